@@ -0,0 +1,77 @@
+#ifndef BUS_SCHEDULER_H_
+#define BUS_SCHEDULER_H_
+
+#include "config_yaml.h"
+#include "meter_profiles.h"
+#include "modbus_poller.h"
+#include <chrono>
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <optional>
+#include <vector>
+
+/**
+ * @class BusScheduler
+ * @brief Decides which meter on a shared Modbus bus is polled next.
+ *
+ * @details
+ * Every meter contributes one task per rate class (fast measurements, slow
+ * energy counters). Tasks run earliest-deadline-first, so requests to
+ * different meters interleave and a slow class never delays a fast one for
+ * longer than a single task. The expected cost of a task is derived from the
+ * baud rate and the RTU frame sizes of its block reads plus a learned device
+ * turnaround time. A meter that stops answering is backed off exponentially,
+ * so its timeouts only cost bus time once per retry interval.
+ *
+ * The scheduler performs no I/O; it is driven by the meter master poll loop.
+ */
+class BusScheduler {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Task {
+    size_t device{0};
+    MeterProfiles::Rate rate{MeterProfiles::Rate::FAST};
+    Clock::duration period{};
+    Clock::duration wireTime{}; // request and response frames on the wire
+    size_t transactions{0};     // block reads per run
+    Clock::time_point due{};
+    uint32_t runs{0}; // successful runs in the current metrics window
+  };
+
+  BusScheduler(const MeterMasterConfig &cfg, const ModbusPoller &poller);
+
+  void reset(Clock::time_point now);
+  std::optional<size_t> next(Clock::time_point now, Clock::time_point &wakeAt);
+  bool complete(size_t task, Clock::time_point now, Clock::duration elapsed);
+  bool fail(size_t task, Clock::time_point now, Clock::duration elapsed);
+  void markOffline(void);
+
+  const Task &task(size_t task) const { return tasks_[task]; }
+  bool isOnline(size_t device) const { return devices_[device].online; }
+  double expectedLoad(void) const;
+  nlohmann::ordered_json metrics(Clock::time_point now);
+
+private:
+  struct DeviceState {
+    bool online{false};
+    int failures{0};
+    Clock::time_point retryAt{};
+    Clock::duration turnaround{}; // learned response latency per transaction
+    Clock::duration busy{};       // bus time used in the current window
+    uint32_t timeouts{0};         // failed runs in the current window
+  };
+
+  Clock::duration frameTime(size_t chars) const;
+  Clock::duration expectedCost(const Task &task) const;
+
+  const MeterMasterConfig &cfg_;
+  const ModbusPoller &poller_;
+  std::vector<Task> tasks_;
+  std::vector<DeviceState> devices_;
+  Clock::duration charTime_{};
+  Clock::duration frameGap_{};
+  Clock::time_point windowStart_{};
+};
+
+#endif /* BUS_SCHEDULER_H_ */
@@ -1,11 +1,14 @@
 #ifndef CONFIG_YAML_HPP
 #define CONFIG_YAML_HPP
 
+#include <array>
 #include <map>
 #include <optional>
+#include <sched.h>
 #include <spdlog/spdlog.h>
 #include <string>
 #include <termios.h>
+#include <vector>
 
 // ---------------------------------------------------------------------------
 // Serial types
@@ -13,6 +16,13 @@
 
 enum class Parity { None, Even, Odd };
 
+// ---------------------------------------------------------------------------
+// Meter protocol types
+// ---------------------------------------------------------------------------
+
+enum class MeterProtocol { Obis, Dsmr, Sml, Modbus, Mbus };
+enum class ModbusMeterModel { SDM630, EM24 };
+
 // ---------------------------------------------------------------------------
 // Conversion helpers (defined in config_yaml.cpp)
 // ---------------------------------------------------------------------------
@@ -29,11 +39,13 @@ void applyParity(termios &tty, Parity parity);
 struct ModbusTcpClientConfig {
   std::string host;
   int port{502};
+  bool operator==(const ModbusTcpClientConfig &) const = default;
 };
 
 struct ModbusTcpServerConfig {
   std::string listen{"0.0.0.0"};
   int port{502};
+  bool operator==(const ModbusTcpServerConfig &) const = default;
 };
 
 struct ModbusRtuConfig {
@@ -42,6 +54,7 @@ struct ModbusRtuConfig {
   int dataBits{8};
   int stopBits{1};
   Parity parity{Parity::None};
+  bool operator==(const ModbusRtuConfig &) const = default;
 };
 
 // ---------------------------------------------------------------------------
@@ -68,13 +81,79 @@ struct GridConfig {
   double powerFactor{0.95};
   double frequency{50.0};
   bool isLeading{false};
+  bool operator==(const GridConfig &) const = default;
+};
+
+// --- Modbus polling config ---
+struct ModbusDeviceConfig {
+  std::string name; // MQTT sub-topic, empty for a single meter
+  int slaveId{1};
+  ModbusMeterModel model{ModbusMeterModel::SDM630};
+};
+
+struct ModbusPollConfig {
+  ModbusMeterModel model{ModbusMeterModel::SDM630};
+  int pollInterval{1000};    // milliseconds, fast registers (power, voltage)
+  int energyInterval{10000}; // milliseconds, slow registers (energy counters)
+  int metricsInterval{60};   // seconds
+  int maxGap{8};             // unused registers a merged block read may span
+  ResponseTimeoutConfig responseTimeout{0, 500000};
+  ReconnectDelayConfig retryDelay{2, 60, true}; // back-off of dead meters
+  std::vector<ModbusDeviceConfig> devices;      // meters sharing the bus
+};
+
+// --- Telegram source config (protocol obis, dsmr and sml) ---
+struct TelegramSourceConfig {
+  int readTimeout{5};      // seconds without data before reconnecting
+  int keepalive{30};       // TCP keepalive idle time in seconds, 0 = off
+  int rcvLowat{0};         // SO_RCVLOWAT in bytes, 0 = kernel default
+  bool noDelay{true};      // TCP_NODELAY
+  int metricsInterval{60}; // seconds between two line metrics messages
+  int maxRetries{3};       // errors in a row before the port is reopened
+  ReconnectDelayConfig reconnectDelay{1, 60, true};
+};
+
+// --- IEC 62056-21 mode C readout (protocol obis, rtu only) ---
+struct IecReadoutConfig {
+  int interval{10};    // seconds between two readouts
+  int maxBaud{19200};  // upper limit of the baud rate switch
+  std::string address; // device address of the request, empty = any meter
+};
+
+// --- Wired M-Bus master (protocol mbus, rtu only) ---
+struct MbusDeviceConfig {
+  std::string name;      // MQTT sub-topic
+  int address{-1};       // primary address 0-250, -1 = secondary addressing
+  std::string secondary; // "IIIIIIIIMMMMVVDD", 'F' nibbles are wildcards
+};
+
+struct MbusPollConfig {
+  int interval{60}; // seconds between two poll cycles
+  int retries{2};   // repeated requests before a meter counts as offline
+  ResponseTimeoutConfig responseTimeout{0, 500000}; // silence ends an answer
+  bool scan{false}; // secondary address scan after the first cycle
+  std::vector<MbusDeviceConfig> devices;
+};
+
+// --- AES-128-GCM encrypted P1 port (protocol obis and dsmr) ---
+struct DecryptionConfig {
+  using Key = std::array<unsigned char, 16>;
+  Key key{};                  // per-meter encryption key (GUEK)
+  std::optional<Key> authKey; // authentication key (GAK), if the meter uses it
 };
 
 struct MeterMasterConfig {
+  std::string name; // MQTT sub-topic, empty for a single meter
+  MeterProtocol protocol{MeterProtocol::Obis};
   std::optional<ModbusTcpClientConfig> tcp;
   std::optional<ModbusRtuConfig> rtu;
   int slaveId{1};
   GridConfig grid;
+  ModbusPollConfig modbus;
+  TelegramSourceConfig telegram;
+  std::optional<IecReadoutConfig> iec; // sign on instead of waiting for data
+  std::optional<DecryptionConfig> decryption;
+  std::optional<MbusPollConfig> mbus;
 };
 
 struct MeterSlaveConfig {
@@ -87,7 +166,8 @@ struct MeterSlaveConfig {
 };
 
 struct MeterConfig {
-  MeterMasterConfig master;
+  std::vector<MeterMasterConfig> masters; // meter.master or meter.meters
+  int threads{1};                         // event loops for telegram sources
   std::optional<MeterSlaveConfig> slave;
 };
 
@@ -111,9 +191,109 @@ struct MqttConfig {
 
 struct LoggerConfig {
   spdlog::level::level_enum globalLevel{spdlog::level::info};
+  size_t queueSize{8192}; // messages buffered for the logging thread
   std::map<std::string, spdlog::level::level_enum> moduleLevels;
 };
 
+// ---------------------------------------------------------------------------
+// Snapshot config
+// ---------------------------------------------------------------------------
+
+struct SnapshotConfig {
+  std::string path;  // file holding the last good readings
+  int interval{60};  // seconds between two writes, also written on shutdown
+  int maxAge{86400}; // seconds, older snapshots are not loaded
+};
+
+// ---------------------------------------------------------------------------
+// Stats config
+// ---------------------------------------------------------------------------
+
+struct StatsConfig {
+  int interval{60}; // seconds between two resource samples, 0 = off
+};
+
+// ---------------------------------------------------------------------------
+// HTTP API config
+// ---------------------------------------------------------------------------
+
+struct HttpConfig {
+  std::string listen{"0.0.0.0"};
+  int port{8080};
+  int longPoll{30};     // seconds a request with ?after= waits at most
+  int maxClients{1024}; // open connections, further ones are refused
+  int streamQueue{64};  // frames queued for a stream subscriber at most
+  bool operator==(const HttpConfig &) const = default;
+};
+
+// ---------------------------------------------------------------------------
+// Sink config
+// ---------------------------------------------------------------------------
+
+enum class DropPolicy { Oldest, Newest };
+
+struct SinkOptions {
+  int queue{1024};                     // records waiting at most
+  int batch{64};                       // records per write at most
+  int flushInterval{0};                // ms to wait for a full batch
+  DropPolicy drop{DropPolicy::Oldest}; // record dropped from a full queue
+  bool operator==(const SinkOptions &) const = default;
+};
+
+struct FileSinkConfig {
+  std::string path;      // JSON lines, appended
+  bool telegrams{false}; // raw telegrams too, hex encoded
+  bool operator==(const FileSinkConfig &) const = default;
+};
+
+struct InfluxSinkConfig {
+  std::string host; // UDP listener, e.g. Telegraf socket_listener
+  int port{8094};
+  std::string socket;                      // or a Unix datagram socket
+  std::string measurement{"smartmeter"};   // of every line
+  std::map<std::string, std::string> tags; // added to every line
+  int packetSize{1400};                    // datagram bytes at most
+  bool operator==(const InfluxSinkConfig &) const = default;
+};
+
+struct SinkConfig {
+  std::string type; // registered sink type, e.g. "file"
+  std::string name; // unique, defaults to the type
+  SinkOptions options;
+  std::optional<FileSinkConfig> file;
+  std::optional<InfluxSinkConfig> influx;
+  bool operator==(const SinkConfig &) const = default;
+};
+
+// ---------------------------------------------------------------------------
+// Flight recorder config
+// ---------------------------------------------------------------------------
+
+struct RecorderConfig {
+  std::string path;       // trace file written on SIGUSR2 or after an error
+  int events{4096};       // ring size per thread
+  bool dumpOnError{true}; // dump after a fatal or transient error
+
+  bool operator==(const RecorderConfig &) const = default;
+};
+
+// ---------------------------------------------------------------------------
+// Scheduling config
+// ---------------------------------------------------------------------------
+
+struct ThreadTuningConfig {
+  int policy{SCHED_OTHER}; // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+  int priority{0};         // 1-99 with SCHED_FIFO and SCHED_RR
+  std::vector<int> cpus;   // CPU affinity, empty = all CPUs
+};
+
+struct SchedulingConfig {
+  ThreadTuningConfig meter; // event loops and Modbus bus threads
+  ThreadTuningConfig slave; // Modbus server, its client threads inherit it
+  ThreadTuningConfig mqtt;  // MQTT publisher, HTTP API and sinks
+  bool lockMemory{false};   // mlockall(), small prefaulted stacks
+};
+
 // ---------------------------------------------------------------------------
 // Root config
 // ---------------------------------------------------------------------------
@@ -122,6 +302,12 @@ struct AppConfig {
   MeterConfig meter;
   MqttConfig mqtt;
   LoggerConfig logger;
+  std::optional<SnapshotConfig> snapshot;
+  std::optional<SchedulingConfig> scheduling;
+  StatsConfig stats;
+  std::optional<RecorderConfig> recorder;
+  std::optional<HttpConfig> http;
+  std::vector<SinkConfig> sinks;
 };
 
 AppConfig loadConfig(const std::string &path);
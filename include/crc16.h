@@ -0,0 +1,50 @@
+#ifndef CRC16_H_
+#define CRC16_H_
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+namespace Crc16 {
+
+namespace detail {
+
+// --- Lookup table of a reflected CRC16, one entry per input byte ---
+template <uint16_t Poly> constexpr std::array<uint16_t, 256> makeTable() {
+  std::array<uint16_t, 256> table{};
+  for (unsigned i = 0; i < 256; ++i) {
+    uint16_t crc = static_cast<uint16_t>(i);
+    for (int bit = 0; bit < 8; ++bit)
+      crc = (crc & 1) ? static_cast<uint16_t>((crc >> 1) ^ Poly) : crc >> 1;
+    table[i] = crc;
+  }
+  return table;
+}
+
+template <uint16_t Poly>
+inline constexpr std::array<uint16_t, 256> table = makeTable<Poly>();
+
+template <uint16_t Poly>
+constexpr uint16_t update(uint16_t crc, std::string_view data) {
+  for (unsigned char c : data)
+    crc = static_cast<uint16_t>((crc >> 8) ^ table<Poly>[(crc ^ c) & 0xff]);
+  return crc;
+}
+
+} // namespace detail
+
+// --- CRC-16/X-25 (CCITT, reflected), used by the SML transport layer ---
+constexpr uint16_t x25(std::string_view data) {
+  return detail::update<0x8408>(0xffff, data) ^ 0xffff;
+}
+static_assert(x25("123456789") == 0x906e);
+
+// --- CRC-16/ARC (IBM, reflected), used by DSMR P1 telegrams ---
+constexpr uint16_t arc(std::string_view data) {
+  return detail::update<0xa001>(0x0000, data);
+}
+static_assert(arc("123456789") == 0xbb3d);
+
+} // namespace Crc16
+
+#endif /* CRC16_H_ */
@@ -0,0 +1,60 @@
+#ifndef FLIGHT_RECORDER_H_
+#define FLIGHT_RECORDER_H_
+
+#include "config_yaml.h"
+#include "modbus_error.h"
+#include <cstdint>
+#include <expected>
+
+/**
+ * Flight recorder: the last events of every thread, dumped on demand.
+ *
+ * Each thread that records gets a ring of fixed size, claimed on its first
+ * event and handed on to a new thread when it exits. Recording is a handful
+ * of relaxed stores into the ring of the calling thread, no lock and no
+ * allocation; a sequence number per slot lets the dump skip a slot that is
+ * overwritten while it is copied. An event is a monotonic timestamp, its
+ * type and up to three numbers (48 bytes).
+ *
+ * SIGUSR2 dumps the rings to a Chrome trace file (JSON, open it in Perfetto
+ * or chrome://tracing); with dump_on_error a fatal or transient error does
+ * the same, at most once per DUMP_INTERVAL. The dump runs in the main thread,
+ * the thread hitting the error only raises the signal.
+ */
+namespace FlightRecorder {
+
+/** Least time between two dumps triggered by errors, in seconds. */
+constexpr int DUMP_INTERVAL = 60;
+
+enum class Event : uint32_t {
+  BYTES_READ,     /**< bytes */
+  FRAME_START,    /**< format */
+  FRAME_END,      /**< length, µs since frame start */
+  PARSE,          /**< protocol, 1 on success, µs */
+  CALLBACK,       /**< length of the values JSON, µs in the callback */
+  MQTT_ENQUEUE,   /**< length, messages queued for the topic */
+  MQTT_PUBLISH,   /**< length, mosquitto rc, µs since enqueued */
+  MODBUS_REQUEST, /**< function code, first address, register count */
+  MODBUS_REPLY,   /**< function code, reply length or -1, µs since request */
+  RECONNECT,      /**< errno, delay in ms */
+  ERROR,          /**< errno, severity */
+};
+
+/** Start recording, before the threads to record are started. */
+void enable(const RecorderConfig &cfg);
+
+/** Append an event to the ring of the calling thread, no-op if disabled. */
+void record(Event event, int64_t a = 0, int64_t b = 0, int64_t c = 0);
+
+/** Record an error and, with dump_on_error, request a dump (SIGUSR2). */
+void recordError(const ModbusError &err);
+
+/** True once after an error requested a dump. */
+bool dumpRequested(void);
+
+/** Write all rings to the trace file, from the main thread. */
+std::expected<void, ModbusError> dump(void);
+
+} // namespace FlightRecorder
+
+#endif /* FLIGHT_RECORDER_H_ */
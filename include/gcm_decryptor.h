@@ -0,0 +1,65 @@
+#ifndef GCM_DECRYPTOR_H_
+#define GCM_DECRYPTOR_H_
+
+#include "modbus_error.h"
+#include <array>
+#include <cstdint>
+#include <expected>
+#include <optional>
+#include <string>
+
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
+/**
+ * @class GcmDecryptor
+ * @brief Decrypts AES-128-GCM protected P1 frames in place.
+ *
+ * @details
+ * Luxembourg (smarty), Austrian and DSMR E-MUCS meters wrap their telegram
+ * in a DLMS general-glo-ciphering frame:
+ *
+ *   db 08 <system title> <length> 30 <frame counter> <ciphertext> <tag>
+ *
+ * The initialisation vector is the system title followed by the frame
+ * counter, the additional authenticated data is the security control byte
+ * followed by the authentication key, and the tag is truncated to 12 bytes.
+ * Frames with security control 0x20 (encryption only, some Austrian meters)
+ * carry no tag and rely on the CRC16 of the decrypted telegram.
+ * The OpenSSL cipher context is set up once per key, so a frame only costs
+ * an IV update and a single pass over the ciphertext; OpenSSL picks AES-NI
+ * or the ARMv8 crypto extensions at run time. A frame counter that does not
+ * increase is rejected as a replay. The counter of a frame without tag only
+ * counts once accept() confirms that its telegram parsed, so a counter byte
+ * hit by line noise cannot lock out the frames that follow.
+ */
+class GcmDecryptor {
+public:
+  static constexpr size_t KEY_SIZE = 16;
+  static constexpr size_t TAG_SIZE = 12;
+  static constexpr size_t TITLE_SIZE = 8;
+  using Key = std::array<unsigned char, KEY_SIZE>;
+
+  GcmDecryptor(void);
+  ~GcmDecryptor();
+  GcmDecryptor(const GcmDecryptor &) = delete;
+  GcmDecryptor &operator=(const GcmDecryptor &) = delete;
+
+  std::expected<void, ModbusError> setKeys(const Key &key,
+                                           const std::optional<Key> &authKey);
+  std::expected<void, ModbusError> decrypt(std::string &frame);
+  /** @brief Takes over the counter of the last frame for replay checks. */
+  void accept(void);
+
+  uint32_t frameCounter(void) const { return frameCounter_; }
+  const std::string &systemTitle(void) const { return systemTitle_; }
+
+private:
+  EVP_CIPHER_CTX *ctx_{nullptr};
+  std::optional<Key> authKey_;
+  std::string systemTitle_; // of the last frame, raw bytes
+  uint32_t frameCounter_{0};    // of the last frame decrypted
+  uint32_t acceptedCounter_{0}; // highest counter of a valid telegram
+  bool hasCounter_{false};
+};
+
+#endif /* GCM_DECRYPTOR_H_ */
@@ -0,0 +1,159 @@
+#ifndef HTTP_SERVER_H_
+#define HTTP_SERVER_H_
+
+#include "config_yaml.h"
+#include "logger.h"
+#include "modbus_error.h"
+#include "signal_handler.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <expected>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <spdlog/logger.h>
+#include <string>
+#include <sys/epoll.h>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * @class HttpServer
+ * @brief Read-only HTTP/1.1 API serving and streaming the latest documents.
+ *
+ * @details
+ * Every document published over MQTT is also kept under the path of its
+ * topic below the root, e.g. /values, /device and /stats for a single meter
+ * or /<name>/values with several. A document is the serialized JSON shared
+ * by all responses (one reference per connection, never copied) and a
+ * sequence number counting its updates, i.e. telegrams for the values.
+ *
+ * The ETag of a response is the sequence number, so polling clients get
+ * 304 Not Modified with If-None-Match. With ?after=<seq> a request that
+ * would return the same sequence waits until the document changes or the
+ * long-poll timeout expires (304). The server is a single epoll thread with
+ * non-blocking sockets; a waiting client costs a descriptor and a few
+ * hundred bytes, no thread and no timer of its own.
+ *
+ * The same paths stream every update as Server-Sent Events (Accept:
+ * text/event-stream) or WebSocket text messages (Upgrade: websocket), at
+ * most one per ?interval=<ms> if given. An update is encoded once per
+ * protocol and the frame is shared by the send queues of all subscribers,
+ * which are written with one sendmsg each. A subscriber with more than
+ * stream_queue frames unsent is dropped instead of buffering for it.
+ */
+class HttpServer {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  HttpServer(const HttpConfig &cfg, SignalHandler &signalHandler);
+  ~HttpServer();
+
+  // --- Delete copy and assignment ---
+  HttpServer(const HttpServer &) = delete;
+  HttpServer &operator=(const HttpServer &) = delete;
+
+  // Replaces a document (e.g. "/values") and answers waiting clients;
+  // safe from any thread
+  void publish(const std::string &path, std::string json);
+
+  // Server thread, for naming and scheduling after startup
+  std::vector<std::thread::native_handle_type> threads(void);
+
+private:
+  static constexpr size_t MAX_REQUEST = 8192;
+  static constexpr std::chrono::seconds IDLE_TIMEOUT{60};
+  static constexpr std::chrono::seconds HEARTBEAT{15}; // idle streams
+  static constexpr size_t MAX_IOV = 64;                // frames per sendmsg
+
+  struct Document {
+    std::shared_ptr<const std::string> body;
+    uint64_t seq{0};
+  };
+
+  using Frame = std::shared_ptr<const std::string>;
+
+  enum class Mode { REQUEST, SSE, WEBSOCKET };
+
+  // Last update encoded for the subscribers of a path
+  struct Encoded {
+    uint64_t seq{0};
+    Frame sse;
+    Frame websocket;
+  };
+
+  struct Connection {
+    int fd{-1};
+    Mode mode{Mode::REQUEST};
+    std::string request;      // bytes read, not yet handled
+    std::deque<Frame> out;    // head and body, or stream frames
+    size_t sent{0};           // of the first frame
+    uint32_t events{EPOLLIN}; // registered epoll events
+    bool keepAlive{true};
+    bool closing{false};  // closed after the current batch of events
+    std::string waitPath; // long-poll: document waited for, empty if none
+    uint64_t after{0};    // long-poll: sequence already known
+    bool headOnly{false}; // long-poll: HEAD request
+    Clock::time_point deadline;
+
+    // --- streams ---
+    std::string streamPath;
+    std::chrono::milliseconds interval{0}; // least time between updates
+    Clock::time_point nextSend;            // throttled until
+    Frame pending;                         // latest update while throttled
+  };
+
+  std::expected<void, ModbusError> startListener(void);
+  void run(void);
+  void acceptClients(void);
+  void onClient(int fd, uint32_t events);
+  void readRequest(Connection &conn);
+  void handleRequest(Connection &conn);
+  void respond(Connection &conn, int status, Frame body, uint64_t seq,
+               bool headOnly);
+  void subscribe(Connection &conn, Mode mode, const std::string &path,
+                 std::string head, std::chrono::milliseconds interval);
+  void readFrames(Connection &conn);
+  Frame encode(const std::string &path, Mode mode);
+  void deliver(Connection &conn, Frame frame);
+  void enqueue(Connection &conn, Frame frame);
+  void flush(Connection &conn);
+  void watch(Connection &conn, uint32_t events);
+  void onPublished(void);
+  void onStreamTimer(Connection &conn, Clock::time_point now);
+  void setDeadline(Connection &conn, Clock::time_point deadline);
+  void expire(Clock::time_point now);
+  void closeClient(Connection &conn);
+  void reap(void);
+
+  const HttpConfig &cfg_;
+  SignalHandler &handler_;
+  std::shared_ptr<spdlog::logger> httpLogger_;
+  LogLimiter dropLog_; // slow stream subscribers
+  std::string etagPrefix_; // start time, a restart never reuses an ETag
+
+  // --- documents, written by publish() ---
+  std::mutex mutex_;
+  std::map<std::string, Document> documents_;
+  std::vector<std::string> changed_; // paths published since the last wake
+
+  // --- server thread only ---
+  int listenFd_{-1};
+  int epollFd_{-1};
+  int wakeFd_{-1};
+  std::unordered_map<int, Connection> connections_;
+  std::set<std::pair<Clock::time_point, int>> deadlines_;
+  std::multimap<std::string, int> waiting_; // long-poll clients by path
+  std::multimap<std::string, int> streams_; // stream subscribers by path
+  std::map<std::string, Encoded> encoded_;
+  std::vector<int> closing_;
+  bool listenPaused_{false}; // out of descriptors
+  std::thread worker_;
+};
+
+#endif /* HTTP_SERVER_H_ */
@@ -2,21 +2,39 @@
 #define LOGGER_H_
 
 #include "config_yaml.h"
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <spdlog/async.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
+#include <type_traits>
+#include <utility>
 
+// Log calls only format and enqueue the message; a single background thread
+// writes to stdout (journald). The queue is a ring allocated once at
+// startup; when it is full the oldest message is overwritten, so a slow
+// console never blocks the meter or Modbus threads. Call before starting any
+// other thread but after the SignalHandler, whose signal mask the logging
+// thread has to inherit.
 inline void setupLogging(const LoggerConfig &cfg) {
+  spdlog::init_thread_pool(cfg.queueSize, 1);
+
   // single console sink
   auto sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
 
   // default/global logger
-  auto defaultLogger = std::make_shared<spdlog::logger>("", sink);
+  auto defaultLogger = std::make_shared<spdlog::async_logger>(
+      "", sink, spdlog::thread_pool(),
+      spdlog::async_overflow_policy::overrun_oldest);
   defaultLogger->set_level(cfg.globalLevel);
   spdlog::set_default_logger(defaultLogger);
 
   // per-module loggers
   for (const auto &kv : cfg.moduleLevels) {
-    auto logger = std::make_shared<spdlog::logger>(kv.first, sink);
+    auto logger = std::make_shared<spdlog::async_logger>(
+        kv.first, sink, spdlog::thread_pool(),
+        spdlog::async_overflow_policy::overrun_oldest);
     logger->set_level(kv.second);
     spdlog::register_logger(logger);
   }
@@ -25,4 +43,85 @@ inline void setupLogging(const LoggerConfig &cfg) {
   spdlog::set_pattern("[%n] [%^%l%$] %v");
 }
 
+// Applies changed log levels of a reloaded config to the running loggers
+inline void reloadLogging(const LoggerConfig &cfg) {
+  // Modules dropped from the config fall back to the global level; a module
+  // new to the config keeps logging through the default logger until restart
+  spdlog::apply_all([&cfg](std::shared_ptr<spdlog::logger> logger) {
+    auto it = cfg.moduleLevels.find(logger->name());
+    logger->set_level(it != cfg.moduleLevels.end() ? it->second
+                                                   : cfg.globalLevel);
+  });
+}
+
+/**
+ * @class LogLimiter
+ * @brief Rate limit for one log call site that can repeat in a storm.
+ *
+ * @details
+ * Lets BURST messages through per WINDOW and counts the rest. The first
+ * message of the next window is followed by the number suppressed
+ * meanwhile ("... 37 similar message(s) suppressed"). Safe to share between
+ * threads.
+ *
+ * An argument may be a callable without parameters, e.g.
+ * [&err] { return err.describe(); }; it is only invoked for a message that
+ * is let through, so a suppressed one costs neither formatting nor an
+ * allocation.
+ */
+class LogLimiter {
+  // Type an argument is formatted as, the result of a callable
+  template <typename T, bool = std::is_invocable_v<T>> struct Lazy {
+    using type = T;
+  };
+  template <typename T> struct Lazy<T, true> {
+    using type = std::invoke_result_t<T>;
+  };
+
+  template <typename T> static decltype(auto) resolve(T &&arg) {
+    if constexpr (std::is_invocable_v<T>)
+      return std::forward<T>(arg)();
+    else
+      return std::forward<T>(arg);
+  }
+
+public:
+  static constexpr int BURST = 5;
+  static constexpr std::chrono::seconds WINDOW{60};
+
+  template <typename... Args>
+  void log(spdlog::logger &logger, spdlog::level::level_enum level,
+           spdlog::format_string_t<typename Lazy<Args>::type...> fmt,
+           Args &&...args) {
+    if (!logger.should_log(level))
+      return;
+
+    uint64_t suppressed = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      const auto now = std::chrono::steady_clock::now();
+      if (now - windowStart_ >= WINDOW) {
+        windowStart_ = now;
+        passed_ = 0;
+      }
+      if (passed_ >= BURST) {
+        ++suppressed_;
+        return;
+      }
+      ++passed_;
+      std::swap(suppressed, suppressed_);
+    }
+
+    logger.log(level, fmt, resolve(std::forward<Args>(args))...);
+    if (suppressed)
+      logger.log(level, "... {} similar message(s) suppressed", suppressed);
+  }
+
+private:
+  std::mutex mutex_;
+  std::chrono::steady_clock::time_point windowStart_{};
+  int passed_{0};
+  uint64_t suppressed_{0};
+};
+
 #endif /* LOGGER_H_ */
@@ -0,0 +1,69 @@
+#ifndef MBUS_DECODER_H_
+#define MBUS_DECODER_H_
+
+#include "modbus_error.h"
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <string>
+#include <string_view>
+
+/**
+ * @class MbusDecoder
+ * @brief Builds M-Bus requests and decodes RSP_UD long frames.
+ *
+ * @details
+ * Covers the parts of EN 13757-2/-3 a wired M-Bus master needs: short
+ * frames for SND_NKE and REQ_UD2, the SND_UD long frame selecting a meter
+ * by its secondary address, and the variable data structure of a RSP_UD
+ * answer with CI field 0x72. The fixed header is returned, every data
+ * record is handed to the visitor with its value scaled to a canonical unit
+ * (kWh, m3, kg, kW, m3/h, °C, K, bar, s, V, A) as given by the DIF/VIF
+ * tables. Records with unknown units are passed on as "unknown" with the
+ * raw value. Manufacturer specific data ends the record list.
+ */
+class MbusDecoder {
+public:
+  // --- Control field, addresses and single character answer ---
+  static constexpr uint8_t SND_NKE = 0x40;
+  static constexpr uint8_t REQ_UD2 = 0x5b;
+  static constexpr uint8_t SND_UD = 0x53;
+  static constexpr uint8_t FCB = 0x20;
+  static constexpr uint8_t ADDRESS_SECONDARY = 0xfd;
+  static constexpr char ACK = '\xe5';
+
+  struct Header {
+    std::string id;           /**< Identification number, 8 digits */
+    std::string manufacturer; /**< Three letter FLAG code */
+    uint8_t version{0};
+    uint8_t medium{0}; /**< Device type, e.g. 4 heat, 7 water */
+    uint8_t access{0}; /**< Access number, increments per answer */
+    uint8_t status{0};
+    uint16_t rawManufacturer{0};
+    bool moreFollows{false}; /**< Another RSP_UD is ready (DIF 0x1f) */
+
+    std::string secondaryAddress(void) const;
+  };
+
+  struct Record {
+    const char *quantity{"unknown"}; /**< e.g. "energy", "flow_temperature" */
+    std::string unit;
+    double value{0.0};
+    std::string text;    /**< Dates and ASCII values */
+    uint32_t storage{0}; /**< 0 = current value, 1.. = historic values */
+    uint32_t tariff{0};
+    uint32_t subunit{0};
+    uint8_t function{0}; /**< 0 instantaneous, 1 maximum, 2 minimum, 3 error */
+    bool numeric{false};
+  };
+
+  using Visitor = std::function<void(const Record &)>;
+
+  static std::string shortFrame(uint8_t control, uint8_t address);
+  static std::string selectFrame(std::string_view secondary);
+  static std::expected<Header, ModbusError> decode(std::string_view frame,
+                                                   const Visitor &visitor);
+  static const char *mediumName(uint8_t medium);
+};
+
+#endif /* MBUS_DECODER_H_ */
@@ -1,45 +1,178 @@
 #ifndef METER_MASTER_H_
 #define METER_MASTER_H_
 
+#include "bus_scheduler.h"
 #include "config_yaml.h"
+#include "gcm_decryptor.h"
+#include "logger.h"
+#include "mbus_decoder.h"
+#include "meter_reactor.h"
 #include "meter_types.h"
 #include "modbus_error.h"
+#include "modbus_poller.h"
 #include "signal_handler.h"
-#include <condition_variable>
+#include "telegram_framer.h"
+#include <algorithm>
+#include <chrono>
 #include <expected>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <nlohmann/json.hpp>
+#include <optional>
+#include <random>
 #include <spdlog/logger.h>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <vector>
 
-class MeterMaster {
+class MeterMaster : public MeterReactor::Source {
 public:
+  using Clock = MeterReactor::Clock;
+
   explicit MeterMaster(const MeterMasterConfig &cfg,
-                       SignalHandler &signalHandler);
+                       SignalHandler &signalHandler, MeterReactor &reactor);
   virtual ~MeterMaster();
 
   std::string getJsonDump(void) const;
   MeterTypes::Values getValues(void) const;
-  void
-  setUpdateCallback(std::function<void(std::string, MeterTypes::Values)> cb);
-  void
-  setDeviceCallback(std::function<void(std::string, MeterTypes::Device)> cb);
-  void setAvailabilityCallback(std::function<void(std::string)> cb);
+  // --- callbacks receive the meter name, empty for a single meter ---
+  using UpdateCallback = std::function<void(
+      const std::string &source, std::string, MeterTypes::Values)>;
+  using DeviceCallback = std::function<void(
+      const std::string &source, std::string, MeterTypes::Device)>;
+  using AvailabilityCallback =
+      std::function<void(const std::string &source, std::string)>;
+  // Frame as received, before decryption; telegram protocols only
+  using TelegramCallback = std::function<void(const std::string &source,
+                                              const std::string &telegram)>;
+
+  void setUpdateCallback(UpdateCallback cb);
+  void setDeviceCallback(DeviceCallback cb);
+  void setAvailabilityCallback(AvailabilityCallback cb);
+  void setTelegramCallback(TelegramCallback cb);
+  void setMetricsCallback(std::function<void(std::string)> cb);
+  std::string primarySource(void) const;
+  // Bus thread of a Modbus meter, telegram sources run on the reactor
+  std::vector<std::thread::native_handle_type> threads(void);
+
+  // Takes effect with the next encrypted frame, e.g. after a config reload
+  void setDecryptionKeys(const DecryptionConfig &keys);
+  // Takes effect with the next telegram or poll, e.g. after a config reload
+  void setGrid(const GridConfig &grid);
 
-  static constexpr size_t BUFFER_SIZE = 64;
+  static constexpr size_t BUFFER_SIZE = 512;
   static constexpr size_t TELEGRAM_SIZE = 368;
+  static constexpr size_t SML_SIZE = 1024;
+  static constexpr size_t DSMR_SIZE = 8192;
+  static constexpr std::chrono::milliseconds TAIL_DELAY{50};
+  static constexpr size_t IDENT_SIZE = 128;
+  static constexpr size_t IEC_SIZE = 8192;
+  static constexpr char IEC_STX = 0x02;
+  static constexpr std::chrono::milliseconds IEC_SWITCH_MARGIN{20};
+  static constexpr size_t MBUS_SIZE = 261;
+  static constexpr int MBUS_MAX_TELEGRAMS = 8;
+
+  // --- MeterReactor::Source (telegram protocols) ---
+  int fd(void) const override;
+  uint32_t events(void) const override;
+  uint64_t generation(void) const override { return fdGeneration_; }
+  Clock::time_point deadline(void) const override {
+    return std::min(deadline_, metricsDeadline_);
+  }
+  void onEvent(uint32_t events) override;
+  void onTimer(Clock::time_point now) override;
 
 private:
-  void runLoop();
+  enum class LinkState : uint8_t { DISCONNECTED, CONNECTING, CONNECTED };
+  enum class IecState : uint8_t { NONE, IDLE, IDENT, SWITCH, DATA };
+  enum class MbusState : uint8_t {
+    NONE,
+    IDLE,
+    RESET,       // SND_NKE sent, waiting for the acknowledgement
+    SELECT,      // secondary address sent, waiting for the acknowledgement
+    REQUEST,     // REQ_UD2 sent, waiting for RSP_UD
+    SCAN_SELECT, // wildcard address sent during a scan
+    SCAN_READ    // REQ_UD2 to the single meter matching the wildcard
+  };
+
+  struct MbusTarget {
+    std::string name;
+    int address{-1};       // primary address, -1 = select by secondary
+    std::string secondary; // "IIIIIIIIMMMMVVDD" with 'F' wildcards
+    std::string id;        // identification number once it has answered
+    bool fcb{false};       // frame count bit of the next REQ_UD2
+    bool online{false};
+    bool missing{false}; // no answer reported, until it answers again
+  };
+
   MeterTypes::ErrorAction
-  handleResult(std::expected<void, ModbusError> &&result);
+  handleResult(std::expected<void, ModbusError> &&result,
+               bool recorded = false);
   void disconnect(void);
   std::expected<void, ModbusError> updateValuesAndJson(void);
   std::expected<void, ModbusError> updateDeviceAndJson(void);
+  std::expected<void, ModbusError> updateFromSml(std::string &file);
+  std::expected<void, ModbusError> updateFromDsmr(std::string_view telegram);
+  std::expected<void, ModbusError> updateFromIec(std::string_view telegram);
+  void deriveValues(MeterTypes::Values &values) const;
+  GridConfig currentGrid(void) const;
   std::expected<void, ModbusError> tryConnect(void);
-  std::expected<void, ModbusError> readTelegram(void);
+  std::chrono::milliseconds reconnectDelay(void);
+
+  // --- Telegram sources: local tty or remote TCP bridge (ser2net) ---
+  std::expected<void, ModbusError> tryConnectTcp(void);
+  std::expected<void, ModbusError> connectSocket(const struct addrinfo *ai);
+  std::expected<void, ModbusError> finishConnect(void);
+  void tuneSocket(void);
+  std::expected<void, ModbusError> readAvailable(void);
+  std::expected<void, ModbusError> processTelegram(std::string telegram);
+  std::expected<void, ModbusError> decryptFrame(std::string &frame);
+  void handleLinkResult(std::expected<void, ModbusError> &&result);
+  bool recover(const ModbusError &err);
+  bool watchDevice(void);
+  void unwatchDevice(void);
+  void onHotplug(void);
+  void publishLineMetrics(void);
+
+  // --- IEC 62056-21 mode C readout (sign-on, baud rate switch) ---
+  std::expected<void, ModbusError> requestReadout(void);
+  std::expected<void, ModbusError> receiveIdent(std::string_view chunk);
+  std::expected<void, ModbusError> switchBaud(void);
+  std::expected<void, ModbusError> setBaud(int baud);
+  std::expected<void, ModbusError> writeSerial(std::string_view data);
+
+  // --- Wired M-Bus master (poll cycle, secondary address scan) ---
+  std::expected<void, ModbusError> onMbusTimer(void);
+  std::expected<void, ModbusError> sendMbus(const std::string &frame,
+                                            MbusState state);
+  std::expected<void, ModbusError> pollMbusTarget(void);
+  std::expected<void, ModbusError> requestMbusData(void);
+  std::expected<void, ModbusError> nextMbusTarget(bool answered);
+  std::expected<void, ModbusError> receiveMbus(std::string_view chunk);
+  std::expected<void, ModbusError> receiveMbusData(std::string_view frame);
+  std::expected<void, ModbusError> receiveMbusFrame(const std::string &frame);
+  std::expected<void, ModbusError> advanceMbusScan(bool collision);
+  void addScannedTarget(const MbusDecoder::Header &header);
+  void publishMbus(MbusTarget &target, const MbusDecoder::Header &header);
+
+  // --- Modbus polling ---
+  void pollLoop();
+  void waitReconnect(void);
+  void waitUntil(BusScheduler::Clock::time_point until);
+  std::expected<void, ModbusError> tryConnectModbus(void);
+  std::expected<void, ModbusError> pollDeviceAndJson(size_t device);
+  std::expected<void, ModbusError>
+  pollValuesAndJson(size_t device, MeterProfiles::Rate rate);
+  void publishAvailability(size_t device, const char *availability);
+  void publishMetrics(BusScheduler::Clock::time_point now);
+
+  // --- JSON payloads shared by all protocols ---
+  static nlohmann::ordered_json
+  buildValuesJson(const MeterTypes::Values &values);
+  static nlohmann::ordered_json
+  buildDeviceJson(const MeterTypes::Device &device);
 
   const MeterMasterConfig &cfg_;
   MeterTypes::Values values_;
@@ -48,15 +181,54 @@ private:
   nlohmann::ordered_json jsonValues_;
   nlohmann::json jsonDevice_;
   std::shared_ptr<spdlog::logger> masterLogger_;
+  std::string label_; // "Meter" or "Meter '<name>'" in log messages
+  LogLimiter transientLog_; // reconnects of a flapping link
+  LogLimiter recoverLog_;   // dropped telegrams and retries
   int serialPort_{-1};
+  int socket_{-1};
+  int hotplugFd_{-1};    // inotify while the tty is unplugged
+  int hotplugWatch_{-1}; // watch on the deepest existing directory
+  uint64_t fdGeneration_{0}; // bumped when fd() is closed
+  int connectFailures_{0};
+  int linkErrors_{0}; // recovered errors since the last good telegram
+  std::minstd_rand rng_{std::random_device{}()};
+  LinkState link_{LinkState::DISCONNECTED};
+  Clock::time_point deadline_{Clock::time_point::max()};
+  Clock::time_point readDeadline_{Clock::time_point::max()};
+  Clock::time_point metricsDeadline_{Clock::time_point::max()};
+  uint64_t parityMarked_{0};           // at the last line metrics message
+  std::optional<uint64_t> uartErrors_; // at the last line metrics message
+  IecState iec_{IecState::NONE};
+  int iecBaud_{0};     // current line speed during mode C readout
+  int iecNextBaud_{0}; // speed acknowledged to the meter
+  std::string identLine_;
+  Clock::time_point nextReadout_;
+  MbusState mbus_{MbusState::NONE};
+  std::vector<MbusTarget> mbusTargets_;
+  size_t mbusIndex_{0};
+  int mbusAttempts_{0};
+  int mbusTelegrams_{0};    // RSP_UD frames of the current meter
+  size_t mbusBytes_{0};     // received since the last request
+  std::string mbusScan_;    // wildcard pattern being probed
+  int mbusScanDigit_{-1};   // last fixed digit of the pattern
+  bool mbusScanned_{false}; // found meters stay in mbusTargets_
+  nlohmann::ordered_json mbusRecords_;
+  MeterTypes::Values mbusValues_;
+  TelegramFramer framer_{TELEGRAM_SIZE};
+  std::unique_ptr<GcmDecryptor> decryptor_;
+  std::optional<DecryptionConfig> pendingKeys_; // guarded by cbMutex_
+  GridConfig grid_;                             // guarded by cbMutex_
+  std::unique_ptr<ModbusPoller> poller_;
+  std::unique_ptr<BusScheduler> scheduler_;
 
   // --- threading / callbacks ---
-  std::function<void(std::string, MeterTypes::Values)> updateCallback_;
-  std::function<void(std::string, MeterTypes::Device)> deviceCallback_;
-  std::function<void(std::string)> availabilityCallback_;
+  UpdateCallback updateCallback_;
+  DeviceCallback deviceCallback_;
+  AvailabilityCallback availabilityCallback_;
+  TelegramCallback telegramCallback_;
+  std::function<void(std::string)> metricsCallback_;
   SignalHandler &handler_;
   mutable std::mutex cbMutex_;
-  std::condition_variable cv_;
   std::thread worker_;
   std::thread dongle_;
 };
@@ -0,0 +1,221 @@
+/**
+ * @file meter_profiles.h
+ * @brief Register maps of Modbus-capable meters polled by the meter master.
+ *
+ * @details
+ * Each profile lists the registers of one meter model together with the
+ * scaling and the `MeterTypes::Values` member the decoded value is stored in.
+ * The Modbus poller merges adjacent registers of the same rate class into as
+ * few block reads as possible, so the order of the fields does not matter.
+ *
+ * Supported models:
+ *   - **SDM630**: Eastron SDM630 (input registers, IEEE float, FC04)
+ *   - **EM24**: Carlo Gavazzi EM24 DIN (holding registers, INT32 LSW first,
+ * FC03)
+ */
+
+#ifndef METER_PROFILES_H_
+#define METER_PROFILES_H_
+
+#include "config_yaml.h"
+#include "meter_types.h"
+#include "register_base.h"
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <span>
+
+namespace MeterProfiles {
+
+/** @brief Modbus function code used to read the registers of a profile. */
+enum class Function : uint8_t {
+  HOLDING = 0x03, /**< FC03 read holding registers */
+  INPUT = 0x04    /**< FC04 read input registers */
+};
+
+/** @brief Order of the 16-bit words of 32-bit values. */
+enum class WordOrder : uint8_t {
+  HIGH_FIRST, /**< Most significant word first (ABCD) */
+  LOW_FIRST   /**< Least significant word first (CDAB) */
+};
+
+/** @brief Poll rate class of a register. */
+enum class Rate : uint8_t {
+  FAST, /**< Fast-changing measurements (power, voltage, current) */
+  SLOW  /**< Slow-changing counters (energy) */
+};
+
+/**
+ * @struct Field
+ * @brief One measurement register and where its value ends up.
+ *
+ * @details
+ * The raw register value is multiplied by `scale` and passed to `apply`,
+ * which stores it in the matching `MeterTypes::Values` member. Registers of
+ * the `SLOW` rate class are polled at the energy interval only.
+ */
+struct Field {
+  Register reg;
+  double scale;
+  void (*apply)(MeterTypes::Values &, double);
+  Rate rate{Rate::FAST};
+};
+
+/**
+ * @struct Profile
+ * @brief Register map and identification of one meter model.
+ */
+struct Profile {
+  const char *manufacturer;
+  const char *model;
+  Function function;
+  WordOrder wordOrder;
+  int phases;
+  std::span<const Field> fields;
+  std::optional<Register> serialNumber; /**< read once with FC03 */
+};
+
+// --- Eastron SDM630 (input registers, float) ---
+namespace SDM630 {
+
+using V = MeterTypes::Values;
+constexpr auto FLOAT = Register::Type::FLOAT;
+
+constexpr std::array<Field, 33> FIELDS{{
+    // phase-to-neutral voltage [V]
+    {{0x0000, 2, FLOAT}, 1.0, [](V &v, double x) { v.phase1.phVoltage = x; }},
+    {{0x0002, 2, FLOAT}, 1.0, [](V &v, double x) { v.phase2.phVoltage = x; }},
+    {{0x0004, 2, FLOAT}, 1.0, [](V &v, double x) { v.phase3.phVoltage = x; }},
+    // current [A]
+    {{0x0006, 2, FLOAT}, 1.0, [](V &v, double x) { v.phase1.current = x; }},
+    {{0x0008, 2, FLOAT}, 1.0, [](V &v, double x) { v.phase2.current = x; }},
+    {{0x000A, 2, FLOAT}, 1.0, [](V &v, double x) { v.phase3.current = x; }},
+    // active power [W]
+    {{0x000C, 2, FLOAT}, 1.0, [](V &v, double x) { v.phase1.activePower = x; }},
+    {{0x000E, 2, FLOAT}, 1.0, [](V &v, double x) { v.phase2.activePower = x; }},
+    {{0x0010, 2, FLOAT}, 1.0, [](V &v, double x) { v.phase3.activePower = x; }},
+    // apparent power [VA]
+    {{0x0012, 2, FLOAT}, 1.0,
+     [](V &v, double x) { v.phase1.apparentPower = x; }},
+    {{0x0014, 2, FLOAT}, 1.0,
+     [](V &v, double x) { v.phase2.apparentPower = x; }},
+    {{0x0016, 2, FLOAT}, 1.0,
+     [](V &v, double x) { v.phase3.apparentPower = x; }},
+    // reactive power [var]
+    {{0x0018, 2, FLOAT}, 1.0,
+     [](V &v, double x) { v.phase1.reactivePower = x; }},
+    {{0x001A, 2, FLOAT}, 1.0,
+     [](V &v, double x) { v.phase2.reactivePower = x; }},
+    {{0x001C, 2, FLOAT}, 1.0,
+     [](V &v, double x) { v.phase3.reactivePower = x; }},
+    // power factor
+    {{0x001E, 2, FLOAT}, 1.0, [](V &v, double x) { v.phase1.powerFactor = x; }},
+    {{0x0020, 2, FLOAT}, 1.0, [](V &v, double x) { v.phase2.powerFactor = x; }},
+    {{0x0022, 2, FLOAT}, 1.0, [](V &v, double x) { v.phase3.powerFactor = x; }},
+    // totals
+    {{0x002A, 2, FLOAT}, 1.0, [](V &v, double x) { v.phVoltage = x; }},
+    {{0x0030, 2, FLOAT}, 1.0, [](V &v, double x) { v.current = x; }},
+    {{0x0034, 2, FLOAT}, 1.0, [](V &v, double x) { v.activePower = x; }},
+    {{0x0038, 2, FLOAT}, 1.0, [](V &v, double x) { v.apparentPower = x; }},
+    {{0x003C, 2, FLOAT}, 1.0, [](V &v, double x) { v.reactivePower = x; }},
+    {{0x003E, 2, FLOAT}, 1.0, [](V &v, double x) { v.powerFactor = x; }},
+    {{0x0046, 2, FLOAT}, 1.0, [](V &v, double x) { v.frequency = x; }},
+    // energy [kWh, kvarh]
+    {{0x0048, 2, FLOAT}, 1.0,
+     [](V &v, double x) { v.activeEnergyImport = x; }, Rate::SLOW},
+    {{0x004A, 2, FLOAT}, 1.0,
+     [](V &v, double x) { v.activeEnergyExport = x; }, Rate::SLOW},
+    {{0x004C, 2, FLOAT}, 1.0,
+     [](V &v, double x) { v.reactiveEnergyImport = x; }, Rate::SLOW},
+    {{0x004E, 2, FLOAT}, 1.0,
+     [](V &v, double x) { v.reactiveEnergyExport = x; }, Rate::SLOW},
+    // phase-to-phase voltage [V]
+    {{0x00C8, 2, FLOAT}, 1.0, [](V &v, double x) { v.phase1.ppVoltage = x; }},
+    {{0x00CA, 2, FLOAT}, 1.0, [](V &v, double x) { v.phase2.ppVoltage = x; }},
+    {{0x00CC, 2, FLOAT}, 1.0, [](V &v, double x) { v.phase3.ppVoltage = x; }},
+    {{0x00CE, 2, FLOAT}, 1.0, [](V &v, double x) { v.ppVoltage = x; }},
+}};
+
+} // namespace SDM630
+
+// --- Carlo Gavazzi EM24 (holding registers, INT32 LSW first) ---
+namespace EM24 {
+
+using V = MeterTypes::Values;
+constexpr auto INT32 = Register::Type::INT32;
+constexpr auto INT16 = Register::Type::INT16;
+
+constexpr std::array<Field, 27> FIELDS{{
+    // phase-to-neutral voltage [V*10]
+    {{0x0000, 2, INT32}, 0.1, [](V &v, double x) { v.phase1.phVoltage = x; }},
+    {{0x0002, 2, INT32}, 0.1, [](V &v, double x) { v.phase2.phVoltage = x; }},
+    {{0x0004, 2, INT32}, 0.1, [](V &v, double x) { v.phase3.phVoltage = x; }},
+    // phase-to-phase voltage [V*10]
+    {{0x0006, 2, INT32}, 0.1, [](V &v, double x) { v.phase1.ppVoltage = x; }},
+    {{0x0008, 2, INT32}, 0.1, [](V &v, double x) { v.phase2.ppVoltage = x; }},
+    {{0x000A, 2, INT32}, 0.1, [](V &v, double x) { v.phase3.ppVoltage = x; }},
+    // current [A*1000]
+    {{0x000C, 2, INT32}, 0.001, [](V &v, double x) { v.phase1.current = x; }},
+    {{0x000E, 2, INT32}, 0.001, [](V &v, double x) { v.phase2.current = x; }},
+    {{0x0010, 2, INT32}, 0.001, [](V &v, double x) { v.phase3.current = x; }},
+    // active power [W*10]
+    {{0x0012, 2, INT32}, 0.1, [](V &v, double x) { v.phase1.activePower = x; }},
+    {{0x0014, 2, INT32}, 0.1, [](V &v, double x) { v.phase2.activePower = x; }},
+    {{0x0016, 2, INT32}, 0.1, [](V &v, double x) { v.phase3.activePower = x; }},
+    // apparent power [VA*10]
+    {{0x0018, 2, INT32}, 0.1,
+     [](V &v, double x) { v.phase1.apparentPower = x; }},
+    {{0x001A, 2, INT32}, 0.1,
+     [](V &v, double x) { v.phase2.apparentPower = x; }},
+    {{0x001C, 2, INT32}, 0.1,
+     [](V &v, double x) { v.phase3.apparentPower = x; }},
+    // reactive power [var*10]
+    {{0x001E, 2, INT32}, 0.1,
+     [](V &v, double x) { v.phase1.reactivePower = x; }},
+    {{0x0020, 2, INT32}, 0.1,
+     [](V &v, double x) { v.phase2.reactivePower = x; }},
+    {{0x0022, 2, INT32}, 0.1,
+     [](V &v, double x) { v.phase3.reactivePower = x; }},
+    // system totals
+    {{0x0024, 2, INT32}, 0.1, [](V &v, double x) { v.phVoltage = x; }},
+    {{0x0026, 2, INT32}, 0.1, [](V &v, double x) { v.ppVoltage = x; }},
+    {{0x0028, 2, INT32}, 0.1, [](V &v, double x) { v.activePower = x; }},
+    {{0x002A, 2, INT32}, 0.1, [](V &v, double x) { v.apparentPower = x; }},
+    {{0x002C, 2, INT32}, 0.1, [](V &v, double x) { v.reactivePower = x; }},
+    // power factor [PF*1000] and frequency [Hz*10]
+    {{0x0031, 1, INT16}, 0.001, [](V &v, double x) { v.powerFactor = x; }},
+    {{0x0033, 1, INT16}, 0.1, [](V &v, double x) { v.frequency = x; }},
+    // energy [kWh*10]
+    {{0x0034, 2, INT32}, 0.1,
+     [](V &v, double x) { v.activeEnergyImport = x; }, Rate::SLOW},
+    {{0x004E, 2, INT32}, 0.1,
+     [](V &v, double x) { v.activeEnergyExport = x; }, Rate::SLOW},
+}};
+
+} // namespace EM24
+
+/**
+ * @brief Look up the register profile of a meter model.
+ * @param model Meter model selected in the configuration.
+ * @return Reference to the static profile of that model.
+ */
+inline const Profile &get(ModbusMeterModel model) {
+  static constexpr Profile sdm630{"Eastron", "SDM630", Function::INPUT,
+                                  WordOrder::HIGH_FIRST, 3, SDM630::FIELDS,
+                                  Register(0xFC00, 2, Register::Type::UINT32)};
+  static constexpr Profile em24{"Carlo Gavazzi", "EM24", Function::HOLDING,
+                                WordOrder::LOW_FIRST, 3, EM24::FIELDS,
+                                std::nullopt};
+
+  switch (model) {
+  case ModbusMeterModel::EM24:
+    return em24;
+  case ModbusMeterModel::SDM630:
+  default:
+    return sdm630;
+  }
+}
+
+} // namespace MeterProfiles
+
+#endif /* METER_PROFILES_H_ */
@@ -0,0 +1,88 @@
+#ifndef METER_REACTOR_H_
+#define METER_REACTOR_H_
+
+#include "signal_handler.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <spdlog/logger.h>
+#include <thread>
+#include <vector>
+
+/**
+ * @class MeterReactor
+ * @brief Small fixed pool of epoll threads driving many telegram sources.
+ *
+ * @details
+ * Meters that push telegrams (local ttys, TCP bridges) do not need a thread
+ * each: they are distributed over a few event loops, each of which waits on
+ * one epoll set. The reactor only knows the file descriptor, the wanted
+ * events and the next deadline of a source; connecting, framing and parsing
+ * stay with the source. The per-source bookkeeping of a loop is a contiguous
+ * array of 16-byte entries, so dozens of meters fit in a few cache lines.
+ *
+ * Sources are added before start() and must outlive the reactor threads,
+ * i.e. stop() (or the destructor) has to run before they are destroyed.
+ * All callbacks of a source run on the same loop thread.
+ */
+class MeterReactor {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  class Source {
+  public:
+    virtual ~Source() = default;
+
+    /** @brief Descriptor to wait on, -1 while disconnected. */
+    virtual int fd(void) const = 0;
+    /** @brief epoll events to wait for (EPOLLIN, EPOLLOUT while connecting). */
+    virtual uint32_t events(void) const = 0;
+    /**
+     * @brief Changes whenever a descriptor returned by fd() is closed.
+     *
+     * The next descriptor may get the same number, which has silently left
+     * the epoll set with the close and has to be added again.
+     */
+    virtual uint64_t generation(void) const { return 0; }
+    /** @brief Next time onTimer() should run. */
+    virtual Clock::time_point deadline(void) const = 0;
+
+    virtual void onEvent(uint32_t events) = 0;
+    virtual void onTimer(Clock::time_point now) = 0;
+  };
+
+  MeterReactor(int threads, SignalHandler &signalHandler);
+  virtual ~MeterReactor();
+
+  void add(Source &source);
+  void start(void);
+  void stop(void);
+
+  // Loop threads, for naming and scheduling after start()
+  std::vector<std::thread::native_handle_type> threads(void);
+
+private:
+  struct Entry {
+    Source *source;
+    int fd;          // descriptor currently registered, -1 if none
+    uint32_t events; // events currently registered
+    uint64_t generation;
+  };
+
+  struct Loop {
+    int epollFd{-1};
+    int wakeFd{-1};
+    std::vector<Entry> entries;
+    std::thread thread;
+  };
+
+  void run(Loop &loop);
+  void sync(Loop &loop, uint32_t idx);
+
+  std::vector<std::unique_ptr<Loop>> loops_;
+  SignalHandler &handler_;
+  std::shared_ptr<spdlog::logger> masterLogger_;
+  bool started_{false};
+};
+
+#endif /* METER_REACTOR_H_ */
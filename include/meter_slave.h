@@ -2,6 +2,7 @@
 #define METER_SLAVE_H_
 
 #include "config_yaml.h"
+#include "logger.h"
 #include "meter_types.h"
 #include "modbus_error.h"
 #include "signal_handler.h"
@@ -12,6 +13,7 @@
 #include <mutex>
 #include <poll.h>
 #include <thread>
+#include <vector>
 
 class MeterSlave {
 public:
@@ -19,10 +21,22 @@ public:
   virtual ~MeterSlave();
   void updateValues(MeterTypes::Values values);
   void updateDevice(MeterTypes::Device device);
+
+  // SunSpec image for a warm start, see Snapshot
+  std::vector<uint16_t> registers(void) const;
+  std::expected<void, ModbusError>
+  restoreRegisters(const std::vector<uint16_t> &image);
+
+  // Listener thread, TCP client threads inherit its scheduling
+  std::vector<std::thread::native_handle_type> threads(void);
+
   static constexpr int MODBUS_REGISTERS = 65535;
 
 private:
   std::shared_ptr<spdlog::logger> modbusLogger_;
+  LogLimiter transientLog_;
+  LogLimiter connectLog_;    // client storms, e.g. a scanner on port 502
+  LogLimiter disconnectLog_; // closed, reset or idle clients
   const MeterSlaveConfig &cfg_;
   MeterTypes::ErrorAction
   handleResult(std::expected<void, ModbusError> &&result);
@@ -34,6 +48,7 @@ private:
   void rtuClientHandler(void);
   void tcpClientHandler();
   void tcpClientWorker(int clientSocket);
+  bool waitRequest(int fd, int timeout);
 
   // --- modbus registers and values
   std::atomic<std::shared_ptr<modbus_mapping_t>> regs_{nullptr};
@@ -49,7 +64,11 @@ private:
   SignalHandler &handler_;
   mutable std::mutex clientMutex_;
   std::thread worker_;
-  std::vector<std::thread> clientThreads_;
+  struct ClientThread {
+    std::thread thread;
+    std::shared_ptr<std::atomic<bool>> done; // set when the worker returns
+  };
+  std::vector<ClientThread> clientThreads_;
 };
 
 #endif /* METER_SLAVE_H_ */
@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <string>
 #include <termios.h>
+#include <vector>
 
 struct MeterTypes {
 
@@ -18,6 +19,16 @@ struct MeterTypes {
     double powerFactor{0.0};
   };
 
+  // --- Sub-meter on an M-Bus channel of the meter (gas, water, heat) ---
+  struct Channel {
+    int id{0};
+    int medium{0}; // M-Bus device type, e.g. 3 gas, 7 water
+    std::string serialNumber;
+    double value{0.0};
+    std::string unit;
+    uint64_t time{0};
+  };
+
   struct Values {
     uint64_t time{0};
     uint64_t activeSensorTime{0};
@@ -38,6 +49,8 @@ struct MeterTypes {
     Phase phase1;
     Phase phase2;
     Phase phase3;
+    int tariff{0};
+    std::vector<Channel> channels;
   };
 
   struct Device {
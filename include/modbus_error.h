@@ -12,11 +12,17 @@
 #ifndef MODBUS_ERROR_H_
 #define MODBUS_ERROR_H_
 
+#include <array>
 #include <cerrno>
+#include <cstddef>
+#include <cstdint>
 #include <expected>
 #include <format>
 #include <modbus/modbus.h>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
 
 /**
  * @struct ModbusError
@@ -26,8 +32,15 @@
  * This struct standardizes error handling for Modbus operations.
  * The severity indicates whether an error is transient (retryable) or fatal
  * (requires intervention). Factory methods support creation from errno or
- * explicit codes, and the `toString()` method combines both context and
+ * explicit codes, and the `describe()` method combines both context and
  * Modbus-specific information in human-readable form.
+ *
+ * Errors are cheap to create: the factories keep the format string (a
+ * literal) and up to MAX_ARGS arguments, numbers by value, and the text is
+ * only formatted when `message()` or `describe()` is called. An error that
+ * is counted, recovered from or logged below the active level never touches
+ * std::format. Only string arguments are copied, short ones without an
+ * allocation.
  */
 struct ModbusError {
 public:
@@ -38,13 +51,12 @@ public:
     SHUTDOWN   /**< Signal shutdown in progress */
   };
 
+  /** @brief Maximum number of format arguments kept for the message. */
+  static constexpr size_t MAX_ARGS = 4;
+
   /** @brief Modbus or system error code (as set in `errno`). */
   int code;
 
-  /** @brief Contextual human-readable message (e.g. "Receive register 40329
-   * failed"). */
-  std::string message;
-
   /** @brief Classified severity of the error. */
   Severity severity;
 
@@ -52,8 +64,8 @@ public:
    * @brief Create a ModbusError from the current system @c errno using a plain
    * message.
    *
-   * This overload should be used when no formatting is required.
-   * The message is stored as-is in the resulting ModbusError.
+   * This overload should be used when no formatting is required. A string
+   * literal is referenced, not copied.
    *
    * @param msg Context message describing the error.
    * @return A ModbusError instance with @c code = errno and a severity deduced
@@ -66,8 +78,14 @@ public:
    * auto err = ModbusError::fromErrno("Failed to connect to Modbus device");
    * @endcode
    */
+  template <size_t N> static ModbusError fromErrno(const char (&msg)[N]) {
+    return ModbusError(errno, std::string_view(msg), false);
+  }
+
+  /** @brief As above, for a message built at runtime (copied). */
   static ModbusError fromErrno(const std::string &msg) {
-    return {errno, msg, deduceSeverity(errno)};
+    const int err = errno;
+    return custom(err, "{}", msg);
   }
 
   /**
@@ -75,8 +93,8 @@ public:
    * formatted message.
    *
    * This overload supports C++23-style @c std::format syntax for type-safe,
-   * compile-time-checked formatting. The resulting message is formatted
-   * according to the provided format string and arguments.
+   * compile-time-checked formatting. The arguments are stored and the message
+   * is formatted on first use.
    *
    * @tparam Args Argument types deduced from the format string.
    * @param fmt Format string with {} placeholders (validated at compile time).
@@ -95,15 +113,16 @@ public:
   template <typename... Args>
   static ModbusError fromErrno(std::format_string<Args...> fmt,
                                Args &&...args) {
-    return {errno, std::format(fmt, std::forward<Args>(args)...),
-            deduceSeverity(errno)};
+    const int err = errno;
+    return custom(err, fmt, std::forward<Args>(args)...);
   }
 
   /**
    * @brief Create a ModbusError with a custom error code and a plain message.
    *
    * This overload is used when the error code is not derived from @c errno,
-   * but is manually provided by the caller. The message is stored as-is.
+   * but is manually provided by the caller. A string literal is referenced,
+   * not copied.
    *
    * @param c Custom error code.
    * @param msg Context message describing the error.
@@ -116,8 +135,13 @@ public:
    * auto err = ModbusError::custom(1234, "Invalid Modbus address");
    * @endcode
    */
+  template <size_t N> static ModbusError custom(int c, const char (&msg)[N]) {
+    return ModbusError(c, std::string_view(msg), false);
+  }
+
+  /** @brief As above, for a message built at runtime (copied). */
   static ModbusError custom(int c, const std::string &msg) {
-    return {c, msg, deduceSeverity(c)};
+    return custom(c, "{}", msg);
   }
 
   /**
@@ -125,8 +149,8 @@ public:
    * message.
    *
    * This overload supports C++23-style @c std::format syntax for compile-time
-   * checked formatting. The formatted message is constructed with the provided
-   * format string and arguments.
+   * checked formatting. The arguments are stored and the message is formatted
+   * on first use.
    *
    * @tparam Args Argument types deduced from the format string.
    * @param code Custom error code.
@@ -145,8 +169,11 @@ public:
   template <typename... Args>
   static ModbusError custom(int code, std::format_string<Args...> fmt,
                             Args &&...args) {
-    return {code, std::format(fmt, std::forward<Args>(args)...),
-            deduceSeverity(code)};
+    static_assert(sizeof...(Args) <= MAX_ARGS,
+                  "ModbusError keeps at most MAX_ARGS format arguments");
+    ModbusError err(code, fmt.get(), true);
+    ((err.args_[err.argCount_++] = toArg(std::forward<Args>(args))), ...);
+    return err;
   }
 
   /**
@@ -182,6 +209,45 @@ public:
     }
   }
 
+  /**
+   * @brief Get the contextual message (e.g. "Receive register 40329
+   * failed").
+   *
+   * @details
+   * Substitutes the stored arguments into the format string. Placeholders
+   * are filled in order; a format spec such as {:04x} is applied to its
+   * argument.
+   *
+   * @return An owning std::string with the formatted message.
+   */
+  std::string message() const {
+    if (!formatted_)
+      return std::string(context_);
+
+    std::string out;
+    out.reserve(context_.size() + 16 * argCount_);
+    size_t next = 0;
+    for (size_t i = 0; i < context_.size(); ++i) {
+      const char c = context_[i];
+      const bool doubled = i + 1 < context_.size() && context_[i + 1] == c;
+      if ((c == '{' || c == '}') && doubled) {
+        out += c;
+        ++i;
+      } else if (c == '{') {
+        const size_t close = context_.find('}', i);
+        std::string_view spec = context_.substr(i + 1, close - i - 1);
+        const size_t colon = spec.find(':');
+        spec = colon == std::string_view::npos ? "" : spec.substr(colon);
+        if (next < argCount_)
+          appendArg(out, args_[next++], spec);
+        i = close;
+      } else {
+        out += c;
+      }
+    }
+    return out;
+  }
+
   /**
    * @brief Get a preformatted human-readable error description.
    *
@@ -192,11 +258,53 @@ public:
    * @return An owning std::string with the formatted description.
    */
   std::string describe() const {
-    return std::format("{}: {} (code {})", message, modbus_strerror(code),
+    return std::format("{}: {} (code {})", message(), modbus_strerror(code),
                        code);
   }
 
 private:
+  /** @brief A stored format argument; numbers by value, text owned. */
+  using Arg = std::variant<std::monostate, bool, char, int64_t, uint64_t,
+                           double, std::string>;
+
+  ModbusError(int c, std::string_view context, bool formatted)
+      : code(c), severity(deduceSeverity(c)), context_(context),
+        formatted_(formatted) {}
+
+  template <typename T> static Arg toArg(T &&value) {
+    using U = std::remove_cvref_t<T>;
+    if constexpr (std::is_same_v<U, bool> || std::is_same_v<U, char>)
+      return value;
+    else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>)
+      return static_cast<int64_t>(value);
+    else if constexpr (std::is_integral_v<U>)
+      return static_cast<uint64_t>(value);
+    else if constexpr (std::is_floating_point_v<U>)
+      return static_cast<double>(value);
+    else if constexpr (std::is_convertible_v<const U &, std::string_view>)
+      return std::string(std::string_view(value));
+    else
+      return std::format("{}", value);
+  }
+
+  static void appendArg(std::string &out, const Arg &arg,
+                        std::string_view spec) {
+    std::visit(
+        [&](const auto &value) {
+          if constexpr (!std::is_same_v<std::remove_cvref_t<decltype(value)>,
+                                        std::monostate>) {
+            const std::string fmt = "{" + std::string(spec) + "}";
+            out += std::vformat(fmt, std::make_format_args(value));
+          }
+        },
+        arg);
+  }
+
+  std::string_view context_; // format string literal or plain message
+  std::array<Arg, MAX_ARGS> args_{};
+  uint8_t argCount_{0};
+  bool formatted_{false}; // context_ holds placeholders and {{ }} escapes
+
   /**
    * @brief Deduce severity based on the error code.
    * @param c Error code (errno or custom).
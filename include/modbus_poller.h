@@ -0,0 +1,80 @@
+#ifndef MODBUS_POLLER_H_
+#define MODBUS_POLLER_H_
+
+#include "config_yaml.h"
+#include "meter_profiles.h"
+#include "meter_types.h"
+#include "modbus_error.h"
+#include <array>
+#include <cstdint>
+#include <expected>
+#include <memory>
+#include <modbus/modbus.h>
+#include <span>
+#include <spdlog/logger.h>
+#include <string>
+#include <vector>
+
+class ModbusPoller {
+public:
+  // --- one merged FC03/FC04 read covering several profile fields ---
+  struct Block {
+    uint16_t start{0};
+    uint16_t count{0};
+    std::vector<size_t> fields; // indices into the profile field table
+  };
+
+  // --- one meter on the bus, blocks are planned per rate class ---
+  struct Device {
+    const ModbusDeviceConfig &cfg;
+    const MeterProfiles::Profile &profile;
+    std::array<std::vector<Block>, 2> blocks; // indexed by Rate
+    MeterTypes::Values values;                // last decoded values
+
+    std::string describe(void) const {
+      if (cfg.name.empty())
+        return "unit id " + std::to_string(cfg.slaveId);
+      return "'" + cfg.name + "' (unit id " + std::to_string(cfg.slaveId) +
+             ")";
+    }
+  };
+
+  explicit ModbusPoller(const MeterMasterConfig &cfg);
+  virtual ~ModbusPoller();
+
+  std::expected<void, ModbusError> connect(void);
+  void close(void);
+  bool isConnected(void) const { return ctx_ != nullptr; }
+
+  std::expected<void, ModbusError> readValues(size_t device,
+                                              MeterProfiles::Rate rate);
+  std::expected<void, ModbusError> readDevice(size_t device,
+                                              MeterTypes::Device &info);
+
+  size_t deviceCount(void) const { return devices_.size(); }
+  Device &device(size_t device) { return devices_[device]; }
+  const Device &device(size_t device) const { return devices_[device]; }
+  std::string endpoint(void) const;
+
+  static bool isDeviceError(const ModbusError &err);
+  static std::vector<Block>
+  planBlocks(std::span<const MeterProfiles::Field> fields, int maxGap,
+             MeterProfiles::Rate rate,
+             int maxCount = MODBUS_MAX_READ_REGISTERS);
+
+private:
+  std::expected<void, ModbusError> selectDevice(const Device &dev);
+  std::expected<void, ModbusError> readBlock(const Device &dev,
+                                             const Block &block);
+  static double decode(const MeterProfiles::Profile &profile,
+                       const MeterProfiles::Field &field, const uint16_t *src);
+
+  const MeterMasterConfig &cfg_;
+  std::vector<Device> devices_;
+  std::vector<uint16_t> buffer_;
+  modbus_t *ctx_{nullptr};
+  int selectedSlave_{-1};
+  std::shared_ptr<spdlog::logger> masterLogger_;
+};
+
+#endif /* MODBUS_POLLER_H_ */
@@ -4,6 +4,7 @@
 #include "config_yaml.h"
 #include "signal_handler.h"
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <mosquitto.h>
 #include <mutex>
@@ -21,6 +22,9 @@ public:
   // Producer pushes JSON payloads here
   void publish(std::string payload, const std::string &topic);
 
+  // Publisher thread (the mosquitto network thread is not exposed)
+  std::vector<std::thread::native_handle_type> threads(void);
+
 private:
   void run();
   MqttConfig cfg_;
@@ -29,6 +33,7 @@ private:
   std::shared_ptr<spdlog::logger> mqttLogger_;
 
   // State
+  static constexpr std::chrono::seconds DISCONNECT_TIMEOUT{1};
   std::atomic<bool> connected_{false};
   struct mosquitto *mosq_ = nullptr;
   std::thread worker_;
@@ -39,6 +44,7 @@ private:
   // --- queued messages setup
   struct QueuedMessage {
     std::string payload;
+    std::chrono::steady_clock::time_point queued;
   };
   std::map<std::string, std::queue<QueuedMessage>> topicQueues_;
   std::unordered_map<std::string, std::size_t> lastPayloadHashes_;
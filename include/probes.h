@@ -0,0 +1,38 @@
+#ifndef PROBES_H_
+#define PROBES_H_
+
+/**
+ * Static tracepoints (USDT) of provider "smartmeter" for bpftrace and perf.
+ *
+ * A probe compiles to a single nop plus an ELF note describing where its
+ * arguments live; the arguments are only read by an attached tracer. Probes
+ * are built in when <sys/sdt.h> is available (systemtap-sdt-dev) and can be
+ * left out with -DNO_PROBES. List them with
+ *
+ *   bpftrace -l 'usdt:/usr/bin/smartmeter-gateway:*'
+ *
+ * Every probe takes at least one argument. Strings are passed as pointers,
+ * read them with str(argN).
+ *
+ * | Probe          | Arguments                                            |
+ * |----------------|------------------------------------------------------|
+ * | frame_start    | format (TelegramFramer::Format)                      |
+ * | frame_end      | length, µs since frame_start                         |
+ * | parse_start    | protocol (MeterProtocol), length                     |
+ * | parse_end      | protocol, 1 on success or 0, µs since parse_start    |
+ * | dispatch       | meter name, length of the values JSON                |
+ * | mqtt_enqueue   | topic, length, messages queued for the topic         |
+ * | mqtt_publish   | topic, length, µs since mqtt_enqueue, mosquitto rc   |
+ * | modbus_request | function code, first register address, length        |
+ * | modbus_reply   | function code, reply length or -1, µs since request  |
+ */
+#if !defined(NO_PROBES) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define PROBE(name, ...) STAP_PROBEV(smartmeter, name, __VA_ARGS__)
+#else
+#define PROBE(name, ...)                                                       \
+  do {                                                                         \
+  } while (0)
+#endif
+
+#endif /* PROBES_H_ */
@@ -0,0 +1,54 @@
+#ifndef RESOURCE_MONITOR_H_
+#define RESOURCE_MONITOR_H_
+
+#include "config_yaml.h"
+#include "meter_reactor.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <spdlog/logger.h>
+#include <string>
+
+/**
+ * @class ResourceMonitor
+ * @brief Samples the gateway's own resource usage for the stats topic.
+ *
+ * @details
+ * Every interval the monitor reads the CPU time of each thread from
+ * /proc/self/task, the resident set size, the heap statistics of the C
+ * library and counts the open descriptors and live threads. The sample is
+ * handed to the stats callback as JSON. It costs a few dozen small /proc
+ * reads once a minute, and mallinfo2() locks every malloc arena for a
+ * moment, so it runs on the housekeeping loop, never on a meter, Modbus or
+ * MQTT thread. Slowly growing thread, descriptor or memory counts on a long
+ * running gateway show up here before they hurt.
+ */
+class ResourceMonitor : public MeterReactor::Source {
+public:
+  using Clock = MeterReactor::Clock;
+
+  explicit ResourceMonitor(const StatsConfig &cfg);
+
+  void setStatsCallback(std::function<void(std::string)> cb);
+  std::string sample(void);
+
+  // --- MeterReactor::Source (periodic sample, no descriptor) ---
+  int fd(void) const override { return -1; }
+  uint32_t events(void) const override { return 0; }
+  Clock::time_point deadline(void) const override { return deadline_; }
+  void onEvent(uint32_t) override {}
+  void onTimer(Clock::time_point now) override;
+
+private:
+  const StatsConfig &cfg_;
+  std::shared_ptr<spdlog::logger> logger_;
+  Clock::time_point deadline_;
+  Clock::time_point lastSample_;
+  std::map<int, uint64_t> lastTicks_; // CPU ticks per thread id
+  std::mutex cbMutex_;
+  std::function<void(std::string)> statsCallback_;
+};
+
+#endif /* RESOURCE_MONITOR_H_ */
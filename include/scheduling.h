@@ -0,0 +1,180 @@
+#ifndef SCHEDULING_H_
+#define SCHEDULING_H_
+
+#include "config_yaml.h"
+#include "modbus_error.h"
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <expected>
+#include <format>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <string>
+#include <sys/mman.h>
+
+namespace Scheduling {
+
+/** Stack of every thread started after setupStacks(), in bytes. */
+constexpr size_t THREAD_STACK = 512 * 1024;
+
+/** Stack touched by a meter thread when it starts, in bytes. */
+constexpr size_t PREFAULT_STACK = 256 * 1024;
+
+namespace detail {
+inline std::atomic<bool> prefault{false};
+} // namespace detail
+
+/**
+ * Name a thread as shown by top -H and ps -L (at most 15 characters).
+ */
+inline void setName(pthread_t thread, const std::string &name) {
+  pthread_setname_np(thread, name.substr(0, 15).c_str());
+}
+
+/**
+ * Apply policy, priority and CPU affinity of a thread role. A thread created
+ * by a tuned thread inherits its settings.
+ *
+ * Real-time policies need CAP_SYS_NICE or a sufficient RLIMIT_RTPRIO (e.g.
+ * LimitRTPRIO= in the systemd unit) once privileges have been dropped.
+ */
+inline std::expected<void, ModbusError>
+apply(pthread_t thread, const ThreadTuningConfig &cfg) {
+  if (cfg.policy != SCHED_OTHER) {
+    sched_param param{};
+    param.sched_priority = cfg.priority;
+    int rc = pthread_setschedparam(thread, cfg.policy, &param);
+    if (rc != 0) {
+      errno = rc;
+      return std::unexpected(ModbusError::fromErrno(
+          "Unable to set scheduling policy {} priority {}",
+          cfg.policy == SCHED_FIFO ? "fifo" : "rr", cfg.priority));
+    }
+  }
+
+  if (!cfg.cpus.empty()) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cfg.cpus)
+      CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (rc != 0) {
+      errno = rc;
+      return std::unexpected(
+          ModbusError::fromErrno("Unable to set CPU affinity"));
+    }
+  }
+
+  return {};
+}
+
+/**
+ * Effective policy, priority and CPU affinity of a thread, e.g.
+ * "fifo 50, CPUs 2-3".
+ */
+inline std::string describe(pthread_t thread) {
+  int policy = SCHED_OTHER;
+  sched_param param{};
+  pthread_getschedparam(thread, &policy, &param);
+
+  std::string text;
+  switch (policy) {
+  case SCHED_FIFO:
+    text = std::format("fifo {}", param.sched_priority);
+    break;
+  case SCHED_RR:
+    text = std::format("rr {}", param.sched_priority);
+    break;
+  default:
+    text = "other";
+    break;
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (pthread_getaffinity_np(thread, sizeof(set), &set) != 0)
+    return text;
+
+  // Ranges of consecutive CPUs, as in /proc/self/status
+  std::string cpus;
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (!CPU_ISSET(cpu, &set))
+      continue;
+    int last = cpu;
+    while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &set))
+      ++last;
+    cpus += (cpus.empty() ? "" : ",") +
+            (last == cpu ? std::to_string(cpu)
+                         : std::format("{}-{}", cpu, last));
+    cpu = last;
+  }
+  return text + ", CPUs " + cpus;
+}
+
+/**
+ * Give every thread started from here on, the ones of libraries included, a
+ * stack of THREAD_STACK instead of the 8 MiB of RLIMIT_STACK, and have the
+ * meter threads prefault theirs. mlockall() makes each stack resident in
+ * full, so this bounds the memory to lock. Call before the first thread is
+ * started.
+ */
+inline std::expected<void, ModbusError> setupStacks(void) {
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  int rc = pthread_attr_setstacksize(&attr, THREAD_STACK);
+  if (rc == 0)
+    rc = pthread_setattr_default_np(&attr);
+  pthread_attr_destroy(&attr);
+  if (rc != 0) {
+    errno = rc;
+    return std::unexpected(
+        ModbusError::fromErrno("Unable to set the thread stack size"));
+  }
+  detail::prefault = true;
+  return {};
+}
+
+/**
+ * Touch PREFAULT_STACK of the calling thread's stack after setupStacks(), so
+ * the first deep parse does not page fault, even if locking failed.
+ */
+inline void prefaultStack(void) {
+  if (!detail::prefault)
+    return;
+  volatile unsigned char stack[PREFAULT_STACK];
+  for (size_t i = 0; i < sizeof(stack); i += 4096)
+    stack[i] = 0;
+}
+
+/**
+ * Lock all current and future pages in memory, so a page fault never delays
+ * reading a telegram. Thread stacks are mapped in full and locked along with
+ * the heap. Needs CAP_IPC_LOCK or a sufficient RLIMIT_MEMLOCK
+ * (LimitMEMLOCK=).
+ */
+inline std::expected<void, ModbusError> lockMemory(void) {
+  if (mlockall(MCL_CURRENT | MCL_FUTURE) == -1)
+    return std::unexpected(ModbusError::fromErrno("Unable to lock memory"));
+  return {};
+}
+
+/** Memory locked by the process in KiB (VmLck), 0 if unknown. */
+inline size_t lockedKiB(void) {
+  std::ifstream status("/proc/self/status");
+  std::string key;
+  size_t kib = 0;
+  while (status >> key) {
+    if (key == "VmLck:") {
+      status >> kib;
+      break;
+    }
+    status.ignore(256, '\n');
+  }
+  return kib;
+}
+
+} // namespace Scheduling
+
+#endif /* SCHEDULING_H_ */
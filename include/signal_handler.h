@@ -2,52 +2,96 @@
 #define SIGNAL_HANDLER_H_
 
 #include <atomic>
-#include <condition_variable>
+#include <cerrno>
 #include <csignal>
-#include <mutex>
+#include <cstdint>
+#include <cstring>
+#include <poll.h>
+#include <pthread.h>
+#include <stdexcept>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
 
+/**
+ * @class SignalHandler
+ * @brief Turns SIGINT and SIGTERM into a shutdown, SIGHUP into a reload and
+ * SIGUSR2 into a dump of the flight recorder.
+ *
+ * @details
+ * The signals are blocked and read from a signalfd, so no code runs in
+ * signal context. The handler has to be created before any other thread,
+ * which inherit the blocked mask. A shutdown, by signal or by request, makes
+ * shutdownFd() readable for good; threads waiting in poll() or epoll_wait()
+ * add it to their descriptors and wake up right away instead of rechecking
+ * isRunning() periodically.
+ */
 class SignalHandler {
 public:
+  enum class Event { SHUTDOWN, RELOAD, DUMP };
+
   explicit SignalHandler(void) : running_(true) {
-    struct sigaction action{};
-    action.sa_flags = SA_SIGINFO;
-    action.sa_sigaction = [](int sig, siginfo_t *, void *) {
-      if (instance_ && instance_->running_.load()) {
-        instance_->signal_ = sig;
-        instance_->shutdown();
-      }
-    };
-    sigemptyset(&action.sa_mask);
-    instance_ = this;
-    sigaction(SIGINT, &action, nullptr);
-    sigaction(SIGTERM, &action, nullptr);
+    sigemptyset(&signals_);
+    sigaddset(&signals_, SIGINT);
+    sigaddset(&signals_, SIGTERM);
+    sigaddset(&signals_, SIGHUP);
+    sigaddset(&signals_, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &signals_, nullptr);
+
+    signalFd_ = signalfd(-1, &signals_, SFD_NONBLOCK | SFD_CLOEXEC);
+    shutdownFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (signalFd_ == -1 || shutdownFd_ == -1) {
+      std::string err = strerror(errno);
+      if (signalFd_ != -1)
+        close(signalFd_);
+      if (shutdownFd_ != -1)
+        close(shutdownFd_);
+      pthread_sigmask(SIG_UNBLOCK, &signals_, nullptr);
+      throw std::runtime_error("Failed to set up signal handling: " + err);
+    }
   }
 
+  // Signals stay blocked, a second one during teardown is ignored
   ~SignalHandler() {
-    struct sigaction defaultAction{};
-    defaultAction.sa_handler = SIG_DFL;
-    sigaction(SIGINT, &defaultAction, nullptr);
-    sigaction(SIGTERM, &defaultAction, nullptr);
-    instance_ = nullptr;
+    close(signalFd_);
+    close(shutdownFd_);
   }
 
   // --- Delete copy and assignment ---
   SignalHandler(const SignalHandler &) = delete;
   SignalHandler &operator=(const SignalHandler &) = delete;
 
-  // --- Programmatic shutdown ---
+  // --- Programmatic shutdown, safe from any thread ---
   void shutdown() {
-    {
-      std::lock_guard<std::mutex> lock(mtx_);
-      running_.store(false);
-    }
-    cv_.notify_all();
+    if (!running_.exchange(false))
+      return;
+    // Never read, the descriptor stays readable for every waiter
+    const uint64_t one = 1;
+    ssize_t n = write(shutdownFd_, &one, sizeof(one));
+    (void)n;
   }
 
-  // --- Wait for shutdown ---
-  void wait() {
-    std::unique_lock<std::mutex> lock(mtx_);
-    cv_.wait(lock, [&] { return !running_.load(); });
+  // --- Wait for shutdown, a reload (SIGHUP) or dump request (SIGUSR2) ---
+  Event wait() {
+    pollfd fds[2] = {{signalFd_, POLLIN, 0}, {shutdownFd_, POLLIN, 0}};
+    while (running_.load()) {
+      if (poll(fds, 2, -1) == -1 && errno != EINTR) {
+        shutdown();
+        break;
+      }
+      signalfd_siginfo info{};
+      if ((fds[0].revents & POLLIN) &&
+          read(signalFd_, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGHUP)
+          return Event::RELOAD;
+        if (info.ssi_signo == SIGUSR2)
+          return Event::DUMP;
+        signal_ = static_cast<int>(info.ssi_signo);
+        shutdown();
+      }
+    }
+    return Event::SHUTDOWN;
   }
 
   const char *signalName() const {
@@ -56,12 +100,13 @@ public:
 
   int signal() const { return signal_; }
   bool isRunning() const { return running_.load(); }
+  int shutdownFd() const { return shutdownFd_; }
 
 private:
   std::atomic<bool> running_;
-  std::mutex mtx_;
-  std::condition_variable cv_;
-  static inline SignalHandler *instance_ = nullptr;
+  sigset_t signals_;
+  int signalFd_{-1};
+  int shutdownFd_{-1};
   std::atomic<int> signal_{0};
 };
 
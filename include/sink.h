@@ -0,0 +1,69 @@
+#ifndef SINK_H_
+#define SINK_H_
+
+#include "meter_types.h"
+#include "modbus_error.h"
+#include <array>
+#include <chrono>
+#include <expected>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+
+/**
+ * One output of the gateway: a document, the readings behind it or a raw
+ * telegram. Created once and shared by all sinks that want its kind.
+ */
+struct SinkRecord {
+  enum class Kind { TELEGRAM, VALUES, DEVICE, AVAILABILITY, METRICS, STATS };
+
+  Kind kind{Kind::VALUES};
+  std::string source{};  // meter or bus device below the root, "" if single
+  std::string payload{}; // JSON document, the frame as received for TELEGRAM
+  std::optional<MeterTypes::Values> values{}; // with VALUES
+  std::optional<MeterTypes::Device> device{}; // with DEVICE
+  bool primary{false}; // from the source feeding the meter slave
+  std::chrono::system_clock::time_point time{}; // set by dispatch()
+
+  // Path below the root topic, e.g. "/heatpump/values"
+  std::string path(void) const {
+    static constexpr std::array<const char *, 6> SUFFIX = {
+        "/telegram", "/values", "/device", "/availability", "/metrics",
+        "/stats"};
+    return source + SUFFIX[static_cast<size_t>(kind)];
+  }
+};
+
+/**
+ * @class Sink
+ * @brief Output of the gateway, e.g. MQTT, the HTTP API or a file.
+ *
+ * @details
+ * A sink declares the inputs it wants and gets them in batches on a thread
+ * of its own (see SinkRegistry), so it may block, e.g. on a socket, without
+ * delaying the meters or the other sinks. Records are shared between the
+ * sinks and stay valid after write() returns only if the sink keeps the
+ * pointer.
+ */
+class Sink {
+public:
+  using Record = std::shared_ptr<const SinkRecord>;
+
+  enum Input : unsigned {
+    TELEGRAMS = 1u << 0, /**< raw telegrams (SML, DSMR, IEC 62056-21) */
+    VALUES = 1u << 1,    /**< values and device info, parsed */
+    PAYLOADS = 1u << 2,  /**< every JSON document */
+  };
+
+  virtual ~Sink() = default;
+
+  /** Inputs wanted, a combination of Input; fixed for the lifetime. */
+  virtual unsigned inputs(void) const = 0;
+
+  /** Write records in the order they were produced, on the sink thread. */
+  virtual std::expected<void, ModbusError>
+  write(std::span<const Record> batch) = 0;
+};
+
+#endif /* SINK_H_ */
@@ -0,0 +1,74 @@
+#ifndef SINK_REGISTRY_H_
+#define SINK_REGISTRY_H_
+
+#include "config_yaml.h"
+#include "sink.h"
+#include <functional>
+#include <map>
+#include <memory>
+#include <spdlog/logger.h>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * @class SinkRegistry
+ * @brief Creates the sinks and hands every record to the ones that want it.
+ *
+ * @details
+ * Sink types are registered by name with a factory, so a new output only
+ * needs a Sink, its config and a line in the constructor. The built-in
+ * outputs (MQTT, HTTP API, meter slave, snapshot) are added by main, the
+ * ones in the sinks section of the config are created from it.
+ *
+ * Every sink has a bounded queue and a thread. dispatch() allocates the
+ * record once and appends a reference to the queue of each sink that wants
+ * it; a full queue drops its oldest or the new record. A slow or broken sink
+ * thus loses records instead of delaying the meters or the other sinks. The
+ * thread writes up to batch records at once, waiting up to flush_interval
+ * for a full batch. Records still queued on destruction are written first.
+ */
+class SinkRegistry {
+public:
+  using Factory = std::function<std::unique_ptr<Sink>(const SinkConfig &)>;
+
+  SinkRegistry(void);
+  ~SinkRegistry();
+
+  // --- Delete copy and assignment ---
+  SinkRegistry(const SinkRegistry &) = delete;
+  SinkRegistry &operator=(const SinkRegistry &) = delete;
+
+  // Makes a sink type available to create()
+  void addType(const std::string &type, Factory factory);
+
+  // Sink of a registered type, from an entry of the sinks section; sinks
+  // are added before the first dispatch()
+  void create(const SinkConfig &cfg);
+
+  // Sink constructed by the caller, e.g. a built-in output
+  void add(const std::string &name, std::unique_ptr<Sink> sink,
+           const SinkOptions &options = {});
+
+  // True if any sink wants the input, e.g. to skip copying raw telegrams
+  bool wants(Sink::Input input) const;
+
+  // Hands a record to every sink that wants it; safe from any thread and
+  // never waits for a sink
+  void dispatch(SinkRecord record);
+
+  // Sink threads by sink name, for naming and scheduling after startup
+  std::vector<std::pair<std::string, std::thread::native_handle_type>>
+  threads(void);
+
+private:
+  class Worker;
+
+  std::shared_ptr<spdlog::logger> sinkLogger_;
+  std::map<std::string, Factory> factories_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  unsigned inputs_{0}; // of all sinks
+};
+
+#endif /* SINK_REGISTRY_H_ */
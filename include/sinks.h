@@ -0,0 +1,155 @@
+#ifndef SINKS_H_
+#define SINKS_H_
+
+#include "config_yaml.h"
+#include "http_server.h"
+#include "meter_slave.h"
+#include "modbus_error.h"
+#include "mqtt_client.h"
+#include "sink.h"
+#include "snapshot.h"
+#include <atomic>
+#include <expected>
+#include <memory>
+#include <span>
+#include <string>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unordered_map>
+#include <vector>
+
+// MQTT root topic, swapped as a whole when the config is reloaded
+using TopicRoot = std::atomic<std::shared_ptr<const std::string>>;
+
+/** Publishes every document below the root topic. */
+class MqttSink : public Sink {
+public:
+  MqttSink(MqttClient &mqtt, const TopicRoot &topicRoot)
+      : mqtt_(mqtt), topicRoot_(topicRoot) {}
+
+  unsigned inputs(void) const override { return PAYLOADS; }
+  std::expected<void, ModbusError>
+  write(std::span<const Record> batch) override;
+
+private:
+  MqttClient &mqtt_;
+  const TopicRoot &topicRoot_;
+};
+
+/** Serves the JSON documents over the HTTP API, by path. */
+class HttpSink : public Sink {
+public:
+  explicit HttpSink(HttpServer &http) : http_(http) {}
+
+  unsigned inputs(void) const override { return PAYLOADS; }
+  std::expected<void, ModbusError>
+  write(std::span<const Record> batch) override;
+
+private:
+  HttpServer &http_;
+};
+
+/** Feeds the values of the primary source to the meter slave registers. */
+class SlaveSink : public Sink {
+public:
+  SlaveSink(MeterSlave &slave, Snapshot *snapshot)
+      : slave_(slave), snapshot_(snapshot) {}
+
+  unsigned inputs(void) const override { return VALUES; }
+  std::expected<void, ModbusError>
+  write(std::span<const Record> batch) override;
+
+private:
+  MeterSlave &slave_;
+  Snapshot *snapshot_; // takes the register image, if any
+};
+
+/** Keeps the last values and device documents for a warm start. */
+class SnapshotSink : public Sink {
+public:
+  SnapshotSink(Snapshot &snapshot, const TopicRoot &topicRoot)
+      : snapshot_(snapshot), topicRoot_(topicRoot) {}
+
+  unsigned inputs(void) const override { return PAYLOADS; }
+  std::expected<void, ModbusError>
+  write(std::span<const Record> batch) override;
+
+private:
+  Snapshot &snapshot_;
+  const TopicRoot &topicRoot_;
+};
+
+/**
+ * Appends every document, and optionally the raw telegrams, to a file of
+ * JSON lines: {"time":<ms since epoch>,"path":"/values","payload":{...}}.
+ * A telegram is {"time":...,"path":"/telegram","hex":"..."}. One write per
+ * batch; the file is opened with O_APPEND, so logrotate's copytruncate
+ * works.
+ */
+class FileSink : public Sink {
+public:
+  explicit FileSink(const FileSinkConfig &cfg);
+  ~FileSink();
+
+  // --- Delete copy and assignment ---
+  FileSink(const FileSink &) = delete;
+  FileSink &operator=(const FileSink &) = delete;
+
+  unsigned inputs(void) const override;
+  std::expected<void, ModbusError>
+  write(std::span<const Record> batch) override;
+
+private:
+  const FileSinkConfig cfg_;
+  int fd_{-1};
+  std::string buffer_; // lines of the current batch
+};
+
+/**
+ * Writes the values in InfluxDB line protocol to a UDP or Unix datagram
+ * listener, e.g. Telegraf's socket_listener or the InfluxDB 1.x UDP service:
+ *
+ *   smartmeter,meter=house energy_active_import=22557.3,... 1767449059987000000
+ *
+ * The escaped measurement and tags of a meter are built once and kept as
+ * the prefix of its lines; the fields come straight from the parsed values,
+ * without going through JSON. The lines of a batch are packed into
+ * datagrams of packet_size bytes at most and sent with one sendmmsg(). The
+ * socket is connected on the first write and again after an error, so the
+ * listener may start later or restart; datagrams it cannot take right away
+ * are dropped.
+ */
+class InfluxSink : public Sink {
+public:
+  explicit InfluxSink(const InfluxSinkConfig &cfg);
+  ~InfluxSink();
+
+  // --- Delete copy and assignment ---
+  InfluxSink(const InfluxSink &) = delete;
+  InfluxSink &operator=(const InfluxSink &) = delete;
+
+  unsigned inputs(void) const override { return VALUES; }
+  std::expected<void, ModbusError>
+  write(std::span<const Record> batch) override;
+
+private:
+  std::expected<void, ModbusError> connect(void);
+  const std::string &prefix(const std::string &source);
+  void appendValues(const SinkRecord &record);
+  void endLine(size_t start);
+
+  const InfluxSinkConfig cfg_;
+  sockaddr_storage address_{};
+  socklen_t addressLength_{0};
+  std::string endpoint_; // host:port or socket path, for messages
+  int fd_{-1};
+
+  std::unordered_map<std::string, std::string> prefixes_; // by source
+  std::string buffer_;          // lines of the current batch
+  size_t packetStart_{0};       // of the datagram being filled
+  std::vector<size_t> packets_; // end of each datagram in buffer_
+  std::vector<iovec> iov_;      // one per datagram
+  std::vector<mmsghdr> messages_;
+};
+
+#endif /* SINKS_H_ */
@@ -0,0 +1,43 @@
+#ifndef SML_DECODER_H_
+#define SML_DECODER_H_
+
+#include "modbus_error.h"
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <string>
+#include <string_view>
+
+/**
+ * @class SmlDecoder
+ * @brief Decodes the value lists of an SML file without building a tree.
+ *
+ * @details
+ * Takes one file as cut by TelegramFramer in SML mode, checks the CRC16 of
+ * the transport layer, removes escape sequences in place and walks the
+ * type-length encoded messages with a cursor. Only GetList.Res messages are
+ * looked at; every entry of their value list is handed to the visitor as
+ * views into the frame, all other messages are skipped. Nothing is copied
+ * or allocated, so the visitor has to consume an entry before returning.
+ */
+class SmlDecoder {
+public:
+  struct Entry {
+    std::string_view serverId; /**< Server id of the enclosing list */
+    std::string_view obis;     /**< Object name, usually 6 bytes A..F */
+    std::string_view octets;   /**< Value of an octet string entry */
+    int64_t value{0};          /**< Value of a numeric entry */
+    int8_t scaler{0};          /**< Decimal exponent of the value */
+    uint8_t unit{0};           /**< DLMS unit code, 0 if not set */
+    bool numeric{false};
+
+    double scaled(void) const;
+  };
+
+  using Visitor = std::function<void(const Entry &)>;
+
+  static std::expected<void, ModbusError> decode(std::string &frame,
+                                                 const Visitor &visitor);
+};
+
+#endif /* SML_DECODER_H_ */
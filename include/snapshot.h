@@ -0,0 +1,84 @@
+#ifndef SNAPSHOT_H_
+#define SNAPSHOT_H_
+
+#include "config_yaml.h"
+#include "meter_reactor.h"
+#include "modbus_error.h"
+#include <cstdint>
+#include <expected>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <spdlog/logger.h>
+#include <string>
+#include <vector>
+
+/**
+ * @class Snapshot
+ * @brief Keeps the last good readings on disk for a warm start.
+ *
+ * @details
+ * Collects the retained values and device payloads of every MQTT topic and
+ * the encoded SunSpec register image of the meter slave while the gateway
+ * runs, and writes them every interval (only if something changed) and on
+ * shutdown. The file is written to a temporary name, synced and renamed
+ * over the previous one, so a power cut leaves either the old or the new
+ * snapshot. The timer runs on a loop of its own, not on the meter loops,
+ * as a sync may take hundreds of milliseconds on an SD card. A one line
+ * header carries the format version, the body size and a CRC16 of the JSON
+ * body:
+ *
+ *   smartmeter-gateway snapshot 1 <size> <crc16>
+ *   {"time": ..., "topics": {...}, "registers": [...]}
+ *
+ * After a restart the snapshot is loaded before the meters are read, so the
+ * Modbus slave and the retained topics have plausible data right away. Its
+ * age decides whether it is used at all (max_age); the sources are marked
+ * stale until their meter answers again.
+ */
+class Snapshot : public MeterReactor::Source {
+public:
+  using Clock = MeterReactor::Clock;
+  static constexpr int VERSION = 1;
+
+  struct Payloads {
+    std::string values; /**< JSON of the values topic, empty if none */
+    std::string device; /**< JSON of the device topic, empty if none */
+  };
+
+  struct Data {
+    uint64_t time{0}; /**< Unix epoch in ms of the last update */
+    std::map<std::string, Payloads> topics; /**< By MQTT base topic */
+    std::vector<uint16_t> registers;        /**< Meter slave image */
+  };
+
+  explicit Snapshot(const SnapshotConfig &cfg);
+
+  std::expected<Data, ModbusError> load(void) const;
+  std::expected<void, ModbusError> save(void);
+  void restore(Data data);
+
+  void setValues(const std::string &topic, std::string json);
+  void setDevice(const std::string &topic, std::string json);
+  void setRegisters(std::vector<uint16_t> registers);
+
+  // --- MeterReactor::Source (periodic write, no descriptor) ---
+  int fd(void) const override { return -1; }
+  uint32_t events(void) const override { return 0; }
+  Clock::time_point deadline(void) const override { return deadline_; }
+  void onEvent(uint32_t) override {}
+  void onTimer(Clock::time_point now) override;
+
+private:
+  std::expected<void, ModbusError> write(const std::string &content);
+
+  const SnapshotConfig &cfg_;
+  std::shared_ptr<spdlog::logger> logger_;
+  mutable std::mutex mutex_;
+  Data data_;         // guarded by mutex_
+  bool dirty_{false}; // guarded by mutex_
+  std::mutex fileMutex_;
+  Clock::time_point deadline_;
+};
+
+#endif /* SNAPSHOT_H_ */
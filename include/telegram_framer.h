@@ -0,0 +1,103 @@
+#ifndef TELEGRAM_FRAMER_H_
+#define TELEGRAM_FRAMER_H_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+
+/**
+ * @class TelegramFramer
+ * @brief Cuts a byte stream into complete telegrams, SML files or frames.
+ *
+ * @details
+ * An OBIS telegram starts with '/' and ends two characters (CR LF) after the
+ * '!' trailer; a DSMR P1 telegram ends with the line feed following the '!'
+ * and its CRC16 (DSMR 4 and later) or right after it. An SML file is
+ * enclosed in the escape sequences 1b1b1b1b 01010101 and 1b1b1b1b 1aXXYYYY
+ * of the SML transport layer; four escape bytes in the payload are doubled
+ * by the meter and kept as is for the decoder. An encrypted P1 frame starts
+ * with the general-glo-ciphering tag 0xdb and a system title of 8 bytes, its
+ * end follows from the length field of the header. An M-Bus answer is the
+ * single character 0xe5 or a long frame 68 L L 68 ... 16. Bytes are pushed
+ * in whatever chunks the source delivers them, so the same framer serves
+ * ttys and TCP sockets. A chunk may complete several telegrams, e.g. from a
+ * serial bridge flushing its buffer after a stall; they are queued in order
+ * until taken, the oldest is dropped beyond MAX_QUEUED. A telegram that
+ * grows beyond the maximum size or breaks the escaping rules is dropped and
+ * the framer waits for the next start sequence.
+ *
+ * With parity marking enabled the stream is expected as delivered by a tty
+ * with PARMRK set: ff ff stands for a data byte ff, ff 00 X for a byte X
+ * received with a parity or framing error (a break reads as ff 00 00). A
+ * telegram containing such a byte is abandoned right away instead of
+ * failing its checksum later. The statistics tell a noisy line (parity
+ * marks, truncated telegrams) apart from a framer that lost sync (resyncs,
+ * bytes discarded outside of telegrams).
+ */
+class TelegramFramer {
+public:
+  enum class Format { OBIS, DSMR, SML, GCM, MBUS };
+
+  enum class Status {
+    INCOMPLETE, /**< More bytes needed */
+    COMPLETE,   /**< At least one telegram is ready to be taken */
+    OVERFLOW    /**< Stream out of sync, the partial telegram was dropped */
+  };
+
+  struct Stats {
+    uint64_t bytes{0};        /**< Bytes pushed */
+    uint64_t telegrams{0};    /**< Complete telegrams */
+    uint64_t overflows{0};    /**< Telegrams dropped: too large, corrupt or
+                                   not taken in time */
+    uint64_t truncated{0};    /**< Partial telegrams abandoned */
+    uint64_t resyncs{0};      /**< Start sequences found after skipped bytes */
+    uint64_t discarded{0};    /**< Bytes skipped outside of telegrams */
+    uint64_t parityErrors{0}; /**< Bytes marked by the tty (PARMRK) */
+  };
+
+  explicit TelegramFramer(size_t maxSize, Format format = Format::OBIS);
+
+  // Complete telegrams kept until taken
+  static constexpr size_t MAX_QUEUED = 8;
+
+  Status push(std::string_view data);
+  std::string take(void);
+  bool ready(void) const { return !telegrams_.empty(); }
+  void reset(void);
+  void setParityMarking(bool enable);
+
+  bool inTelegram(void) const { return inTelegram_; }
+  const Stats &stats(void) const { return stats_; }
+
+private:
+  Status dispatch(std::string_view data);
+  Status pushText(std::string_view data);
+  Status pushSml(std::string_view data);
+  Status pushGcm(std::string_view data);
+  Status pushMbus(std::string_view data);
+  void begin(size_t startSize);
+  void complete(Status &status);
+  void drop(Status &status);
+  void markError(void);
+
+  size_t maxSize_;
+  Format format_;
+  std::string buffer_;   // telegram being assembled
+  std::deque<std::string> telegrams_; // complete, oldest first
+  bool inTelegram_{false};
+  int trailer_{-1}; // characters left after '!', -1 before the trailer
+  uint64_t window_{0};  // last eight bytes while hunting for an SML start
+  int escapeRun_{0};    // consecutive SML escape bytes
+  int commandBytes_{0}; // SML escape command bytes still expected
+  size_t frameSize_{0}; // frame size from the header, 0 = unknown
+  uint64_t hunted_{0};  // bytes skipped since the last telegram
+  bool parityMarking_{false};
+  int mark_{0}; // PARMRK bytes seen: 1 after ff, 2 after ff 00
+  std::chrono::steady_clock::time_point started_; // start of the telegram
+  Stats stats_;
+};
+
+#endif /* TELEGRAM_FRAMER_H_ */
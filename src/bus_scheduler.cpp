@@ -0,0 +1,226 @@
+#include "bus_scheduler.h"
+#include "config_yaml.h"
+#include "json_utils.h"
+#include "meter_profiles.h"
+#include "modbus_poller.h"
+#include <algorithm>
+#include <chrono>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::ordered_json;
+
+BusScheduler::BusScheduler(const MeterMasterConfig &cfg,
+                           const ModbusPoller &poller)
+    : cfg_(cfg), poller_(poller), windowStart_(Clock::now()) {
+
+  // Character time on an RTU line: start, data, parity and stop bits
+  if (cfg_.rtu) {
+    const int bits = 1 + cfg_.rtu->dataBits +
+                     (cfg_.rtu->parity != Parity::None ? 1 : 0) +
+                     cfg_.rtu->stopBits;
+    charTime_ = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(static_cast<double>(bits) /
+                                      cfg_.rtu->baud));
+    // Silent interval between frames, fixed at 1.75 ms above 19200 baud
+    frameGap_ = cfg_.rtu->baud > 19200
+                    ? std::chrono::duration_cast<Clock::duration>(
+                          std::chrono::microseconds(1750))
+                    : charTime_ * 35 / 10;
+  }
+
+  // Initial guess of the meter response latency, refined by measurements
+  DeviceState initial;
+  initial.turnaround = cfg_.rtu ? std::chrono::milliseconds(20)
+                                : std::chrono::milliseconds(5);
+  devices_.assign(poller_.deviceCount(), initial);
+
+  for (size_t dev = 0; dev < poller_.deviceCount(); ++dev) {
+    for (auto rate : {MeterProfiles::Rate::FAST, MeterProfiles::Rate::SLOW}) {
+      const auto &blocks =
+          poller_.device(dev).blocks[static_cast<size_t>(rate)];
+      if (blocks.empty())
+        continue;
+
+      Task task;
+      task.device = dev;
+      task.rate = rate;
+      task.period = std::chrono::milliseconds(
+          rate == MeterProfiles::Rate::FAST ? cfg_.modbus.pollInterval
+                                            : cfg_.modbus.energyInterval);
+      task.transactions = blocks.size();
+
+      // request: address, function, start, count, crc (8 bytes)
+      // response: address, function, byte count, data, crc (5 + 2n bytes)
+      for (const auto &block : blocks)
+        task.wireTime += frameTime(8) + frameTime(5 + 2 * block.count);
+
+      tasks_.push_back(task);
+    }
+  }
+}
+
+BusScheduler::Clock::duration BusScheduler::frameTime(size_t chars) const {
+  return charTime_ * chars + frameGap_;
+}
+
+BusScheduler::Clock::duration
+BusScheduler::expectedCost(const Task &task) const {
+  return task.wireTime +
+         devices_[task.device].turnaround * static_cast<int>(task.transactions);
+}
+
+double BusScheduler::expectedLoad(void) const {
+  double load = 0.0;
+  for (const auto &task : tasks_) {
+    load += std::chrono::duration<double>(expectedCost(task)).count() /
+            std::chrono::duration<double>(task.period).count();
+  }
+  return load;
+}
+
+void BusScheduler::reset(Clock::time_point now) {
+  for (auto &task : tasks_)
+    task.due = now;
+  for (auto &dev : devices_) {
+    dev.failures = 0;
+    dev.retryAt = now;
+  }
+}
+
+std::optional<size_t> BusScheduler::next(Clock::time_point now,
+                                         Clock::time_point &wakeAt) {
+  std::optional<size_t> best;
+  wakeAt = Clock::time_point::max();
+
+  for (size_t idx = 0; idx < tasks_.size(); ++idx) {
+    const Task &task = tasks_[idx];
+    const auto eligible = std::max(task.due, devices_[task.device].retryAt);
+
+    if (eligible > now) {
+      wakeAt = std::min(wakeAt, eligible);
+      continue;
+    }
+    // Earliest deadline first
+    if (!best || task.due < tasks_[*best].due)
+      best = idx;
+  }
+
+  return best;
+}
+
+bool BusScheduler::complete(size_t idx, Clock::time_point now,
+                            Clock::duration elapsed) {
+  Task &task = tasks_[idx];
+  DeviceState &dev = devices_[task.device];
+
+  // Learn the turnaround per transaction (exponential average, 1/8 weight)
+  auto measured = (elapsed - task.wireTime) /
+                  static_cast<int>(std::max<size_t>(task.transactions, 1));
+  measured = std::max(measured, Clock::duration::zero());
+  dev.turnaround += (measured - dev.turnaround) / 8;
+
+  dev.busy += elapsed;
+  dev.failures = 0;
+  dev.retryAt = now;
+  ++task.runs;
+
+  // Skip missed deadlines instead of bursting to catch up
+  task.due = std::max(task.due + task.period, now);
+
+  const bool changed = !dev.online;
+  dev.online = true;
+  return changed;
+}
+
+bool BusScheduler::fail(size_t idx, Clock::time_point now,
+                        Clock::duration elapsed) {
+  Task &task = tasks_[idx];
+  DeviceState &dev = devices_[task.device];
+
+  dev.busy += elapsed;
+  ++dev.timeouts;
+  ++dev.failures;
+  task.due = std::max(task.due + task.period, now);
+
+  // Tolerate single lost frames before the meter is considered dead
+  constexpr int maxFailures = 3;
+  if (dev.failures < maxFailures)
+    return false;
+
+  // Back off the whole meter so it cannot stall the others on the bus
+  const auto &delay = cfg_.modbus.retryDelay;
+  int seconds = delay.min;
+  if (delay.exponential) {
+    const int shift = std::min(dev.failures - maxFailures, 16);
+    seconds = std::min(delay.max, delay.min << shift);
+  }
+  dev.retryAt = now + std::chrono::seconds(seconds);
+
+  const bool changed = dev.online || dev.failures == maxFailures;
+  dev.online = false;
+  return changed;
+}
+
+void BusScheduler::markOffline(void) {
+  for (auto &dev : devices_)
+    dev.online = false;
+}
+
+json BusScheduler::metrics(Clock::time_point now) {
+  const double window =
+      std::max(std::chrono::duration<double>(now - windowStart_).count(), 1e-3);
+
+  json devices = json::array();
+  Clock::duration busBusy{};
+
+  for (size_t idx = 0; idx < devices_.size(); ++idx) {
+    DeviceState &dev = devices_[idx];
+    const auto &cfg = poller_.device(idx).cfg;
+
+    double rates[2]{0.0, 0.0};
+    for (auto &task : tasks_) {
+      if (task.device != idx)
+        continue;
+      rates[static_cast<size_t>(task.rate)] = task.runs / window;
+      task.runs = 0;
+    }
+
+    devices.push_back({
+        {"name", cfg.name},
+        {"unit_id", cfg.slaveId},
+        {"model", poller_.device(idx).profile.model},
+        {"state", dev.online ? "online" : "offline"},
+        {"rate_fast", JsonUtils::roundTo(rates[0], 3)},
+        {"rate_slow", JsonUtils::roundTo(rates[1], 3)},
+        {"utilisation",
+         JsonUtils::roundTo(
+             std::chrono::duration<double>(dev.busy).count() / window, 3)},
+        {"timeouts", dev.timeouts},
+        {"turnaround_ms",
+         JsonUtils::roundTo(
+             std::chrono::duration<double, std::milli>(dev.turnaround).count(),
+             1)},
+    });
+
+    busBusy += dev.busy;
+    dev.busy = Clock::duration::zero();
+    dev.timeouts = 0;
+  }
+
+  json metrics;
+  metrics["time"] = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::system_clock::now().time_since_epoch())
+                        .count();
+  metrics["window"] = JsonUtils::roundTo(window, 1);
+  metrics["bus"] = {
+      {"utilisation",
+       JsonUtils::roundTo(std::chrono::duration<double>(busBusy).count() /
+                              window,
+                          3)},
+      {"expected_load", JsonUtils::roundTo(expectedLoad(), 3)},
+  };
+  metrics["devices"] = devices;
+
+  windowStart_ = now;
+  return metrics;
+}
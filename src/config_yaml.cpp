@@ -1,4 +1,7 @@
 #include "config_yaml.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
 #include <spdlog/spdlog.h>
 #include <stdexcept>
 #include <yaml-cpp/yaml.h>
@@ -20,6 +23,10 @@ char parityToChar(Parity parity) {
 
 speed_t baudToSpeed(int baud) {
   switch (baud) {
+  case 300:
+    return B300;
+  case 600:
+    return B600;
   case 1200:
     return B1200;
   case 2400:
@@ -87,6 +94,29 @@ static Parity parseParity(const std::string &val) {
   throw std::invalid_argument("parity must be one of: none, even, odd");
 }
 
+static MeterProtocol parseProtocol(const std::string &val) {
+  if (val == "obis")
+    return MeterProtocol::Obis;
+  if (val == "dsmr")
+    return MeterProtocol::Dsmr;
+  if (val == "sml")
+    return MeterProtocol::Sml;
+  if (val == "modbus")
+    return MeterProtocol::Modbus;
+  if (val == "mbus")
+    return MeterProtocol::Mbus;
+  throw std::invalid_argument(
+      ".protocol must be one of: obis, dsmr, sml, modbus, mbus");
+}
+
+static ModbusMeterModel parseModel(const std::string &val) {
+  if (val == "sdm630")
+    return ModbusMeterModel::SDM630;
+  if (val == "em24")
+    return ModbusMeterModel::EM24;
+  throw std::invalid_argument(".modbus.model must be one of: sdm630, em24");
+}
+
 // ---------------------------------------------------------------------------
 // Internal parse helpers
 // ---------------------------------------------------------------------------
@@ -168,6 +198,285 @@ static ReconnectDelayConfig parseReconnectDelay(const YAML::Node &node) {
   return cfg;
 }
 
+static ResponseTimeoutConfig
+parseResponseTimeout(const YAML::Node &node,
+                     const ResponseTimeoutConfig &defaults) {
+  ResponseTimeoutConfig cfg = defaults;
+  if (!node)
+    return cfg;
+
+  cfg.sec = node["sec"].as<int>(defaults.sec);
+  cfg.usec = node["usec"].as<int>(defaults.usec);
+
+  if (cfg.sec < 0)
+    throw std::invalid_argument(".response_timeout.sec must not be negative");
+  if (cfg.usec < 0 || cfg.usec > 999999)
+    throw std::invalid_argument(
+        ".response_timeout.usec must be in range 0-999999");
+  if (cfg.sec == 0 && cfg.usec == 0)
+    throw std::invalid_argument(".response_timeout must be greater than zero");
+
+  return cfg;
+}
+
+static ModbusDeviceConfig parseModbusDevice(const YAML::Node &node,
+                                            const ModbusPollConfig &poll) {
+  ModbusDeviceConfig dev;
+
+  if (!node["name"])
+    throw std::invalid_argument(".name is required");
+
+  dev.name = node["name"].as<std::string>();
+  dev.slaveId = node["unit_id"].as<int>(1);
+  dev.model = node["model"] ? parseModel(node["model"].as<std::string>())
+                            : poll.model;
+
+  if (dev.name.empty() || dev.name.find('/') != std::string::npos)
+    throw std::invalid_argument(".name must be a non-empty topic level");
+  if (dev.slaveId < 1 || dev.slaveId > 247)
+    throw std::invalid_argument(".unit_id must be in range 1-247");
+
+  return dev;
+}
+
+static ModbusPollConfig parseModbusPoll(const YAML::Node &node, int slaveId) {
+  ModbusPollConfig cfg;
+
+  if (node) {
+    if (node["model"])
+      cfg.model = parseModel(node["model"].as<std::string>());
+    cfg.pollInterval = node["poll_interval"].as<int>(1000);
+    cfg.energyInterval = node["energy_interval"].as<int>(10000);
+    cfg.metricsInterval = node["metrics_interval"].as<int>(60);
+    cfg.maxGap = node["max_gap"].as<int>(8);
+
+    try {
+      cfg.responseTimeout =
+          parseResponseTimeout(node["response_timeout"], cfg.responseTimeout);
+      if (node["retry_delay"])
+        cfg.retryDelay = parseReconnectDelay(node["retry_delay"]);
+    } catch (const std::exception &e) {
+      throw std::invalid_argument(std::string(".modbus") + e.what());
+    }
+
+    if (cfg.pollInterval < 100)
+      throw std::invalid_argument(".modbus.poll_interval must be >= 100 ms");
+    if (cfg.energyInterval < cfg.pollInterval)
+      throw std::invalid_argument(
+          ".modbus.energy_interval must be >= poll_interval");
+    if (cfg.metricsInterval <= 0)
+      throw std::invalid_argument(".modbus.metrics_interval must be positive");
+    if (cfg.maxGap < 0 || cfg.maxGap > 64)
+      throw std::invalid_argument(".modbus.max_gap must be in range 0-64");
+
+    const YAML::Node devices = node["devices"];
+    for (size_t i = 0; devices && i < devices.size(); ++i) {
+      try {
+        ModbusDeviceConfig dev = parseModbusDevice(devices[i], cfg);
+        for (const auto &other : cfg.devices) {
+          if (other.name == dev.name)
+            throw std::invalid_argument(".name '" + dev.name +
+                                        "' is not unique");
+          if (other.slaveId == dev.slaveId)
+            throw std::invalid_argument(".unit_id " +
+                                        std::to_string(dev.slaveId) +
+                                        " is not unique");
+        }
+        cfg.devices.push_back(std::move(dev));
+      } catch (const std::exception &e) {
+        throw std::invalid_argument(".modbus.devices[" + std::to_string(i) +
+                                    "]" + e.what());
+      }
+    }
+  }
+
+  // A single meter without a devices list uses unit_id and model
+  if (cfg.devices.empty())
+    cfg.devices.push_back({"", slaveId, cfg.model});
+
+  return cfg;
+}
+
+static MbusDeviceConfig parseMbusDevice(const YAML::Node &node) {
+  MbusDeviceConfig dev;
+
+  if (!node["name"])
+    throw std::invalid_argument(".name is required");
+  dev.name = node["name"].as<std::string>();
+  if (dev.name.empty() || dev.name.find('/') != std::string::npos)
+    throw std::invalid_argument(".name must be a non-empty topic level");
+
+  if (node["address"].IsDefined() == node["secondary"].IsDefined())
+    throw std::invalid_argument(
+        ": exactly one of address or secondary must be specified");
+
+  if (node["address"]) {
+    dev.address = node["address"].as<int>();
+    if (dev.address < 0 || dev.address > 250)
+      throw std::invalid_argument(".address must be in range 0-250");
+    return dev;
+  }
+
+  // An identification number alone matches any manufacturer and medium
+  dev.secondary = node["secondary"].as<std::string>();
+  if (dev.secondary.size() == 8)
+    dev.secondary += "FFFFFFFF";
+  std::transform(dev.secondary.begin(), dev.secondary.end(),
+                 dev.secondary.begin(),
+                 [](unsigned char c) { return std::toupper(c); });
+  bool valid = dev.secondary.size() == 16;
+  for (size_t i = 0; valid && i < dev.secondary.size(); ++i) {
+    const char c = dev.secondary[i];
+    valid = std::isdigit(static_cast<unsigned char>(c)) || c == 'F' ||
+            (i >= 8 && c >= 'A' && c <= 'F');
+  }
+  if (!valid)
+    throw std::invalid_argument(
+        ".secondary must be 8 digits or 16 hex digits, F as wildcard");
+
+  return dev;
+}
+
+static std::optional<MbusPollConfig> parseMbusPoll(const YAML::Node &node) {
+  if (!node)
+    return std::nullopt;
+
+  MbusPollConfig cfg;
+  cfg.interval = node["interval"].as<int>(cfg.interval);
+  cfg.retries = node["retries"].as<int>(cfg.retries);
+  cfg.scan = node["scan"].as<bool>(cfg.scan);
+
+  try {
+    cfg.responseTimeout =
+        parseResponseTimeout(node["response_timeout"], cfg.responseTimeout);
+  } catch (const std::exception &e) {
+    throw std::invalid_argument(std::string(".mbus") + e.what());
+  }
+
+  if (cfg.interval <= 0)
+    throw std::invalid_argument(".mbus.interval must be positive");
+  if (cfg.retries < 0 || cfg.retries > 5)
+    throw std::invalid_argument(".mbus.retries must be in range 0-5");
+
+  const YAML::Node devices = node["devices"];
+  for (size_t i = 0; devices && i < devices.size(); ++i) {
+    try {
+      MbusDeviceConfig dev = parseMbusDevice(devices[i]);
+      for (const auto &other : cfg.devices) {
+        if (other.name == dev.name)
+          throw std::invalid_argument(".name '" + dev.name +
+                                      "' is not unique");
+        if (dev.address >= 0 && other.address == dev.address)
+          throw std::invalid_argument(".address " +
+                                      std::to_string(dev.address) +
+                                      " is not unique");
+      }
+      cfg.devices.push_back(std::move(dev));
+    } catch (const std::exception &e) {
+      throw std::invalid_argument(".mbus.devices[" + std::to_string(i) + "]" +
+                                  e.what());
+    }
+  }
+
+  if (cfg.devices.empty() && !cfg.scan)
+    throw std::invalid_argument(".mbus needs devices or scan: true");
+
+  return cfg;
+}
+
+static TelegramSourceConfig parseTelegramSource(const YAML::Node &node) {
+  TelegramSourceConfig cfg;
+  if (!node)
+    return cfg;
+
+  cfg.readTimeout = node["read_timeout"].as<int>(cfg.readTimeout);
+  cfg.keepalive = node["keepalive"].as<int>(cfg.keepalive);
+  cfg.rcvLowat = node["rcvlowat"].as<int>(cfg.rcvLowat);
+  cfg.noDelay = node["nodelay"].as<bool>(cfg.noDelay);
+  cfg.metricsInterval = node["metrics_interval"].as<int>(cfg.metricsInterval);
+  cfg.maxRetries = node["max_retries"].as<int>(cfg.maxRetries);
+  try {
+    if (node["reconnect_delay"])
+      cfg.reconnectDelay = parseReconnectDelay(node["reconnect_delay"]);
+  } catch (const std::exception &e) {
+    throw std::invalid_argument(std::string(".telegram") + e.what());
+  }
+
+  if (cfg.readTimeout <= 0)
+    throw std::invalid_argument(".telegram.read_timeout must be positive");
+  if (cfg.keepalive < 0)
+    throw std::invalid_argument(".telegram.keepalive must not be negative");
+  if (cfg.rcvLowat < 0)
+    throw std::invalid_argument(".telegram.rcvlowat must not be negative");
+  if (cfg.metricsInterval <= 0)
+    throw std::invalid_argument(
+        ".telegram.metrics_interval must be positive");
+  if (cfg.maxRetries < 0)
+    throw std::invalid_argument(".telegram.max_retries must not be negative");
+
+  return cfg;
+}
+
+static DecryptionConfig::Key parseKey(const YAML::Node &node,
+                                     const std::string &path) {
+  const auto hex = node.as<std::string>();
+  DecryptionConfig::Key key;
+  if (hex.size() != 2 * key.size())
+    throw std::invalid_argument(path + " must be 32 hex digits");
+
+  for (size_t i = 0; i < key.size(); ++i) {
+    auto [ptr, ec] =
+        std::from_chars(hex.data() + 2 * i, hex.data() + 2 * i + 2, key[i], 16);
+    if (ec != std::errc() || ptr != hex.data() + 2 * i + 2)
+      throw std::invalid_argument(path + " must be 32 hex digits");
+  }
+  return key;
+}
+
+static std::optional<DecryptionConfig>
+parseDecryption(const YAML::Node &node) {
+  if (!node)
+    return std::nullopt;
+  if (!node["key"])
+    throw std::invalid_argument(".decryption.key is required");
+
+  DecryptionConfig cfg;
+  cfg.key = parseKey(node["key"], ".decryption.key");
+  if (node["auth_key"])
+    cfg.authKey = parseKey(node["auth_key"], ".decryption.auth_key");
+
+  return cfg;
+}
+
+static std::optional<IecReadoutConfig>
+parseIecReadout(const YAML::Node &node) {
+  if (!node)
+    return std::nullopt;
+
+  IecReadoutConfig cfg;
+  cfg.interval = node["interval"].as<int>(cfg.interval);
+  cfg.maxBaud = node["max_baud"].as<int>(cfg.maxBaud);
+  cfg.address = node["address"].as<std::string>(cfg.address);
+
+  if (cfg.interval <= 0)
+    throw std::invalid_argument(".iec.interval must be positive");
+  if (cfg.maxBaud != 300 && cfg.maxBaud != 600 && cfg.maxBaud != 1200 &&
+      cfg.maxBaud != 2400 && cfg.maxBaud != 4800 && cfg.maxBaud != 9600 &&
+      cfg.maxBaud != 19200)
+    throw std::invalid_argument(".iec.max_baud must be one of 300, 600, "
+                                "1200, 2400, 4800, 9600, 19200");
+  if (cfg.address.size() > 32 ||
+      !std::all_of(cfg.address.begin(), cfg.address.end(),
+                   [](char c) {
+                     return std::isalnum(static_cast<unsigned char>(c)) ||
+                            c == ' ';
+                   }))
+    throw std::invalid_argument(
+        ".iec.address must be up to 32 letters, digits or spaces");
+
+  return cfg;
+}
+
 static GridConfig parseGrid(const YAML::Node &node) {
   GridConfig cfg;
 
@@ -200,12 +509,36 @@ static MeterMasterConfig parseModbusMaster(const YAML::Node &node) {
   if (cfg.tcp.has_value() == cfg.rtu.has_value())
     throw std::runtime_error(": exactly one of tcp or rtu must be specified");
 
+  cfg.protocol = node["protocol"]
+                     ? parseProtocol(node["protocol"].as<std::string>())
+                     : MeterProtocol::Obis;
   cfg.slaveId = node["unit_id"].as<int>(1);
   cfg.grid = parseGrid(node["grid"]);
-
   if (cfg.slaveId < 1 || cfg.slaveId > 247)
     throw std::invalid_argument(".unit_id must be in range 1-247");
 
+  cfg.modbus = parseModbusPoll(node["modbus"], cfg.slaveId);
+  cfg.telegram = parseTelegramSource(node["telegram"]);
+  cfg.iec = parseIecReadout(node["iec"]);
+
+  if (cfg.iec && (cfg.protocol != MeterProtocol::Obis || !cfg.rtu))
+    throw std::invalid_argument(".iec requires protocol obis and rtu");
+
+  cfg.decryption = parseDecryption(node["decryption"]);
+
+  if (cfg.decryption && cfg.protocol != MeterProtocol::Obis &&
+      cfg.protocol != MeterProtocol::Dsmr)
+    throw std::invalid_argument(".decryption requires protocol obis or dsmr");
+  if (cfg.decryption && cfg.iec)
+    throw std::invalid_argument(".decryption and .iec are exclusive");
+
+  cfg.mbus = parseMbusPoll(node["mbus"]);
+
+  if (cfg.protocol == MeterProtocol::Mbus && (!cfg.mbus || !cfg.rtu))
+    throw std::invalid_argument(".protocol mbus requires .mbus and rtu");
+  if (cfg.mbus && cfg.protocol != MeterProtocol::Mbus)
+    throw std::invalid_argument(".mbus requires protocol mbus");
+
   return cfg;
 }
 
@@ -240,11 +573,51 @@ static std::optional<MeterSlaveConfig> parseMeterSlave(const YAML::Node &node) {
 static MeterConfig parseMeter(const YAML::Node &node) {
   MeterConfig cfg;
 
-  try {
-    cfg.master = parseModbusMaster(node["master"]);
-  } catch (const std::exception &e) {
-    throw std::runtime_error(std::string("meter.master") + e.what());
+  if (node["master"] && node["meters"])
+    throw std::runtime_error(
+        "meter: only one of master or meters may be specified");
+
+  if (const auto meters = node["meters"]) {
+    if (!meters.IsSequence() || meters.size() == 0)
+      throw std::invalid_argument("meter.meters must be a non-empty list");
+
+    for (size_t i = 0; i < meters.size(); ++i) {
+      const std::string path = "meter.meters[" + std::to_string(i) + "]";
+      MeterMasterConfig master;
+      try {
+        if (!meters[i]["name"])
+          throw std::invalid_argument(".name is required");
+        master = parseModbusMaster(meters[i]);
+        master.name = meters[i]["name"].as<std::string>();
+        if (master.name.empty() ||
+            master.name.find('/') != std::string::npos)
+          throw std::invalid_argument(".name must be a non-empty topic level");
+      } catch (const std::exception &e) {
+        throw std::runtime_error(path + e.what());
+      }
+
+      for (const auto &other : cfg.masters) {
+        if (other.name == master.name)
+          throw std::invalid_argument(path + ".name '" + master.name +
+                                      "' is already used");
+        if (master.rtu && other.rtu && other.rtu->device == master.rtu->device)
+          throw std::invalid_argument(path + ".rtu.device '" +
+                                      master.rtu->device +
+                                      "' is already used");
+      }
+      cfg.masters.push_back(std::move(master));
+    }
+  } else {
+    try {
+      cfg.masters.push_back(parseModbusMaster(node["master"]));
+    } catch (const std::exception &e) {
+      throw std::runtime_error(std::string("meter.master") + e.what());
+    }
   }
+
+  cfg.threads = node["threads"].as<int>(1);
+  if (cfg.threads < 1 || cfg.threads > 64)
+    throw std::invalid_argument("meter.threads must be in range 1-64");
   try {
     cfg.slave = parseMeterSlave(node["slave"]);
   } catch (const std::exception &e) {
@@ -303,6 +676,13 @@ static LoggerConfig parseLogger(const YAML::Node &node) {
   if (node["level"])
     cfg.globalLevel = parseLogLevel(node["level"].as<std::string>());
 
+  if (node["queue_size"]) {
+    int queueSize = node["queue_size"].as<int>();
+    if (queueSize <= 0)
+      throw std::runtime_error("logger.queue_size must be > 0");
+    cfg.queueSize = static_cast<size_t>(queueSize);
+  }
+
   if (node["modules"]) {
     for (auto it : node["modules"]) {
       std::string key = it.first.as<std::string>();
@@ -321,19 +701,248 @@ static LoggerConfig parseLogger(const YAML::Node &node) {
   return cfg;
 }
 
+static std::optional<SnapshotConfig> parseSnapshot(const YAML::Node &node) {
+  if (!node)
+    return std::nullopt;
+
+  SnapshotConfig cfg;
+  if (!node["path"])
+    throw std::invalid_argument("snapshot.path is required");
+  cfg.path = node["path"].as<std::string>();
+  cfg.interval = node["interval"].as<int>(cfg.interval);
+  cfg.maxAge = node["max_age"].as<int>(cfg.maxAge);
+
+  if (cfg.path.empty())
+    throw std::invalid_argument("snapshot.path must not be empty");
+  if (cfg.interval <= 0)
+    throw std::invalid_argument("snapshot.interval must be positive");
+  if (cfg.maxAge <= 0)
+    throw std::invalid_argument("snapshot.max_age must be positive");
+
+  return cfg;
+}
+
+static StatsConfig parseStats(const YAML::Node &node) {
+  StatsConfig cfg;
+  if (!node)
+    return cfg;
+
+  cfg.interval = node["interval"].as<int>(cfg.interval);
+  if (cfg.interval < 0)
+    throw std::invalid_argument("stats.interval must be >= 0");
+  return cfg;
+}
+
+static std::optional<HttpConfig> parseHttp(const YAML::Node &node) {
+  if (!node)
+    return std::nullopt;
+
+  HttpConfig cfg;
+  cfg.listen = node["listen"].as<std::string>(cfg.listen);
+  cfg.port = node["port"].as<int>(cfg.port);
+  cfg.longPoll = node["long_poll"].as<int>(cfg.longPoll);
+  cfg.maxClients = node["max_clients"].as<int>(cfg.maxClients);
+  cfg.streamQueue = node["stream_queue"].as<int>(cfg.streamQueue);
+
+  if (cfg.port <= 0 || cfg.port > 65535)
+    throw std::invalid_argument("http.port must be in range 1-65535");
+  if (cfg.longPoll <= 0)
+    throw std::invalid_argument("http.long_poll must be positive");
+  if (cfg.maxClients <= 0)
+    throw std::invalid_argument("http.max_clients must be positive");
+  if (cfg.streamQueue < 2)
+    throw std::invalid_argument("http.stream_queue must be at least 2");
+
+  return cfg;
+}
+
+static DropPolicy parseDropPolicy(const std::string &val) {
+  if (val == "oldest")
+    return DropPolicy::Oldest;
+  if (val == "newest")
+    return DropPolicy::Newest;
+  throw std::invalid_argument(".drop must be one of: oldest, newest");
+}
+
+static SinkOptions parseSinkOptions(const YAML::Node &node) {
+  SinkOptions cfg;
+  cfg.queue = node["queue"].as<int>(cfg.queue);
+  cfg.batch = node["batch"].as<int>(cfg.batch);
+  cfg.flushInterval = node["flush_interval"].as<int>(cfg.flushInterval);
+  if (node["drop"])
+    cfg.drop = parseDropPolicy(node["drop"].as<std::string>());
+
+  if (cfg.queue < 1 || cfg.queue > 1048576)
+    throw std::invalid_argument(".queue must be in range 1-1048576");
+  if (cfg.batch < 1 || cfg.batch > cfg.queue)
+    throw std::invalid_argument(".batch must be in range 1-queue");
+  if (cfg.flushInterval < 0 || cfg.flushInterval > 60000)
+    throw std::invalid_argument(".flush_interval must be in range 0-60000");
+
+  return cfg;
+}
+
+static FileSinkConfig parseFileSink(const YAML::Node &node) {
+  FileSinkConfig cfg;
+  if (!node["path"])
+    throw std::invalid_argument(".path is required");
+  cfg.path = node["path"].as<std::string>();
+  cfg.telegrams = node["telegrams"].as<bool>(cfg.telegrams);
+  if (cfg.path.empty())
+    throw std::invalid_argument(".path must not be empty");
+  return cfg;
+}
+
+static InfluxSinkConfig parseInfluxSink(const YAML::Node &node) {
+  InfluxSinkConfig cfg;
+  cfg.host = node["host"].as<std::string>(cfg.host);
+  cfg.port = node["port"].as<int>(cfg.port);
+  cfg.socket = node["socket"].as<std::string>(cfg.socket);
+  cfg.measurement = node["measurement"].as<std::string>(cfg.measurement);
+  if (node["tags"])
+    cfg.tags = node["tags"].as<std::map<std::string, std::string>>();
+  cfg.packetSize = node["packet_size"].as<int>(cfg.packetSize);
+
+  if (cfg.host.empty() == cfg.socket.empty())
+    throw std::invalid_argument(": exactly one of host or socket is required");
+  if (cfg.port <= 0 || cfg.port > 65535)
+    throw std::invalid_argument(".port must be in range 1-65535");
+  if (cfg.measurement.empty())
+    throw std::invalid_argument(".measurement must not be empty");
+  for (const auto &[key, value] : cfg.tags) {
+    if (key.empty() || value.empty())
+      throw std::invalid_argument(".tags must not be empty");
+    if (key == "meter" || key == "channel")
+      throw std::invalid_argument(".tags: '" + key + "' is set per line");
+  }
+  if (cfg.packetSize < 256 || cfg.packetSize > 65507)
+    throw std::invalid_argument(".packet_size must be in range 256-65507");
+
+  return cfg;
+}
+
+static std::vector<SinkConfig> parseSinks(const YAML::Node &node) {
+  std::vector<SinkConfig> sinks;
+  if (!node)
+    return sinks;
+  if (!node.IsSequence())
+    throw std::invalid_argument("sinks must be a list");
+
+  for (size_t i = 0; i < node.size(); ++i) {
+    const std::string path = "sinks[" + std::to_string(i) + "]";
+    SinkConfig sink;
+    try {
+      if (!node[i]["type"])
+        throw std::invalid_argument(".type is required");
+      sink.type = node[i]["type"].as<std::string>();
+      sink.name = node[i]["name"].as<std::string>(sink.type);
+      if (sink.name.empty())
+        throw std::invalid_argument(".name must not be empty");
+      sink.options = parseSinkOptions(node[i]);
+
+      if (sink.type == "file")
+        sink.file = parseFileSink(node[i]);
+      else if (sink.type == "influx")
+        sink.influx = parseInfluxSink(node[i]);
+      else
+        throw std::invalid_argument(".type must be one of: file, influx");
+    } catch (const std::exception &e) {
+      throw std::runtime_error(path + e.what());
+    }
+
+    for (const auto &other : sinks) {
+      if (other.name == sink.name)
+        throw std::invalid_argument(path + ".name '" + sink.name +
+                                    "' is already used");
+    }
+    sinks.push_back(std::move(sink));
+  }
+
+  return sinks;
+}
+
+static std::optional<RecorderConfig> parseRecorder(const YAML::Node &node) {
+  if (!node)
+    return std::nullopt;
+
+  RecorderConfig cfg;
+  if (!node["path"])
+    throw std::invalid_argument("recorder.path is required");
+  cfg.path = node["path"].as<std::string>();
+  cfg.events = node["events"].as<int>(cfg.events);
+  cfg.dumpOnError = node["dump_on_error"].as<bool>(cfg.dumpOnError);
+
+  if (cfg.path.empty())
+    throw std::invalid_argument("recorder.path must not be empty");
+  if (cfg.events < 64 || cfg.events > 1048576)
+    throw std::invalid_argument("recorder.events must be 64-1048576");
+
+  return cfg;
+}
+
+static ThreadTuningConfig parseThreadTuning(const YAML::Node &node,
+                                            const std::string &role) {
+  ThreadTuningConfig cfg;
+  if (!node)
+    return cfg;
+
+  const std::string prefix = "scheduling." + role;
+  const std::string policy = node["policy"].as<std::string>("other");
+  if (policy == "other")
+    cfg.policy = SCHED_OTHER;
+  else if (policy == "fifo")
+    cfg.policy = SCHED_FIFO;
+  else if (policy == "rr")
+    cfg.policy = SCHED_RR;
+  else
+    throw std::invalid_argument(prefix +
+                                ".policy must be one of: other, fifo, rr");
+
+  cfg.priority = node["priority"].as<int>(cfg.policy == SCHED_OTHER ? 0 : 10);
+  if (cfg.policy == SCHED_OTHER && cfg.priority != 0)
+    throw std::invalid_argument(prefix + ".priority needs policy fifo or rr");
+  if (cfg.policy != SCHED_OTHER && (cfg.priority < 1 || cfg.priority > 99))
+    throw std::invalid_argument(prefix + ".priority must be 1-99");
+
+  if (node["cpus"]) {
+    cfg.cpus = node["cpus"].as<std::vector<int>>();
+    for (int cpu : cfg.cpus) {
+      if (cpu < 0 || cpu >= CPU_SETSIZE)
+        throw std::invalid_argument(prefix + ".cpus: invalid CPU " +
+                                    std::to_string(cpu));
+    }
+  }
+
+  return cfg;
+}
+
+static std::optional<SchedulingConfig>
+parseScheduling(const YAML::Node &node) {
+  if (!node)
+    return std::nullopt;
+
+  SchedulingConfig cfg;
+  cfg.meter = parseThreadTuning(node["meter"], "meter");
+  cfg.slave = parseThreadTuning(node["slave"], "slave");
+  cfg.mqtt = parseThreadTuning(node["mqtt"], "mqtt");
+  cfg.lockMemory = node["lock_memory"].as<bool>(cfg.lockMemory);
+  return cfg;
+}
+
 // ---------------------------------------------------------------------------
 // Cross section validation
 // ---------------------------------------------------------------------------
 
 static void validateConfig(const AppConfig &cfg) {
   if (cfg.meter.slave) {
-    const MeterMasterConfig &master = cfg.meter.master;
     const MeterSlaveConfig &slave = *cfg.meter.slave;
 
     // RTU device conflict: master and slave cannot share the same serial device
-    if (master.rtu && slave.rtu && master.rtu->device == slave.rtu->device) {
-      throw std::runtime_error(
-          "meter.master and meter.slave cannot share the same RTU device");
+    for (const auto &master : cfg.meter.masters) {
+      if (master.rtu && slave.rtu && master.rtu->device == slave.rtu->device) {
+        throw std::runtime_error(
+            "meter.master and meter.slave cannot share the same RTU device");
+      }
     }
   }
 }
@@ -349,6 +958,12 @@ AppConfig loadConfig(const std::string &path) {
   cfg.meter = parseMeter(root["meter"]);
   cfg.mqtt = parseMqtt(root["mqtt"]);
   cfg.logger = parseLogger(root["logger"]);
+  cfg.snapshot = parseSnapshot(root["snapshot"]);
+  cfg.scheduling = parseScheduling(root["scheduling"]);
+  cfg.stats = parseStats(root["stats"]);
+  cfg.recorder = parseRecorder(root["recorder"]);
+  cfg.http = parseHttp(root["http"]);
+  cfg.sinks = parseSinks(root["sinks"]);
 
   validateConfig(cfg);
 
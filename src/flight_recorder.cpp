@@ -0,0 +1,251 @@
+#include "flight_recorder.h"
+#include "config_yaml.h"
+#include "modbus_error.h"
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <expected>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using json = nlohmann::ordered_json;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using FlightRecorder::Event;
+
+// Written by the owning thread only. seq is the event index + 1 once the
+// slot is complete and 0 while it is being written.
+struct Slot {
+  std::atomic<uint64_t> seq{0};
+  std::atomic<int64_t> time{0}; // ns on the steady clock
+  std::atomic<uint32_t> event{0};
+  std::array<std::atomic<int64_t>, 3> args{};
+};
+static_assert(sizeof(Slot) == 48, "event size documented as 48 bytes");
+
+struct Ring {
+  explicit Ring(size_t size) : slots(new Slot[size]), size(size) {}
+
+  std::unique_ptr<Slot[]> slots;
+  const size_t size;
+  std::atomic<uint64_t> head{0}; // events written so far
+  std::atomic<pid_t> tid{0};
+  std::atomic<bool> owned{false};
+};
+
+// Hands the ring back when its thread exits
+struct Owner {
+  Ring *ring{nullptr};
+  ~Owner() {
+    if (ring)
+      ring->owned.store(false, std::memory_order_release);
+  }
+};
+
+struct Description {
+  const char *name;
+  std::array<const char *, 3> args; // nullptr for unused arguments
+  int duration;                     // argument holding µs, -1 = instant
+};
+
+// In the order of FlightRecorder::Event
+constexpr std::array<Description, 11> EVENTS = {{
+    {"bytes_read", {"bytes", nullptr, nullptr}, -1},
+    {"frame_start", {"format", nullptr, nullptr}, -1},
+    {"frame", {"length", "us", nullptr}, 1},
+    {"parse", {"protocol", "ok", "us"}, 2},
+    {"callback", {"length", "us", nullptr}, 1},
+    {"mqtt_enqueue", {"length", "queued", nullptr}, -1},
+    {"mqtt_publish", {"length", "rc", "us"}, 2},
+    {"modbus_request", {"function", "address", "count"}, -1},
+    {"modbus_reply", {"function", "length", "us"}, 2},
+    {"reconnect", {"errno", "delay_ms", nullptr}, -1},
+    {"error", {"errno", "severity", nullptr}, -1},
+}};
+
+std::atomic<bool> enabled{false};
+RecorderConfig config;
+std::mutex ringsMutex;
+std::vector<std::unique_ptr<Ring>> rings;
+std::atomic<int64_t> lastRequest{INT64_MIN};
+std::atomic<bool> requested{false};
+thread_local Owner owner;
+
+// First event of a thread: reuse the ring of an exited thread or add one
+Ring *claimRing(void) {
+  std::lock_guard<std::mutex> lock(ringsMutex);
+  Ring *ring = nullptr;
+  for (auto &candidate : rings) {
+    bool free = false;
+    if (candidate->owned.compare_exchange_strong(free, true)) {
+      ring = candidate.get();
+      break;
+    }
+  }
+  if (!ring) {
+    rings.push_back(std::make_unique<Ring>(config.events));
+    ring = rings.back().get();
+    ring->owned.store(true);
+  }
+  ring->head.store(0, std::memory_order_release);
+  ring->tid.store(gettid(), std::memory_order_relaxed);
+  return ring;
+}
+
+std::string threadName(pid_t tid) {
+  std::ifstream file("/proc/self/task/" + std::to_string(tid) + "/comm");
+  std::string name;
+  if (std::getline(file, name) && !name.empty())
+    return name;
+  return "exited " + std::to_string(tid);
+}
+
+} // namespace
+
+namespace FlightRecorder {
+
+void enable(const RecorderConfig &cfg) {
+  config = cfg;
+  enabled.store(true, std::memory_order_release);
+}
+
+void record(Event event, int64_t a, int64_t b, int64_t c) {
+  if (!enabled.load(std::memory_order_relaxed))
+    return;
+  if (!owner.ring)
+    owner.ring = claimRing();
+
+  Ring &ring = *owner.ring;
+  const uint64_t index = ring.head.load(std::memory_order_relaxed);
+  Slot &slot = ring.slots[index % ring.size];
+
+  slot.seq.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.time.store(Clock::now().time_since_epoch().count(),
+                  std::memory_order_relaxed);
+  slot.event.store(static_cast<uint32_t>(event), std::memory_order_relaxed);
+  slot.args[0].store(a, std::memory_order_relaxed);
+  slot.args[1].store(b, std::memory_order_relaxed);
+  slot.args[2].store(c, std::memory_order_relaxed);
+  slot.seq.store(index + 1, std::memory_order_release);
+  ring.head.store(index + 1, std::memory_order_release);
+}
+
+void recordError(const ModbusError &err) {
+  record(Event::ERROR, err.code, static_cast<int64_t>(err.severity));
+  if (!enabled.load(std::memory_order_relaxed) || !config.dumpOnError ||
+      err.severity == ModbusError::Severity::SHUTDOWN)
+    return;
+
+  // One dump per interval, an error storm would overwrite the first fault
+  const int64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+                          Clock::now().time_since_epoch())
+                          .count();
+  int64_t last = lastRequest.load(std::memory_order_relaxed);
+  if (last != INT64_MIN && now - last < DUMP_INTERVAL)
+    return;
+  if (!lastRequest.compare_exchange_strong(last, now))
+    return;
+
+  // Blocked in every thread, the main thread reads it from the signalfd
+  requested.store(true);
+  kill(getpid(), SIGUSR2);
+}
+
+bool dumpRequested(void) { return requested.exchange(false); }
+
+std::expected<void, ModbusError> dump(void) {
+  if (!enabled.load(std::memory_order_acquire))
+    return std::unexpected(
+        ModbusError::custom(EINVAL, "Flight recorder not enabled"));
+
+  const pid_t pid = getpid();
+  json events = json::array();
+  events.push_back({{"name", "process_name"},
+                    {"ph", "M"},
+                    {"pid", pid},
+                    {"args", {{"name", "smartmeter-gateway"}}}});
+
+  std::lock_guard<std::mutex> lock(ringsMutex);
+  for (const auto &ring : rings) {
+    const pid_t tid = ring->tid.load(std::memory_order_relaxed);
+    const std::string name = ring->owned.load(std::memory_order_acquire)
+                                 ? threadName(tid)
+                                 : "exited " + std::to_string(tid);
+    events.push_back({{"name", "thread_name"},
+                      {"ph", "M"},
+                      {"pid", pid},
+                      {"tid", tid},
+                      {"args", {{"name", name}}}});
+
+    const uint64_t head = ring->head.load(std::memory_order_acquire);
+    const uint64_t first = head > ring->size ? head - ring->size : 0;
+    for (uint64_t index = first; index < head; ++index) {
+      const Slot &slot = ring->slots[index % ring->size];
+      if (slot.seq.load(std::memory_order_acquire) != index + 1)
+        continue; // overwritten meanwhile
+
+      const int64_t time = slot.time.load(std::memory_order_relaxed);
+      const uint32_t type = slot.event.load(std::memory_order_relaxed);
+      std::array<int64_t, 3> args;
+      for (size_t i = 0; i < args.size(); ++i)
+        args[i] = slot.args[i].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) != index + 1 ||
+          type >= EVENTS.size())
+        continue;
+
+      const Description &desc = EVENTS[type];
+      json entry = {{"name", desc.name}, {"pid", pid}, {"tid", tid}};
+      json named = json::object();
+      for (size_t i = 0; i < args.size(); ++i) {
+        if (desc.args[i])
+          named[desc.args[i]] = args[i];
+      }
+
+      // Trace time stamps are µs; events with a duration end at their time
+      const double us = time / 1000.0;
+      if (desc.duration >= 0) {
+        entry["ph"] = "X";
+        entry["ts"] = us - args[desc.duration];
+        entry["dur"] = args[desc.duration];
+      } else {
+        entry["ph"] = "i";
+        entry["s"] = "t";
+        entry["ts"] = us;
+      }
+      entry["args"] = std::move(named);
+      events.push_back(std::move(entry));
+    }
+  }
+
+  // Written aside and renamed, a reader never sees half a trace
+  const std::string tmp = config.path + ".tmp";
+  {
+    std::ofstream file(tmp, std::ios::trunc);
+    file << json{{"traceEvents", std::move(events)},
+                 {"displayTimeUnit", "ms"}}
+                .dump();
+    if (!file.flush())
+      return std::unexpected(
+          ModbusError::fromErrno("Unable to write '{}'", tmp));
+  }
+  if (std::rename(tmp.c_str(), config.path.c_str()) == -1)
+    return std::unexpected(ModbusError::fromErrno(
+        "Unable to rename '{}' to '{}'", tmp, config.path));
+
+  return {};
+}
+
+} // namespace FlightRecorder
@@ -0,0 +1,151 @@
+#include "gcm_decryptor.h"
+#include "modbus_error.h"
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <openssl/evp.h>
+#include <optional>
+#include <string>
+
+namespace {
+
+constexpr unsigned char GLO_CIPHERING = 0xdb;
+constexpr unsigned char SECURITY_ENCRYPTED = 0x20;
+constexpr unsigned char SECURITY_AUTHENTICATED = 0x30;
+constexpr size_t COUNTER_SIZE = 4;
+constexpr size_t IV_SIZE = GcmDecryptor::TITLE_SIZE + COUNTER_SIZE;
+
+} // namespace
+
+GcmDecryptor::GcmDecryptor(void) : ctx_(EVP_CIPHER_CTX_new()) {}
+
+GcmDecryptor::~GcmDecryptor() { EVP_CIPHER_CTX_free(ctx_); }
+
+std::expected<void, ModbusError>
+GcmDecryptor::setKeys(const Key &key, const std::optional<Key> &authKey) {
+  if (!ctx_ ||
+      EVP_DecryptInit_ex(ctx_, EVP_aes_128_gcm(), nullptr, nullptr,
+                         nullptr) != 1 ||
+      EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_GCM_SET_IVLEN, IV_SIZE, nullptr) !=
+          1 ||
+      EVP_DecryptInit_ex(ctx_, nullptr, nullptr, key.data(), nullptr) != 1) {
+    return std::unexpected(ModbusError::custom(
+        ENOMEM, "setKeys(): Unable to set up the AES-128-GCM context"));
+  }
+
+  authKey_ = authKey;
+
+  // The meter restarts its counter together with a new key
+  frameCounter_ = 0;
+  acceptedCounter_ = 0;
+  hasCounter_ = false;
+  return {};
+}
+
+std::expected<void, ModbusError> GcmDecryptor::decrypt(std::string &frame) {
+  auto *p = reinterpret_cast<unsigned char *>(frame.data());
+  const size_t size = frame.size();
+
+  // --- Frame header: tag, system title and length ---
+  if (size < 11 || p[0] != GLO_CIPHERING || p[1] != TITLE_SIZE) {
+    return std::unexpected(ModbusError::custom(
+        EPROTO, "decrypt(): Not a general-glo-ciphering frame"));
+  }
+
+  size_t header = 11;
+  size_t length = p[10];
+  if (length == 0x81 && size > 11) {
+    length = p[11];
+    header = 12;
+  } else if (length == 0x82 && size > 12) {
+    length = static_cast<size_t>(p[11]) << 8 | p[12];
+    header = 13;
+  } else if (length >= 0x80) {
+    return std::unexpected(ModbusError::custom(
+        EPROTO, "decrypt(): Invalid frame length field {:02x}", length));
+  }
+
+  const unsigned char security = header < size ? p[header] : 0;
+  const size_t tagSize = security == SECURITY_AUTHENTICATED ? TAG_SIZE : 0;
+  if (header + length != size || length < 1 + COUNTER_SIZE + tagSize) {
+    return std::unexpected(ModbusError::custom(
+        EPROTO, "decrypt(): Frame length {} does not match {} bytes received",
+        length, size - header));
+  }
+  if (security != SECURITY_AUTHENTICATED && security != SECURITY_ENCRYPTED) {
+    return std::unexpected(ModbusError::custom(
+        EBADMSG, "decrypt(): Unsupported security control byte {:02x}",
+        security));
+  }
+  if (security == SECURITY_AUTHENTICATED && !authKey_) {
+    return std::unexpected(ModbusError::custom(
+        EBADMSG, "decrypt(): Frame is authenticated, auth_key not set"));
+  }
+
+  const unsigned char *counter = p + header + 1;
+  const uint32_t frameCounter = static_cast<uint32_t>(counter[0]) << 24 |
+                                static_cast<uint32_t>(counter[1]) << 16 |
+                                static_cast<uint32_t>(counter[2]) << 8 |
+                                counter[3];
+  if (hasCounter_ && frameCounter <= acceptedCounter_) {
+    return std::unexpected(ModbusError::custom(
+        EBADMSG, "decrypt(): Frame counter {} not above {}, dropping replay",
+        frameCounter, acceptedCounter_));
+  }
+
+  // --- IV = system title | frame counter, AAD = security | auth key ---
+  std::array<unsigned char, IV_SIZE> iv;
+  std::memcpy(iv.data(), p + 2, TITLE_SIZE);
+  std::memcpy(iv.data() + TITLE_SIZE, counter, COUNTER_SIZE);
+
+  unsigned char *text = p + header + 1 + COUNTER_SIZE;
+  const int textSize = static_cast<int>(size - tagSize - (text - p));
+  int outSize = 0;
+
+  if (EVP_DecryptInit_ex(ctx_, nullptr, nullptr, nullptr, iv.data()) != 1) {
+    return std::unexpected(ModbusError::custom(
+        EBADMSG, "decrypt(): No key set for AES-128-GCM"));
+  }
+
+  if (tagSize) {
+    std::array<unsigned char, 1 + KEY_SIZE> aad;
+    aad[0] = security;
+    std::memcpy(aad.data() + 1, authKey_->data(), KEY_SIZE);
+    std::array<unsigned char, TAG_SIZE> tag;
+    std::memcpy(tag.data(), text + textSize, TAG_SIZE);
+
+    if (EVP_DecryptUpdate(ctx_, nullptr, &outSize, aad.data(), aad.size()) !=
+            1 ||
+        EVP_CIPHER_CTX_ctrl(ctx_, EVP_CTRL_GCM_SET_TAG, TAG_SIZE,
+                            tag.data()) != 1) {
+      return std::unexpected(ModbusError::custom(
+          EBADMSG, "decrypt(): Unable to set authentication data"));
+    }
+  }
+
+  // In place, OpenSSL allows identical input and output buffers
+  if (EVP_DecryptUpdate(ctx_, text, &outSize, text, textSize) != 1 ||
+      (tagSize && EVP_DecryptFinal_ex(ctx_, text + outSize, &outSize) != 1)) {
+    return std::unexpected(ModbusError::custom(
+        EBADMSG, "decrypt(): Authentication failed for frame counter {}, "
+                 "wrong key?",
+        frameCounter));
+  }
+
+  systemTitle_.assign(reinterpret_cast<const char *>(p + 2), TITLE_SIZE);
+  frameCounter_ = frameCounter;
+  // Without a tag only the telegram's own checks vouch for the counter
+  if (tagSize)
+    accept();
+
+  frame.resize(text - p + textSize);
+  frame.erase(0, text - p);
+  return {};
+}
+
+void GcmDecryptor::accept(void) {
+  acceptedCounter_ = frameCounter_;
+  hasCounter_ = true;
+}
@@ -0,0 +1,876 @@
+#include "http_server.h"
+#include "config_yaml.h"
+#include "modbus_error.h"
+#include "signal_handler.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <map>
+#include <netdb.h>
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+const char *reason(int status) {
+  switch (status) {
+  case 101:
+    return "Switching Protocols";
+  case 200:
+    return "OK";
+  case 304:
+    return "Not Modified";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 405:
+    return "Method Not Allowed";
+  case 431:
+    return "Request Header Fields Too Large";
+  default:
+    return "Internal Server Error";
+  }
+}
+
+// Error bodies are shared like documents
+std::shared_ptr<const std::string> errorBody(int status) {
+  return std::make_shared<const std::string>(
+      std::format("{{\"error\":\"{}\"}}", reason(status)));
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+  return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                    [](char x, char y) {
+                      return std::tolower(static_cast<unsigned char>(x)) ==
+                             std::tolower(static_cast<unsigned char>(y));
+                    });
+}
+
+// Value of a numeric query parameter, name including the '='
+std::optional<uint64_t> numberParam(std::string_view query,
+                                    std::string_view name) {
+  while (!query.empty()) {
+    const auto amp = query.find('&');
+    const std::string_view param = query.substr(0, amp);
+    if (param.starts_with(name)) {
+      uint64_t value = 0;
+      const char *first = param.data() + name.size();
+      const char *last = param.data() + param.size();
+      auto [ptr, ec] = std::from_chars(first, last, value);
+      if (ec == std::errc() && ptr == last)
+        return value;
+    }
+    if (amp == std::string_view::npos)
+      break;
+    query.remove_prefix(amp + 1);
+  }
+  return std::nullopt;
+}
+
+void unlist(std::multimap<std::string, int> &clients, const std::string &path,
+            int fd) {
+  auto [first, last] = clients.equal_range(path);
+  for (auto it = first; it != last; ++it) {
+    if (it->second == fd) {
+      clients.erase(it);
+      return;
+    }
+  }
+}
+
+// Sec-WebSocket-Accept for the key of a client (RFC 6455, 4.2.2)
+std::string acceptKey(std::string_view key) {
+  const std::string input =
+      std::string(key) + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+  std::array<unsigned char, SHA_DIGEST_LENGTH> digest;
+  SHA1(reinterpret_cast<const unsigned char *>(input.data()), input.size(),
+       digest.data());
+  std::array<unsigned char, 4 * ((SHA_DIGEST_LENGTH + 2) / 3) + 1> encoded;
+  EVP_EncodeBlock(encoded.data(), digest.data(), digest.size());
+  return reinterpret_cast<const char *>(encoded.data());
+}
+
+// Unmasked server frame, a single fragment
+std::string webSocketFrame(uint8_t opcode, std::string_view payload) {
+  std::string frame;
+  frame.reserve(payload.size() + 10);
+  frame.push_back(static_cast<char>(0x80 | opcode));
+  const uint64_t size = payload.size();
+  int bytes = 0;
+  if (size < 126) {
+    frame.push_back(static_cast<char>(size));
+  } else if (size <= 0xffff) {
+    frame.push_back(126);
+    bytes = 2;
+  } else {
+    frame.push_back(127);
+    bytes = 8;
+  }
+  for (int i = bytes - 1; i >= 0; --i)
+    frame.push_back(static_cast<char>(size >> (8 * i)));
+  frame.append(payload);
+  return frame;
+}
+
+// One event with the sequence as id, a data line per line of the document
+std::string eventFrame(uint64_t seq, std::string_view body) {
+  std::string frame = std::format("id: {}\n", seq);
+  while (true) {
+    const auto eol = body.find('\n');
+    frame += "data: ";
+    frame += body.substr(0, eol);
+    frame += '\n';
+    if (eol == std::string_view::npos)
+      break;
+    body.remove_prefix(eol + 1);
+  }
+  frame += '\n';
+  return frame;
+}
+
+constexpr uint8_t WS_TEXT = 0x1;
+constexpr uint8_t WS_CLOSE = 0x8;
+constexpr uint8_t WS_PING = 0x9;
+constexpr uint8_t WS_PONG = 0xa;
+
+const std::shared_ptr<const std::string> EVENT_HEARTBEAT =
+    std::make_shared<const std::string>(":\n\n");
+const std::shared_ptr<const std::string> WS_HEARTBEAT =
+    std::make_shared<const std::string>(webSocketFrame(WS_PING, ""));
+
+} // namespace
+
+HttpServer::HttpServer(const HttpConfig &cfg, SignalHandler &signalHandler)
+    : cfg_(cfg), handler_(signalHandler) {
+
+  httpLogger_ = spdlog::get("http");
+  if (!httpLogger_)
+    httpLogger_ = spdlog::default_logger();
+
+  etagPrefix_ = std::format(
+      "{:x}", std::chrono::duration_cast<std::chrono::seconds>(
+                  std::chrono::system_clock::now().time_since_epoch())
+                  .count());
+
+  auto listenAction = startListener();
+  if (!listenAction) {
+    for (int fd : {listenFd_, epollFd_, wakeFd_}) {
+      if (fd != -1)
+        close(fd);
+    }
+    throw std::runtime_error(listenAction.error().describe());
+  }
+
+  worker_ = std::thread(&HttpServer::run, this);
+}
+
+HttpServer::~HttpServer() {
+  if (worker_.joinable())
+    worker_.join();
+
+  for (auto &[fd, conn] : connections_)
+    close(fd);
+  close(listenFd_);
+  close(epollFd_);
+  close(wakeFd_);
+  httpLogger_->info("Stopped HTTP server");
+}
+
+std::expected<void, ModbusError> HttpServer::startListener(void) {
+  const std::string endpoint = cfg_.listen + ":" + std::to_string(cfg_.port);
+
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_PASSIVE;
+  addrinfo *res = nullptr;
+  int rc = getaddrinfo(cfg_.listen.c_str(), std::to_string(cfg_.port).c_str(),
+                       &hints, &res);
+  if (rc != 0) {
+    return std::unexpected(ModbusError::custom(
+        EINVAL, "Unable to resolve HTTP listen address '{}': {}", cfg_.listen,
+        gai_strerror(rc)));
+  }
+
+  listenFd_ =
+      socket(res->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  const int one = 1;
+  if (listenFd_ == -1 ||
+      setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ==
+          -1 ||
+      bind(listenFd_, res->ai_addr, res->ai_addrlen) == -1 ||
+      listen(listenFd_, SOMAXCONN) == -1) {
+    freeaddrinfo(res);
+    return std::unexpected(ModbusError::fromErrno(
+        "Failed to start HTTP server on '{}'", endpoint));
+  }
+  freeaddrinfo(res);
+
+  epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+  wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (epollFd_ == -1 || wakeFd_ == -1) {
+    return std::unexpected(
+        ModbusError::fromErrno("Failed to create HTTP event loop"));
+  }
+
+  for (int fd : {listenFd_, wakeFd_, handler_.shutdownFd()}) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) == -1) {
+      return std::unexpected(
+          ModbusError::fromErrno("Failed to create HTTP event loop"));
+    }
+  }
+
+  httpLogger_->info("Started HTTP server on '{}'", endpoint);
+  return {};
+}
+
+std::vector<std::thread::native_handle_type> HttpServer::threads(void) {
+  if (worker_.joinable())
+    return {worker_.native_handle()};
+  return {};
+}
+
+void HttpServer::publish(const std::string &path, std::string json) {
+  auto body = std::make_shared<const std::string>(std::move(json));
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Document &doc = documents_[path];
+    doc.body = std::move(body);
+    ++doc.seq;
+    if (std::find(changed_.begin(), changed_.end(), path) != changed_.end())
+      return; // wake already pending
+    changed_.push_back(path);
+  }
+
+  const uint64_t one = 1;
+  if (write(wakeFd_, &one, sizeof(one)) == -1)
+    httpLogger_->warn("publish(): Unable to wake HTTP server");
+}
+
+void HttpServer::run(void) {
+  std::array<epoll_event, 64> events;
+
+  while (handler_.isRunning()) {
+    // Sleep until the next long-poll or idle timeout, if any
+    int timeout = -1;
+    if (!deadlines_.empty()) {
+      const auto ms = std::chrono::ceil<std::chrono::milliseconds>(
+                          deadlines_.begin()->first - Clock::now())
+                          .count();
+      timeout = static_cast<int>(std::clamp<int64_t>(ms, 0, INT32_MAX));
+    }
+
+    int count = epoll_wait(epollFd_, events.data(),
+                           static_cast<int>(events.size()), timeout);
+    if (count == -1) {
+      if (errno == EINTR)
+        continue;
+      httpLogger_->error("run(): epoll_wait failed: {}", strerror(errno));
+      handler_.shutdown();
+      break;
+    }
+
+    for (int i = 0; i < count; ++i) {
+      const int fd = events[i].data.fd;
+      if (fd == handler_.shutdownFd()) {
+        return;
+      } else if (fd == wakeFd_) {
+        uint64_t value;
+        if (read(wakeFd_, &value, sizeof(value)) == -1 && errno != EAGAIN)
+          httpLogger_->warn("run(): Unable to read wake event");
+        onPublished();
+      } else if (fd == listenFd_) {
+        acceptClients();
+      } else {
+        onClient(fd, events[i].events);
+      }
+    }
+
+    expire(Clock::now());
+    reap();
+  }
+}
+
+void HttpServer::acceptClients(void) {
+  while (true) {
+    int fd = accept4(listenFd_, nullptr, nullptr,
+                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd == -1) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      if (errno == EMFILE || errno == ENFILE) {
+        // Out of descriptors: stop accepting until a client is gone
+        httpLogger_->warn("acceptClients(): {}, pausing", strerror(errno));
+        epoll_ctl(epollFd_, EPOLL_CTL_DEL, listenFd_, nullptr);
+        listenPaused_ = true;
+      } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        httpLogger_->warn("acceptClients(): accept failed: {}",
+                          strerror(errno));
+      }
+      return;
+    }
+
+    if (connections_.size() >= static_cast<size_t>(cfg_.maxClients)) {
+      close(fd);
+      continue;
+    }
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev) == -1) {
+      close(fd);
+      continue;
+    }
+    Connection &conn = connections_[fd];
+    conn.fd = fd;
+    setDeadline(conn, Clock::now() + IDLE_TIMEOUT);
+  }
+}
+
+void HttpServer::onClient(int fd, uint32_t events) {
+  auto it = connections_.find(fd);
+  if (it == connections_.end() || it->second.closing)
+    return;
+  Connection &conn = it->second;
+
+  if (events & EPOLLERR) {
+    closeClient(conn);
+    return;
+  }
+  if (events & EPOLLOUT)
+    flush(conn);
+  if ((events & (EPOLLIN | EPOLLHUP)) && !conn.closing)
+    readRequest(conn);
+}
+
+void HttpServer::readRequest(Connection &conn) {
+  std::array<char, 4096> buffer;
+
+  while (true) {
+    ssize_t n = read(conn.fd, buffer.data(), buffer.size());
+    if (n > 0) {
+      if (conn.mode == Mode::SSE)
+        continue; // nothing expected from an event stream
+      if (conn.request.size() + n > MAX_REQUEST) {
+        conn.request.clear();
+        conn.keepAlive = false;
+        if (conn.mode == Mode::REQUEST && conn.out.empty() &&
+            conn.waitPath.empty())
+          respond(conn, 431, errorBody(431), 0, false);
+        else
+          closeClient(conn);
+        return;
+      }
+      conn.request.append(buffer.data(), n);
+      continue;
+    }
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+      break;
+    // Closed by the client (n == 0) or reset, a waiting client gave up
+    closeClient(conn);
+    return;
+  }
+
+  // Pipelined requests wait until the current response is out
+  if (conn.mode == Mode::WEBSOCKET)
+    readFrames(conn);
+  else if (conn.mode == Mode::REQUEST && conn.out.empty() &&
+           conn.waitPath.empty())
+    handleRequest(conn);
+}
+
+void HttpServer::handleRequest(Connection &conn) {
+  const auto end = conn.request.find("\r\n\r\n");
+  if (end == std::string::npos)
+    return;
+
+  const std::string request = conn.request.substr(0, end);
+  conn.request.erase(0, end + 4);
+
+  // Request line: method, target and version
+  std::string_view lines(request);
+  const std::string_view line = lines.substr(0, lines.find("\r\n"));
+  const auto sp1 = line.find(' ');
+  const auto sp2 = line.rfind(' ');
+  if (sp1 == std::string_view::npos || sp2 <= sp1) {
+    conn.keepAlive = false;
+    respond(conn, 400, errorBody(400), 0, false);
+    return;
+  }
+  const std::string_view method = line.substr(0, sp1);
+  const std::string_view target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+  const std::string_view version = line.substr(sp2 + 1);
+
+  // Headers of interest, HTTP/1.0 closes unless asked to keep alive
+  conn.keepAlive = version == "HTTP/1.1";
+  std::string_view ifNoneMatch;
+  std::string_view webSocketKey;
+  std::string_view webSocketVersion;
+  bool webSocket = false;
+  bool eventStream = false;
+  size_t pos = line.size() + 2;
+  while (pos < lines.size()) {
+    auto eol = lines.find("\r\n", pos);
+    if (eol == std::string_view::npos)
+      eol = lines.size();
+    const std::string_view header = lines.substr(pos, eol - pos);
+    pos = eol + 2;
+
+    const auto colon = header.find(':');
+    if (colon == std::string_view::npos)
+      continue;
+    const std::string_view name = header.substr(0, colon);
+    std::string_view value = header.substr(colon + 1);
+    while (!value.empty() && value.front() == ' ')
+      value.remove_prefix(1);
+
+    if (equalsIgnoreCase(name, "Connection")) {
+      if (equalsIgnoreCase(value, "close"))
+        conn.keepAlive = false;
+      else if (equalsIgnoreCase(value, "keep-alive"))
+        conn.keepAlive = true;
+    } else if (equalsIgnoreCase(name, "If-None-Match")) {
+      ifNoneMatch = value;
+    } else if (equalsIgnoreCase(name, "Accept")) {
+      eventStream = value.find("text/event-stream") != std::string_view::npos;
+    } else if (equalsIgnoreCase(name, "Upgrade")) {
+      webSocket = equalsIgnoreCase(value, "websocket");
+    } else if (equalsIgnoreCase(name, "Sec-WebSocket-Key")) {
+      webSocketKey = value;
+    } else if (equalsIgnoreCase(name, "Sec-WebSocket-Version")) {
+      webSocketVersion = value;
+    }
+  }
+
+  const bool headOnly = method == "HEAD";
+  if (method != "GET" && !headOnly) {
+    conn.keepAlive = false;
+    respond(conn, 405, errorBody(405), 0, false);
+    return;
+  }
+
+  const auto question = target.find('?');
+  const std::string path(target.substr(0, question));
+  const std::string_view query =
+      question == std::string_view::npos ? "" : target.substr(question + 1);
+  const std::optional<uint64_t> after = numberParam(query, "after=");
+
+  // Streams start on any path, a document published later is sent then
+  if (webSocket && !headOnly) {
+    if (webSocketKey.empty() || webSocketVersion != "13") {
+      conn.keepAlive = false;
+      respond(conn, 400, errorBody(400), 0, false);
+      return;
+    }
+    subscribe(conn, Mode::WEBSOCKET, path,
+              std::format("HTTP/1.1 101 Switching Protocols\r\n"
+                          "Upgrade: websocket\r\n"
+                          "Connection: Upgrade\r\n"
+                          "Sec-WebSocket-Accept: {}\r\n\r\n",
+                          acceptKey(webSocketKey)),
+              std::chrono::milliseconds(
+                  numberParam(query, "interval=").value_or(0)));
+    return;
+  }
+  if (eventStream && !headOnly) {
+    subscribe(conn, Mode::SSE, path,
+              "HTTP/1.1 200 OK\r\n"
+              "Content-Type: text/event-stream\r\n"
+              "Cache-Control: no-cache\r\n"
+              "Access-Control-Allow-Origin: *\r\n"
+              "X-Accel-Buffering: no\r\n\r\n",
+              std::chrono::milliseconds(
+                  numberParam(query, "interval=").value_or(0)));
+    return;
+  }
+
+  Document doc;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = documents_.find(path);
+    if (it != documents_.end())
+      doc = it->second;
+  }
+  if (!doc.body) {
+    respond(conn, 404, errorBody(404), 0, headOnly);
+    return;
+  }
+
+  // Long-poll: wait until the document moves past the known sequence
+  if (after && *after == doc.seq) {
+    conn.waitPath = path;
+    conn.after = *after;
+    conn.headOnly = headOnly;
+    waiting_.emplace(path, conn.fd);
+    setDeadline(conn, Clock::now() + std::chrono::seconds(cfg_.longPoll));
+    return;
+  }
+
+  const std::string etag = std::format("\"{}-{}\"", etagPrefix_, doc.seq);
+  if (!after && (ifNoneMatch == etag || ifNoneMatch == "*")) {
+    respond(conn, 304, nullptr, doc.seq, headOnly);
+    return;
+  }
+  respond(conn, 200, std::move(doc.body), doc.seq, headOnly);
+}
+
+void HttpServer::respond(Connection &conn, int status, Frame body,
+                         uint64_t seq, bool headOnly) {
+  std::string head =
+      std::format("HTTP/1.1 {} {}\r\n", status, reason(status));
+  if (seq) {
+    head += std::format("ETag: \"{}-{}\"\r\nX-Sequence: {}\r\n",
+                        etagPrefix_, seq, seq);
+  }
+  if (status != 304) {
+    head += std::format(
+        "Content-Type: application/json\r\nContent-Length: {}\r\n",
+        body ? body->size() : 0);
+  }
+  head += "Cache-Control: no-cache\r\n"
+          "Access-Control-Allow-Origin: *\r\n"
+          "Access-Control-Expose-Headers: ETag, X-Sequence\r\n";
+  if (!conn.keepAlive)
+    head += "Connection: close\r\n";
+  head += "\r\n";
+
+  conn.out.push_back(std::make_shared<const std::string>(std::move(head)));
+  if (body && !headOnly && status != 304)
+    conn.out.push_back(std::move(body));
+  conn.sent = 0;
+  setDeadline(conn, Clock::now() + IDLE_TIMEOUT);
+  flush(conn);
+}
+
+void HttpServer::subscribe(Connection &conn, Mode mode,
+                           const std::string &path, std::string head,
+                           std::chrono::milliseconds interval) {
+  conn.mode = mode;
+  conn.keepAlive = true;
+  conn.streamPath = path;
+  conn.interval = interval;
+  if (mode == Mode::SSE)
+    conn.request.clear();
+  streams_.emplace(path, conn.fd);
+  httpLogger_->debug("Client {} streams '{}' ({}, interval {} ms)", conn.fd,
+                     path, mode == Mode::SSE ? "events" : "WebSocket",
+                     interval.count());
+
+  enqueue(conn, std::make_shared<const std::string>(std::move(head)));
+  if (conn.closing)
+    return;
+  setDeadline(conn, Clock::now() + HEARTBEAT);
+
+  // The current document right away, a display has something to show
+  if (Frame frame = encode(path, mode))
+    deliver(conn, std::move(frame));
+  if (mode == Mode::WEBSOCKET)
+    readFrames(conn); // sent along with the handshake
+}
+
+void HttpServer::readFrames(Connection &conn) {
+  // Client frames are masked; only close and ping matter to a stream
+  while (!conn.closing && conn.keepAlive) {
+    const auto *data =
+        reinterpret_cast<const unsigned char *>(conn.request.data());
+    const size_t size = conn.request.size();
+    if (size < 2)
+      return;
+
+    const uint8_t opcode = data[0] & 0x0f;
+    uint64_t length = data[1] & 0x7f;
+    size_t offset = 2;
+    if (length >= 126) {
+      const size_t bytes = length == 126 ? 2 : 8;
+      if (size < offset + bytes)
+        return;
+      length = 0;
+      for (size_t i = 0; i < bytes; ++i)
+        length = length << 8 | data[offset + i];
+      offset += bytes;
+    }
+    if (!(data[1] & 0x80) || length > MAX_REQUEST) {
+      closeClient(conn);
+      return;
+    }
+    if (size < offset + 4 + length)
+      return;
+
+    std::string payload = conn.request.substr(offset + 4, length);
+    for (size_t i = 0; i < payload.size(); ++i)
+      payload[i] = static_cast<char>(payload[i] ^ data[offset + i % 4]);
+    conn.request.erase(0, offset + 4 + length);
+
+    if (opcode == WS_CLOSE) {
+      // Echo the status code, the connection closes once it is out
+      conn.keepAlive = false;
+      enqueue(conn, std::make_shared<const std::string>(webSocketFrame(
+                        WS_CLOSE, std::string_view(payload).substr(0, 2))));
+    } else if (opcode == WS_PING && payload.size() <= 125) {
+      enqueue(conn, std::make_shared<const std::string>(
+                        webSocketFrame(WS_PONG, payload)));
+    }
+  }
+}
+
+HttpServer::Frame HttpServer::encode(const std::string &path, Mode mode) {
+  Document doc;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = documents_.find(path);
+    if (it != documents_.end())
+      doc = it->second;
+  }
+  if (!doc.body)
+    return nullptr;
+
+  // Once per update and protocol, whatever the number of subscribers
+  Encoded &encoded = encoded_[path];
+  if (encoded.seq != doc.seq)
+    encoded = {doc.seq, nullptr, nullptr};
+  if (mode == Mode::SSE) {
+    if (!encoded.sse) {
+      encoded.sse = std::make_shared<const std::string>(
+          eventFrame(doc.seq, *doc.body));
+    }
+    return encoded.sse;
+  }
+  if (!encoded.websocket) {
+    encoded.websocket = std::make_shared<const std::string>(
+        webSocketFrame(WS_TEXT, *doc.body));
+  }
+  return encoded.websocket;
+}
+
+void HttpServer::deliver(Connection &conn, Frame frame) {
+  if (!conn.keepAlive)
+    return; // closing WebSocket
+
+  // Throttled: only the latest update goes out when the interval is over
+  const auto now = Clock::now();
+  if (now < conn.nextSend) {
+    conn.pending = std::move(frame);
+    setDeadline(conn, conn.nextSend);
+    return;
+  }
+  conn.pending.reset();
+  conn.nextSend = now + conn.interval;
+  enqueue(conn, std::move(frame));
+  if (!conn.closing)
+    setDeadline(conn, now + HEARTBEAT);
+}
+
+void HttpServer::enqueue(Connection &conn, Frame frame) {
+  if (conn.closing)
+    return;
+  if (conn.out.size() >= static_cast<size_t>(cfg_.streamQueue)) {
+    dropLog_.log(*httpLogger_, spdlog::level::warn,
+                 "Dropped client {} of stream '{}': {} frames not sent",
+                 conn.fd, conn.streamPath, conn.out.size());
+    closeClient(conn);
+    return;
+  }
+
+  conn.out.push_back(std::move(frame));
+  if (conn.out.size() == 1)
+    flush(conn); // otherwise waiting for EPOLLOUT
+}
+
+void HttpServer::flush(Connection &conn) {
+  // Queued frames in one call, shared documents and frames are never copied
+  while (!conn.out.empty()) {
+    std::array<iovec, MAX_IOV> iov{};
+    size_t parts = 0;
+    for (const Frame &frame : conn.out) {
+      if (parts == iov.size())
+        break;
+      const size_t offset = parts == 0 ? conn.sent : 0;
+      iov[parts++] = {const_cast<char *>(frame->data()) + offset,
+                      frame->size() - offset};
+    }
+    msghdr msg{};
+    msg.msg_iov = iov.data();
+    msg.msg_iovlen = parts;
+
+    ssize_t n = sendmsg(conn.fd, &msg, MSG_NOSIGNAL);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      watch(conn, EPOLLIN | EPOLLOUT);
+      return;
+    }
+    if (n == -1) {
+      closeClient(conn);
+      return;
+    }
+
+    size_t written = conn.sent + static_cast<size_t>(n);
+    while (!conn.out.empty() && written >= conn.out.front()->size()) {
+      written -= conn.out.front()->size();
+      conn.out.pop_front();
+    }
+    conn.sent = written;
+  }
+
+  conn.sent = 0;
+  watch(conn, EPOLLIN);
+
+  if (conn.mode != Mode::REQUEST) {
+    if (!conn.keepAlive)
+      closeClient(conn); // WebSocket close sent
+    return;
+  }
+  if (!conn.keepAlive) {
+    closeClient(conn);
+    return;
+  }
+  setDeadline(conn, Clock::now() + IDLE_TIMEOUT);
+  handleRequest(conn); // next pipelined request, if complete
+}
+
+void HttpServer::watch(Connection &conn, uint32_t events) {
+  if (conn.events == events)
+    return;
+  epoll_event ev{};
+  ev.events = events;
+  ev.data.fd = conn.fd;
+  epoll_ctl(epollFd_, EPOLL_CTL_MOD, conn.fd, &ev);
+  conn.events = events;
+}
+
+void HttpServer::onPublished(void) {
+  std::vector<std::string> changed;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    changed.swap(changed_);
+  }
+
+  for (const auto &path : changed) {
+    // Streams: a subscriber closed meanwhile leaves the list
+    std::vector<int> subscribers;
+    auto [begin, end] = streams_.equal_range(path);
+    for (auto it = begin; it != end; ++it)
+      subscribers.push_back(it->second);
+    for (int fd : subscribers) {
+      Connection &conn = connections_.at(fd);
+      if (Frame frame = encode(path, conn.mode))
+        deliver(conn, std::move(frame));
+    }
+
+    auto [first, last] = waiting_.equal_range(path);
+    if (first == last)
+      continue;
+
+    Document doc;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      doc = documents_[path];
+    }
+
+    std::vector<int> ready;
+    for (auto it = first; it != last; ++it)
+      ready.push_back(it->second);
+    waiting_.erase(first, last);
+
+    for (int fd : ready) {
+      Connection &conn = connections_.at(fd);
+      conn.waitPath.clear();
+      respond(conn, 200, doc.body, doc.seq, conn.headOnly);
+    }
+  }
+}
+
+void HttpServer::setDeadline(Connection &conn, Clock::time_point deadline) {
+  deadlines_.erase({conn.deadline, conn.fd});
+  conn.deadline = deadline;
+  deadlines_.insert({deadline, conn.fd});
+}
+
+void HttpServer::expire(Clock::time_point now) {
+  while (!deadlines_.empty() && deadlines_.begin()->first <= now) {
+    const int fd = deadlines_.begin()->second;
+    deadlines_.erase(deadlines_.begin());
+    Connection &conn = connections_.at(fd);
+    conn.deadline = {};
+
+    if (conn.mode != Mode::REQUEST) {
+      onStreamTimer(conn, now);
+      continue;
+    }
+    if (conn.waitPath.empty()) {
+      closeClient(conn); // idle or not reading its response
+      continue;
+    }
+
+    // Long-poll timeout: nothing new, the client asks again
+    unlist(waiting_, conn.waitPath, fd);
+    conn.waitPath.clear();
+    respond(conn, 304, nullptr, conn.after, conn.headOnly);
+  }
+}
+
+void HttpServer::onStreamTimer(Connection &conn, Clock::time_point now) {
+  if (conn.pending) {
+    deliver(conn, std::move(conn.pending));
+    return;
+  }
+
+  // Nothing to send for a while: a heartbeat keeps proxies from closing
+  // the stream and finds clients that are gone
+  enqueue(conn, conn.mode == Mode::SSE ? EVENT_HEARTBEAT : WS_HEARTBEAT);
+  if (!conn.closing)
+    setDeadline(conn, now + HEARTBEAT);
+}
+
+void HttpServer::closeClient(Connection &conn) {
+  if (conn.closing)
+    return;
+  conn.closing = true;
+  deadlines_.erase({conn.deadline, conn.fd});
+
+  if (!conn.waitPath.empty())
+    unlist(waiting_, conn.waitPath, conn.fd);
+  if (conn.mode != Mode::REQUEST)
+    unlist(streams_, conn.streamPath, conn.fd);
+  closing_.push_back(conn.fd);
+}
+
+void HttpServer::reap(void) {
+  // Descriptors are closed after the batch of events, so none of them can
+  // be reused by accept() while an event for the old client is pending
+  for (int fd : closing_) {
+    close(fd);
+    connections_.erase(fd);
+  }
+  if (!closing_.empty() && listenPaused_) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.fd = listenFd_;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &ev) == 0)
+      listenPaused_ = false;
+  }
+  closing_.clear();
+}
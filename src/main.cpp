@@ -1,20 +1,218 @@
 #include "config.h"
 #include "config_yaml.h"
+#include "flight_recorder.h"
+#include "http_server.h"
 #include "logger.h"
 #include "meter_master.h"
+#include "meter_reactor.h"
 #include "meter_slave.h"
 #include "meter_types.h"
+#include "modbus_error.h"
 #include "mqtt_client.h"
 #include "privileges.h"
+#include "resource_monitor.h"
+#include "scheduling.h"
 #include "signal_handler.h"
+#include "sink.h"
+#include "sink_registry.h"
+#include "sinks.h"
+#include "snapshot.h"
 #include <CLI/CLI.hpp>
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
+#include <expected>
+#include <format>
 #include <iostream>
 #include <memory>
 #include <nlohmann/json.hpp>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
 
 using json = nlohmann::json;
 
+namespace {
+
+// Seconds the teardown may take before the process is killed by SIGALRM
+constexpr unsigned SHUTDOWN_TIMEOUT = 5;
+
+// Reports a setting that only takes effect after a restart, once per change:
+// against the last loaded config, and back at the running one if reverted
+template <typename T>
+void reportRestart(const T &running, const T &previous, const T &next,
+                   std::string_view what,
+                   const std::shared_ptr<spdlog::logger> &logger) {
+  if (next == previous)
+    return;
+  if (next == running)
+    logger->info("{} back to the running settings", what);
+  else
+    logger->warn("{} changed, restart to apply", what);
+}
+
+// Applies the settings that can change at runtime and reports the ones that
+// only take effect after a restart. running is the config the gateway was
+// started with, previous the one loaded last; meters are matched by name.
+void reloadConfig(const AppConfig &running, const AppConfig &previous,
+                  const AppConfig &next,
+                  const std::vector<std::unique_ptr<MeterMaster>> &masters,
+                  TopicRoot &topicRoot,
+                  const std::shared_ptr<spdlog::logger> &logger) {
+  reloadLogging(next.logger);
+
+  if (*topicRoot.load() != next.mqtt.topic) {
+    topicRoot.store(std::make_shared<const std::string>(next.mqtt.topic));
+    logger->info("MQTT topic changed to '{}'", next.mqtt.topic);
+  }
+  const auto broker = [](const AppConfig &c) {
+    return std::tie(c.mqtt.broker, c.mqtt.port, c.mqtt.user, c.mqtt.password);
+  };
+  reportRestart(broker(running), broker(previous), broker(next),
+                "MQTT broker settings", logger);
+
+  const auto label = [](const std::string &name) {
+    return name.empty() ? std::string("Meter") : "Meter '" + name + "'";
+  };
+  const auto find = [](const AppConfig &c, const std::string &name) {
+    const auto &list = c.meter.masters;
+    auto it = std::find_if(list.begin(), list.end(), [&name](const auto &m) {
+      return m.name == name;
+    });
+    return it == list.end() ? nullptr : &*it;
+  };
+
+  for (size_t i = 0; i < masters.size(); ++i) {
+    const MeterMasterConfig &cur = running.meter.masters[i];
+    const MeterMasterConfig *was = find(previous, cur.name);
+    const MeterMasterConfig *now = find(next, cur.name);
+    if (!now) {
+      if (was)
+        logger->warn("{} removed from the config, restart to apply",
+                     label(cur.name));
+      continue;
+    }
+    const auto transport = [](const MeterMasterConfig &m) {
+      return std::tie(m.protocol, m.tcp, m.rtu);
+    };
+    reportRestart(transport(cur), transport(was ? *was : cur),
+                  transport(*now), label(cur.name) + ": transport", logger);
+
+    masters[i]->setGrid(now->grid);
+
+    // Keys can be replaced at runtime, decryption itself switched on or off
+    // only with a restart; until then the last keys stay in use
+    if (now->decryption && cur.decryption)
+      masters[i]->setDecryptionKeys(*now->decryption);
+    reportRestart(cur.decryption.has_value(),
+                  (was ? *was : cur).decryption.has_value(),
+                  now->decryption.has_value(),
+                  label(cur.name) + ": decryption", logger);
+  }
+  for (const auto &masterCfg : next.meter.masters) {
+    if (!find(previous, masterCfg.name) && !find(running, masterCfg.name))
+      logger->warn("{} added to the config, restart to apply",
+                   label(masterCfg.name));
+  }
+
+  const auto slave = [](const AppConfig &c) {
+    using Key = std::tuple<std::optional<ModbusTcpServerConfig>,
+                           std::optional<ModbusRtuConfig>, int>;
+    return c.meter.slave ? std::optional<Key>(Key(c.meter.slave->tcp,
+                                                  c.meter.slave->rtu,
+                                                  c.meter.slave->slaveId))
+                         : std::nullopt;
+  };
+  reportRestart(slave(running), slave(previous), slave(next),
+                "Meter slave settings", logger);
+  reportRestart(running.http, previous.http, next.http, "HTTP API settings",
+                logger);
+  reportRestart(running.recorder, previous.recorder, next.recorder,
+                "Flight recorder settings", logger);
+  reportRestart(running.sinks, previous.sinks, next.sinks, "Sink settings",
+                logger);
+}
+
+// Writes the events of the flight recorder to its trace file
+void dumpRecorder(const std::optional<RecorderConfig> &cfg,
+                  const std::shared_ptr<spdlog::logger> &logger) {
+  if (!cfg) {
+    logger->warn("SIGUSR2 ignored, no flight recorder configured");
+    return;
+  }
+  auto result = FlightRecorder::dump();
+  if (!result)
+    logger->warn("Unable to dump flight recorder: {}",
+                 result.error().describe());
+  else
+    logger->info("Flight recorder dumped to '{}'", cfg->path);
+}
+
+// Names the threads of each role, applies the scheduling options (after the
+// privilege drop) and reports the settings in effect
+void tuneThreads(const std::optional<SchedulingConfig> &cfg,
+                 MeterReactor &reactor, MeterReactor &housekeeping,
+                 const std::vector<std::unique_ptr<MeterMaster>> &masters,
+                 MeterSlave *slave, MqttClient &mqtt, HttpServer *http,
+                 SinkRegistry &sinks,
+                 const std::shared_ptr<spdlog::logger> &logger) {
+  struct Thread {
+    std::string name;
+    pthread_t handle;
+    const ThreadTuningConfig &tuning;
+  };
+
+  const SchedulingConfig sched = cfg.value_or(SchedulingConfig{});
+  std::vector<Thread> threads;
+  int loop = 0;
+  for (auto handle : reactor.threads())
+    threads.push_back({std::format("meter-loop-{}", loop++), handle,
+                       sched.meter});
+  int bus = 0;
+  for (const auto &master : masters) {
+    for (auto handle : master->threads())
+      threads.push_back({std::format("meter-bus-{}", bus++), handle,
+                         sched.meter});
+  }
+  if (slave) {
+    for (auto handle : slave->threads())
+      threads.push_back({"modbus-slave", handle, sched.slave});
+  }
+  for (auto handle : mqtt.threads())
+    threads.push_back({"mqtt-publish", handle, sched.mqtt});
+  if (http) {
+    for (auto handle : http->threads())
+      threads.push_back({"http-server", handle, sched.mqtt});
+  }
+  for (const auto &[name, handle] : sinks.threads())
+    threads.push_back({"sink-" + name, handle, sched.mqtt});
+  for (auto handle : housekeeping.threads())
+    threads.push_back({"housekeeping", handle, sched.mqtt});
+
+  for (const auto &thread : threads) {
+    Scheduling::setName(thread.handle, thread.name);
+    auto result = Scheduling::apply(thread.handle, thread.tuning);
+    if (!result)
+      logger->warn("Thread '{}': {}", thread.name, result.error().describe());
+    if (cfg)
+      logger->info("Thread '{}': {}", thread.name,
+                   Scheduling::describe(thread.handle));
+  }
+
+  if (cfg && cfg->lockMemory) {
+    auto result = Scheduling::lockMemory();
+    if (!result)
+      logger->warn("{}", result.error().describe());
+    else
+      logger->info("Memory locked, {} KiB resident ({} KiB per thread stack)",
+                   Scheduling::lockedKiB(), Scheduling::THREAD_STACK / 1024);
+  }
+}
+
+} // namespace
+
 int main(int argc, char *argv[]) {
 
   // --- Command line parsing ---
@@ -56,12 +254,26 @@ int main(int argc, char *argv[]) {
     return EXIT_FAILURE;
   }
 
+  // --- Setup signals and shutdown, before the first thread is started
+  SignalHandler handler;
+
+  // --- Small thread stacks when they are all to be locked in memory
+  std::expected<void, ModbusError> stacks;
+  if (cfg.scheduling && cfg.scheduling->lockMemory)
+    stacks = Scheduling::setupStacks();
+
   // --- Setup logging ---
   setupLogging(cfg.logger);
   std::shared_ptr<spdlog::logger> mainLogger = spdlog::get("main");
   if (!mainLogger)
     mainLogger = spdlog::default_logger();
   mainLogger->info("Starting {} with config '{}'", PROJECT_NAME, config);
+  if (!stacks)
+    mainLogger->warn("{}", stacks.error().describe());
+
+  // --- Record hot path events of all threads started from here on
+  if (cfg.recorder)
+    FlightRecorder::enable(*cfg.recorder);
 
   // Warn if --user/--group specified but not running as root
   if (!Privileges::isRoot() && !runUser.empty()) {
@@ -76,13 +288,18 @@ int main(int argc, char *argv[]) {
                      "consider using --user/--group options");
   }
 
-  // --- Setup signals and shutdown
-  SignalHandler handler;
+  TopicRoot topicRoot{std::make_shared<const std::string>(cfg.mqtt.topic)};
 
   // All objects are declared here so their lifetimes are identical
   std::unique_ptr<MeterSlave> slave;
   std::unique_ptr<MqttClient> mqtt;
-  std::unique_ptr<MeterMaster> master;
+  std::unique_ptr<HttpServer> http;
+  std::unique_ptr<Snapshot> snapshot;
+  std::unique_ptr<SinkRegistry> sinks; // outlives everything dispatching
+  std::vector<std::unique_ptr<MeterMaster>> masters;
+  std::unique_ptr<ResourceMonitor> monitor;
+  std::unique_ptr<MeterReactor> reactor; // stopped before the masters go
+  std::unique_ptr<MeterReactor> housekeeping; // snapshot and stats timers
 
   try {
     // --- Start meter slave ---
@@ -92,6 +309,10 @@ int main(int argc, char *argv[]) {
       mainLogger->info("Meter slave disabled");
     }
 
+    // --- Start HTTP API, also before the privileges are dropped
+    if (cfg.http)
+      http = std::make_unique<HttpServer>(*cfg.http, handler);
+
     // --- Drop privileges after binding to privileged ports ---
     if (!runUser.empty() && Privileges::isRoot()) {
       Privileges::drop(runUser, runGroup);
@@ -103,40 +324,193 @@ int main(int argc, char *argv[]) {
     // --- Start MQTT client ---
     mqtt = std::make_unique<MqttClient>(cfg.mqtt, handler);
 
-    // --- Start meter master
-    master = std::make_unique<MeterMaster>(cfg.meter.master, handler);
-
-    // --- Setup callbacks
-    master->setUpdateCallback(
-        [&cfg, &mqtt, &slave](std::string jsonDump, MeterTypes::Values values) {
-          mqtt->publish(std::move(jsonDump), cfg.mqtt.topic + "/values");
-          if (slave) {
-            slave->updateValues(std::move(values));
-          }
-        });
-    master->setDeviceCallback(
-        [&cfg, &mqtt, &slave](std::string jsonDump, MeterTypes::Device device) {
-          mqtt->publish(std::move(jsonDump), cfg.mqtt.topic + "/device");
-          if (slave) {
-            slave->updateDevice(std::move(device));
-          }
-        });
-    master->setAvailabilityCallback([&mqtt, &cfg](std::string availability) {
-      mqtt->publish(std::move(availability), cfg.mqtt.topic + "/availability");
-    });
+    // --- Start meter masters, telegram sources share a few event loops
+    reactor = std::make_unique<MeterReactor>(cfg.meter.threads, handler);
+
+    // --- Periodic file I/O and /proc sampling get a loop of their own; an
+    // fsync on an SD card or mallinfo2() must not delay reading the meters
+    housekeeping = std::make_unique<MeterReactor>(1, handler);
+
+    // --- Warm start: last good readings until the meters answer
+    if (cfg.snapshot) {
+      snapshot = std::make_unique<Snapshot>(*cfg.snapshot);
+      auto data = snapshot->load();
+      if (data) {
+        for (const auto &[topic, payloads] : data->topics) {
+          if (!payloads.values.empty())
+            mqtt->publish(payloads.values, topic + "/values");
+          if (!payloads.device.empty())
+            mqtt->publish(payloads.device, topic + "/device");
+          mqtt->publish("stale", topic + "/availability");
+
+          // Topics below the root are served by the HTTP API
+          if (!http || !topic.starts_with(cfg.mqtt.topic))
+            continue;
+          const std::string path = topic.substr(cfg.mqtt.topic.size());
+          if (!payloads.values.empty())
+            http->publish(path + "/values", payloads.values);
+          if (!payloads.device.empty())
+            http->publish(path + "/device", payloads.device);
+        }
+        if (slave && !data->registers.empty()) {
+          auto result = slave->restoreRegisters(data->registers);
+          if (!result)
+            mainLogger->warn("Snapshot not served by the meter slave: {}",
+                             result.error().describe());
+        }
+        mainLogger->info("Warm start from snapshot '{}' ({} topic(s))",
+                         cfg.snapshot->path, data->topics.size());
+        snapshot->restore(std::move(*data));
+      } else {
+        mainLogger->info("Cold start: {}", data.error().describe());
+      }
+      housekeeping->add(*snapshot);
+    }
+
+    // --- Outputs: the built-in ones and those of the sinks section
+    sinks = std::make_unique<SinkRegistry>();
+    sinks->add("mqtt", std::make_unique<MqttSink>(*mqtt, topicRoot));
+    if (http)
+      sinks->add("http", std::make_unique<HttpSink>(*http));
+    if (slave)
+      sinks->add("slave", std::make_unique<SlaveSink>(*slave, snapshot.get()));
+    if (snapshot)
+      sinks->add("snapshot",
+                 std::make_unique<SnapshotSink>(*snapshot, topicRoot));
+    for (const auto &sinkCfg : cfg.sinks)
+      sinks->create(sinkCfg);
+
+    // --- Resource usage of the gateway itself
+    if (cfg.stats.interval > 0) {
+      monitor = std::make_unique<ResourceMonitor>(cfg.stats);
+      monitor->setStatsCallback([&sinks](std::string stats) {
+        sinks->dispatch(
+            {.kind = SinkRecord::Kind::STATS, .payload = std::move(stats)});
+      });
+      housekeeping->add(*monitor);
+    }
+
+    for (const auto &masterCfg : cfg.meter.masters) {
+      auto master = std::make_unique<MeterMaster>(masterCfg, handler, *reactor);
+
+      // --- Setup callbacks, every meter and bus device gets a path below
+      // the root: its subtopic and the path served by the HTTP API
+      const auto path = [name = masterCfg.name](const std::string &source) {
+        std::string base = name.empty() ? "" : "/" + name;
+        return source.empty() ? base : base + "/" + source;
+      };
+
+      // Only the primary source of the first meter feeds the meter slave
+      const bool first = masters.empty();
+      const std::string primarySource = master->primarySource();
+      const auto primary = [first, primarySource](const std::string &source) {
+        return first && source == primarySource;
+      };
+
+      master->setUpdateCallback([&sinks, path, primary](
+                                    const std::string &source,
+                                    std::string jsonDump,
+                                    MeterTypes::Values values) {
+        sinks->dispatch({.kind = SinkRecord::Kind::VALUES,
+                         .source = path(source),
+                         .payload = std::move(jsonDump),
+                         .values = std::move(values),
+                         .primary = primary(source)});
+      });
+      master->setDeviceCallback([&sinks, path, primary](
+                                    const std::string &source,
+                                    std::string jsonDump,
+                                    MeterTypes::Device device) {
+        sinks->dispatch({.kind = SinkRecord::Kind::DEVICE,
+                         .source = path(source),
+                         .payload = std::move(jsonDump),
+                         .device = std::move(device),
+                         .primary = primary(source)});
+      });
+      master->setAvailabilityCallback(
+          [&sinks, path](const std::string &source, std::string availability) {
+            sinks->dispatch({.kind = SinkRecord::Kind::AVAILABILITY,
+                             .source = path(source),
+                             .payload = std::move(availability)});
+          });
+      master->setMetricsCallback([&sinks, path](std::string metrics) {
+        sinks->dispatch({.kind = SinkRecord::Kind::METRICS,
+                         .source = path(""),
+                         .payload = std::move(metrics)});
+      });
+      // Raw telegrams are only copied for a sink that wants them
+      if (sinks->wants(Sink::TELEGRAMS)) {
+        master->setTelegramCallback(
+            [&sinks, path](const std::string &source,
+                           const std::string &telegram) {
+              sinks->dispatch({.kind = SinkRecord::Kind::TELEGRAM,
+                               .source = path(source),
+                               .payload = telegram});
+            });
+      }
+
+      masters.push_back(std::move(master));
+    }
+
+    reactor->start();
+    housekeeping->start();
+
+    // --- Name and schedule the threads, now that all of them run
+    tuneThreads(cfg.scheduling, *reactor, *housekeeping, masters, slave.get(),
+                *mqtt, http.get(), *sinks, mainLogger);
 
   } catch (const std::exception &ex) {
     mainLogger->error("Startup failed: {}", ex.what());
     handler.shutdown();
+    alarm(SHUTDOWN_TIMEOUT);
     return EXIT_FAILURE;
   }
 
-  // --- Wait for shutdown signal ---
-  handler.wait();
+  // --- Wait for shutdown signal, reload the config on SIGHUP ---
+  AppConfig loaded = cfg; // last config read, changes are reported once
+  for (auto event = handler.wait(); event != SignalHandler::Event::SHUTDOWN;
+       event = handler.wait()) {
+    if (event == SignalHandler::Event::DUMP) {
+      FlightRecorder::dumpRequested(); // answered by this dump
+      dumpRecorder(cfg.recorder, mainLogger);
+      continue;
+    }
+    try {
+      AppConfig next = loadConfig(config);
+      reloadConfig(cfg, loaded, next, masters, topicRoot, mainLogger);
+      loaded = std::move(next);
+      mainLogger->info("Reloaded config '{}'", config);
+    } catch (const std::exception &ex) {
+      mainLogger->error("Config not reloaded, keeping the running one: {}",
+                        ex.what());
+    }
+  }
 
   // --- Shutdown ---
   mainLogger->info("Shutting down due to signal {} ({})", handler.signalName(),
                    handler.signal());
 
+  // Every thread wakes up on the shutdown event; should one still hang in a
+  // driver or library call, the default action of SIGALRM ends the process
+  alarm(SHUTDOWN_TIMEOUT);
+
+  // A fatal error shuts down before its dump request was read
+  if (FlightRecorder::dumpRequested())
+    dumpRecorder(cfg.recorder, mainLogger);
+
+  // Stop everything dispatching and drain the sinks first, the snapshot sink
+  // may still hold the last readings
+  housekeeping.reset();
+  reactor.reset();
+  masters.clear();
+  sinks.reset();
+
+  if (snapshot) {
+    auto result = snapshot->save();
+    if (!result)
+      mainLogger->warn("Unable to write snapshot: {}",
+                       result.error().describe());
+  }
+
   return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,543 @@
+#include "mbus_decoder.h"
+#include "modbus_error.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <format>
+#include <string>
+#include <string_view>
+
+namespace {
+
+constexpr unsigned char START_SHORT = 0x10;
+constexpr unsigned char START_LONG = 0x68;
+constexpr unsigned char STOP = 0x16;
+constexpr unsigned char RSP_UD_MASK = 0xcf;
+constexpr unsigned char RSP_UD = 0x08;
+constexpr unsigned char CI_SELECT = 0x52;
+constexpr unsigned char CI_VARIABLE = 0x72;
+constexpr size_t FIXED_HEADER_SIZE = 12;
+constexpr int MAX_EXTENSIONS = 10;
+
+// --- DIF: special functions ---
+constexpr unsigned char DIF_MANUFACTURER = 0x0f;
+constexpr unsigned char DIF_MORE_RECORDS = 0x1f;
+constexpr unsigned char DIF_IDLE_FILLER = 0x2f;
+
+// --- VIF: codes outside the primary table ---
+constexpr unsigned char VIF_DATE = 0x6c;
+constexpr unsigned char VIF_DATE_TIME = 0x6d;
+constexpr unsigned char VIF_PLAIN_TEXT = 0x7c;
+constexpr unsigned char VIF_ANY = 0x7e;
+constexpr unsigned char VIF_MANUFACTURER = 0x7f;
+constexpr unsigned char VIF_FIRST_EXTENSION = 0xfb;
+constexpr unsigned char VIF_SECOND_EXTENSION = 0xfd;
+
+constexpr double J_PER_KWH = 3.6e6;
+constexpr double DURATION_SECONDS[] = {1.0, 60.0, 3600.0, 86400.0};
+
+/**
+ * Quantity and canonical unit of a VIF. The raw value is multiplied by
+ * factor * 10^exponent.
+ */
+struct Unit {
+  const char *quantity{"unknown"};
+  const char *unit{""};
+  int exponent{0};
+  double factor{1.0};
+  bool date{false};
+};
+
+unsigned char checksum(std::string_view data) {
+  unsigned char sum = 0;
+  for (char c : data)
+    sum += static_cast<unsigned char>(c);
+  return sum;
+}
+
+// --- EN 13757-3 table 10: primary VIF, extension bit removed ---
+Unit primaryVif(unsigned char vif) {
+  const int n3 = vif & 0x07;
+  const int n2 = vif & 0x03;
+
+  switch (vif & 0x78) {
+  case 0x00:
+    return {"energy", "kWh", n3 - 6};
+  case 0x08:
+    return {"energy", "kWh", n3, 1.0 / J_PER_KWH};
+  case 0x10:
+    return {"volume", "m3", n3 - 6};
+  case 0x18:
+    return {"mass", "kg", n3 - 3};
+  case 0x20:
+    return {vif & 0x04 ? "operating_time" : "on_time", "s", 0,
+            DURATION_SECONDS[n2]};
+  case 0x28:
+    return {"power", "kW", n3 - 6};
+  case 0x30:
+    return {"power", "kW", n3, 1.0 / J_PER_KWH};
+  case 0x38:
+    return {"volume_flow", "m3/h", n3 - 6};
+  case 0x40:
+    return {"volume_flow", "m3/h", n3 - 7, 60.0};
+  case 0x48:
+    return {"volume_flow", "m3/h", n3 - 9, 3600.0};
+  case 0x50:
+    return {"mass_flow", "kg/h", n3 - 3};
+  case 0x58:
+    return {vif & 0x04 ? "return_temperature" : "flow_temperature", "°C",
+            n2 - 3};
+  case 0x60:
+    if (vif < 0x64)
+      return {"temperature_difference", "K", n2 - 3};
+    return {"external_temperature", "°C", n2 - 3};
+  case 0x68:
+    if (vif < 0x6c)
+      return {"pressure", "bar", n2 - 3};
+    if (vif == VIF_DATE || vif == VIF_DATE_TIME)
+      return {"time_point", "", 0, 1.0, true};
+    if (vif == 0x6e)
+      return {"hca_units", ""};
+    return {};
+  case 0x70:
+    if (vif < 0x74)
+      return {"averaging_duration", "s", 0, DURATION_SECONDS[n2]};
+    return {"actuality_duration", "s", 0, DURATION_SECONDS[n2]};
+  case 0x78:
+    if (vif == 0x78)
+      return {"fabrication_number", ""};
+    if (vif == 0x79)
+      return {"enhanced_identification", ""};
+    if (vif == 0x7a)
+      return {"bus_address", ""};
+    if (vif == VIF_MANUFACTURER)
+      return {"manufacturer_specific", ""};
+    return {};
+  }
+  return {};
+}
+
+// --- Table 12: first extension (0xfb), large units ---
+Unit firstExtensionVif(unsigned char vife) {
+  const int n1 = vife & 0x01;
+
+  switch (vife & 0x7e) {
+  case 0x00:
+    return {"energy", "kWh", n1 + 2};
+  case 0x08:
+    return {"energy", "kWh", n1 + 8, 1.0 / J_PER_KWH};
+  case 0x10:
+    return {"volume", "m3", n1 + 2};
+  case 0x18:
+    return {"mass", "kg", n1 + 5};
+  case 0x28:
+    return {"power", "kW", n1 + 2};
+  case 0x30:
+    return {"power", "kW", n1 + 8, 1.0 / J_PER_KWH};
+  }
+  return {};
+}
+
+// --- Table 14: second extension (0xfd), device data and electrical units ---
+Unit secondExtensionVif(unsigned char vife) {
+  const int n4 = vife & 0x0f;
+
+  if ((vife & 0x70) == 0x40)
+    return {"voltage", "V", n4 - 9};
+  if ((vife & 0x70) == 0x50)
+    return {"current", "A", n4 - 12};
+
+  switch (vife) {
+  case 0x08:
+    return {"access_number", ""};
+  case 0x09:
+    return {"medium", ""};
+  case 0x0a:
+    return {"manufacturer", ""};
+  case 0x0b:
+    return {"parameter_set", ""};
+  case 0x0c:
+    return {"model_version", ""};
+  case 0x0d:
+    return {"hardware_version", ""};
+  case 0x0e:
+    return {"firmware_version", ""};
+  case 0x0f:
+    return {"software_version", ""};
+  case 0x10:
+    return {"customer_location", ""};
+  case 0x11:
+    return {"customer", ""};
+  case 0x16:
+    return {"password", ""};
+  case 0x17:
+    return {"error_flags", ""};
+  case 0x1a:
+    return {"digital_output", ""};
+  case 0x1b:
+    return {"digital_input", ""};
+  case 0x1c:
+    return {"baud_rate", ""};
+  case 0x3a:
+    return {"dimensionless", ""};
+  case 0x60:
+    return {"reset_counter", ""};
+  case 0x61:
+    return {"cumulation_counter", ""};
+  case 0x74:
+    return {"battery_remaining", "s", 0, DURATION_SECONDS[3]};
+  }
+  return {};
+}
+
+// Little endian two's complement integer of 1 to 8 bytes
+int64_t integer(const unsigned char *p, size_t len) {
+  uint64_t raw = 0;
+  for (size_t i = len; i-- > 0;)
+    raw = (raw << 8) | p[i];
+  if (len < 8 && (raw >> (len * 8 - 1)) & 1)
+    raw |= ~uint64_t{0} << (len * 8);
+  return static_cast<int64_t>(raw);
+}
+
+// Packed BCD, least significant byte first, 0xf in the top nibble is a minus
+bool bcd(const unsigned char *p, size_t len, double &out) {
+  int64_t value = 0;
+  bool negative = false;
+  for (size_t i = len; i-- > 0;) {
+    unsigned hi = p[i] >> 4;
+    const unsigned lo = p[i] & 0x0f;
+    if (i == len - 1 && hi == 0x0f) {
+      negative = true;
+      hi = 0;
+    }
+    if (hi > 9 || lo > 9)
+      return false;
+    value = value * 100 + hi * 10 + lo;
+  }
+  out = static_cast<double>(negative ? -value : value);
+  return true;
+}
+
+// Strings are sent last character first
+std::string reversed(const unsigned char *p, size_t len) {
+  std::string text(reinterpret_cast<const char *>(p), len);
+  return std::string(text.rbegin(), text.rend());
+}
+
+// Type G (date) and type F (date and time) of EN 13757-3 annex A
+std::string dateText(const unsigned char *p, size_t len) {
+  if (len == 2) {
+    const int day = p[0] & 0x1f;
+    const int month = p[1] & 0x0f;
+    const int year = ((p[0] >> 5) & 0x07) | ((p[1] >> 1) & 0x78);
+    return std::format("{:04}-{:02}-{:02}", 2000 + year, month, day);
+  }
+  if (len == 4 && !(p[0] & 0x80)) {
+    const int minute = p[0] & 0x3f;
+    const int hour = p[1] & 0x1f;
+    const int day = p[2] & 0x1f;
+    const int month = p[3] & 0x0f;
+    const int year = ((p[2] >> 5) & 0x07) | ((p[3] >> 1) & 0x78);
+    return std::format("{:04}-{:02}-{:02}T{:02}:{:02}", 2000 + year, month,
+                       day, hour, minute);
+  }
+  return "";
+}
+
+} // namespace
+
+std::string MbusDecoder::Header::secondaryAddress(void) const {
+  return std::format("{}{:04X}{:02X}{:02X}", id, rawManufacturer, version,
+                     medium);
+}
+
+std::string MbusDecoder::shortFrame(uint8_t control, uint8_t address) {
+  std::string frame{static_cast<char>(START_SHORT), static_cast<char>(control),
+                    static_cast<char>(address)};
+  frame.push_back(static_cast<char>(checksum(frame.substr(1))));
+  frame.push_back(static_cast<char>(STOP));
+  return frame;
+}
+
+std::string MbusDecoder::selectFrame(std::string_view secondary) {
+  // "IIIIIIIIMMMMVVDD": id digits, manufacturer, version and medium in hex,
+  // 'F' is a wildcard nibble
+  auto nibble = [&](size_t i) -> unsigned char {
+    const char c = secondary[i];
+    return c <= '9' ? c - '0' : (c & ~0x20) - 'A' + 10;
+  };
+  auto byteAt = [&](size_t i) -> char {
+    return static_cast<char>(nibble(i) << 4 | nibble(i + 1));
+  };
+
+  std::string frame("\x68\x0b\x0b\x68", 4);
+  frame.push_back(static_cast<char>(SND_UD));
+  frame.push_back(static_cast<char>(ADDRESS_SECONDARY));
+  frame.push_back(static_cast<char>(CI_SELECT));
+  for (size_t i = 8; i > 0; i -= 2)
+    frame.push_back(byteAt(i - 2)); // id, least significant byte first
+  frame.push_back(byteAt(10));      // manufacturer, little endian
+  frame.push_back(byteAt(8));
+  frame.push_back(byteAt(12));
+  frame.push_back(byteAt(14));
+  frame.push_back(static_cast<char>(checksum(frame.substr(4))));
+  frame.push_back(static_cast<char>(STOP));
+  return frame;
+}
+
+std::expected<MbusDecoder::Header, ModbusError>
+MbusDecoder::decode(std::string_view frame, const Visitor &visitor) {
+  const auto *raw = reinterpret_cast<const unsigned char *>(frame.data());
+  const size_t size = frame.size();
+
+  // --- Link layer: 68 L L 68 C A CI ... CS 16 ---
+  if (size < 9 || raw[0] != START_LONG || raw[3] != START_LONG ||
+      raw[1] != raw[2] || size != raw[1] + 6u || raw[size - 1] != STOP) {
+    return std::unexpected(
+        ModbusError::custom(EPROTO, "decode(): Malformed M-Bus long frame"));
+  }
+  const unsigned char received = raw[size - 2];
+  const unsigned char computed = checksum(frame.substr(4, raw[1]));
+  if (received != computed) {
+    return std::unexpected(ModbusError::custom(
+        EBADMSG,
+        "decode(): M-Bus checksum mismatch (received {:02x}, computed {:02x})",
+        received, computed));
+  }
+  if ((raw[4] & RSP_UD_MASK) != RSP_UD || raw[6] != CI_VARIABLE ||
+      size < 9 + FIXED_HEADER_SIZE) {
+    return std::unexpected(ModbusError::custom(
+        EPROTO, "decode(): Unsupported M-Bus answer (C {:02x}, CI {:02x})",
+        raw[4], raw[6]));
+  }
+
+  // --- Fixed header of the variable data structure ---
+  const unsigned char *p = raw + 7;
+  Header header;
+  double id = 0;
+  if (!bcd(p, 4, id)) {
+    return std::unexpected(
+        ModbusError::custom(EPROTO, "decode(): Invalid M-Bus identification"));
+  }
+  header.id = std::format("{:08}", static_cast<uint32_t>(id));
+  header.rawManufacturer = static_cast<uint16_t>(p[4] | p[5] << 8);
+  header.manufacturer = {static_cast<char>(((header.rawManufacturer >> 10) &
+                                            0x1f) + 64),
+                         static_cast<char>(((header.rawManufacturer >> 5) &
+                                            0x1f) + 64),
+                         static_cast<char>((header.rawManufacturer & 0x1f) +
+                                           64)};
+  header.version = p[6];
+  header.medium = p[7];
+  header.access = p[8];
+  header.status = p[9];
+  p += FIXED_HEADER_SIZE;
+
+  const unsigned char *end = raw + size - 2;
+  const auto malformed = [&](const unsigned char *record) {
+    return std::unexpected(ModbusError::custom(
+        EPROTO, "decode(): Malformed M-Bus record at offset {}",
+        record - raw));
+  };
+
+  // --- Data records: DIF [DIFE..] VIF [VIFE..] data ---
+  while (p < end) {
+    const unsigned char *start = p;
+    const unsigned char dif = *p++;
+
+    if (dif == DIF_IDLE_FILLER)
+      continue;
+    if ((dif & 0x0f) == DIF_MANUFACTURER) {
+      header.moreFollows = dif == DIF_MORE_RECORDS;
+      break;
+    }
+
+    Record record;
+    record.function = (dif >> 4) & 0x03;
+    record.storage = (dif >> 6) & 0x01;
+    unsigned char ext = dif;
+    for (int i = 0; ext & 0x80; ++i) {
+      if (p >= end || i == MAX_EXTENSIONS)
+        return malformed(start);
+      ext = *p++;
+      record.storage |= static_cast<uint32_t>(ext & 0x0f) << (1 + 4 * i);
+      record.tariff |= static_cast<uint32_t>((ext >> 4) & 0x03) << (2 * i);
+      record.subunit |= static_cast<uint32_t>((ext >> 6) & 0x01) << i;
+    }
+
+    if (p >= end)
+      return malformed(start);
+    const unsigned char vif = *p++;
+    Unit unit;
+    std::string plainUnit;
+
+    if (vif == VIF_FIRST_EXTENSION || vif == VIF_SECOND_EXTENSION) {
+      if (p >= end)
+        return malformed(start);
+      ext = *p++;
+      unit = vif == VIF_FIRST_EXTENSION ? firstExtensionVif(ext & 0x7f)
+                                        : secondExtensionVif(ext & 0x7f);
+    } else {
+      ext = vif;
+      unit = primaryVif(vif & 0x7f);
+      if ((vif & 0x7f) == VIF_PLAIN_TEXT) {
+        // The unit follows as reversed ASCII
+        if (p >= end || *p > end - p - 1)
+          return malformed(start);
+        const size_t len = *p++;
+        plainUnit = reversed(p, len);
+        p += len;
+        unit.quantity = "plain_text";
+      } else if ((vif & 0x7f) == VIF_ANY) {
+        unit.quantity = "any";
+      }
+    }
+
+    // Combinable VIFEs: only the multiplicative corrections change the value
+    for (int i = 0; ext & 0x80; ++i) {
+      if (p >= end || i == MAX_EXTENSIONS)
+        return malformed(start);
+      ext = *p++;
+      const unsigned char code = ext & 0x7f;
+      if ((code & 0x78) == 0x70)
+        unit.exponent += (code & 0x07) - 6;
+      else if (code == 0x7d)
+        unit.exponent += 3;
+    }
+
+    // --- Data field ---
+    size_t len = 0;
+    enum { NONE, INTEGER, REAL, BCD, TEXT } type = NONE;
+    bool negative = false;
+    switch (dif & 0x0f) {
+    case 0x00:
+    case 0x08:
+      break;
+    case 0x05:
+      len = 4;
+      type = REAL;
+      break;
+    case 0x06:
+      len = 6;
+      type = INTEGER;
+      break;
+    case 0x07:
+      len = 8;
+      type = INTEGER;
+      break;
+    case 0x0d: {
+      if (p >= end)
+        return malformed(start);
+      const unsigned char lvar = *p++;
+      if (lvar < 0xc0) {
+        len = lvar;
+        type = TEXT;
+      } else if (lvar < 0xe0) {
+        len = lvar & 0x0f;
+        type = BCD;
+        negative = lvar >= 0xd0;
+      } else if (lvar < 0xf0) {
+        len = lvar & 0x0f;
+        type = INTEGER;
+      } else {
+        return malformed(start);
+      }
+      break;
+    }
+    case 0x0e:
+      len = 6;
+      type = BCD;
+      break;
+    default:
+      if ((dif & 0x0f) < 0x05) {
+        len = dif & 0x0f;
+        type = INTEGER;
+      } else {
+        len = (dif & 0x0f) - 0x08;
+        type = BCD;
+      }
+      break;
+    }
+    if (len > static_cast<size_t>(end - p) || (type == INTEGER && len > 8) ||
+        (type == BCD && len > 8))
+      return malformed(start);
+
+    if (unit.date && type == INTEGER) {
+      record.text = dateText(p, len);
+    } else if (type == TEXT) {
+      record.text = reversed(p, len);
+    } else if (type != NONE) {
+      double value = 0.0;
+      if (type == INTEGER && len > 0) {
+        value = static_cast<double>(integer(p, len));
+        record.numeric = true;
+      } else if (type == REAL) {
+        float f;
+        uint32_t bits = static_cast<uint32_t>(p[0]) |
+                        static_cast<uint32_t>(p[1]) << 8 |
+                        static_cast<uint32_t>(p[2]) << 16 |
+                        static_cast<uint32_t>(p[3]) << 24;
+        std::memcpy(&f, &bits, sizeof(f));
+        value = f;
+        record.numeric = std::isfinite(value);
+      } else if (type == BCD) {
+        record.numeric = bcd(p, len, value);
+      }
+      if (negative)
+        value = -value;
+      if (record.numeric)
+        record.value = value * unit.factor * std::pow(10.0, unit.exponent);
+    }
+    p += len;
+
+    record.quantity = unit.quantity;
+    record.unit = plainUnit.empty() ? unit.unit : std::move(plainUnit);
+    visitor(record);
+  }
+
+  return header;
+}
+
+const char *MbusDecoder::mediumName(uint8_t medium) {
+  switch (medium) {
+  case 0x00:
+    return "other";
+  case 0x01:
+    return "oil";
+  case 0x02:
+    return "electricity";
+  case 0x03:
+    return "gas";
+  case 0x04:
+    return "heat";
+  case 0x05:
+    return "steam";
+  case 0x06:
+    return "warm_water";
+  case 0x07:
+    return "water";
+  case 0x08:
+    return "heat_cost_allocator";
+  case 0x0a:
+  case 0x0b:
+    return "cooling";
+  case 0x0c:
+    return "heat";
+  case 0x0d:
+    return "heat_cooling";
+  case 0x15:
+    return "hot_water";
+  case 0x16:
+    return "cold_water";
+  case 0x17:
+    return "dual_water";
+  case 0x18:
+    return "pressure";
+  case 0x19:
+    return "ad_converter";
+  }
+  return "unknown";
+}
@@ -1,97 +1,265 @@
 #include "meter_master.h"
 #include "config.h"
 #include "config_yaml.h"
+#include "crc16.h"
+#include "flight_recorder.h"
+#include "gcm_decryptor.h"
 #include "json_utils.h"
+#include "mbus_decoder.h"
 #include "meter_types.h"
 #include "modbus_error.h"
+#include "probes.h"
+#include "scheduling.h"
 #include "signal_handler.h"
+#include "sml_decoder.h"
 #include <algorithm>
+#include <array>
 #include <asm-generic/ioctls.h>
+#include <charconv>
 #include <chrono>
+#include <cctype>
 #include <cmath>
-#include <condition_variable>
+#include <cstring>
+#include <ctime>
 #include <expected>
+#include <format>
+#include <initializer_list>
+#include <linux/serial.h>
+#include <limits>
+#include <memory>
 #include <mutex>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <nlohmann/json.hpp>
+#include <poll.h>
+#include <random>
 #include <regex>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <sys/epoll.h>
 #include <sys/file.h>
+#include <sys/inotify.h>
 #include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <termios.h>
+#include <unistd.h>
 
 using json = nlohmann::ordered_json;
 
+namespace {
+
+// Time spent in the values callback, i.e. handing them to the sinks
+void recordCallback(size_t length,
+                    std::chrono::steady_clock::time_point start) {
+  FlightRecorder::record(
+      FlightRecorder::Event::CALLBACK, length,
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start)
+          .count());
+}
+
+} // namespace
+
 MeterMaster::MeterMaster(const MeterMasterConfig &cfg,
-                         SignalHandler &signalHandler)
-    : cfg_(cfg), handler_(signalHandler) {
+                         SignalHandler &signalHandler, MeterReactor &reactor)
+    : cfg_(cfg), grid_(cfg.grid), handler_(signalHandler) {
 
   masterLogger_ = spdlog::get("meter.master");
   if (!masterLogger_)
     masterLogger_ = spdlog::default_logger();
 
-  // Start update loop thread
-  worker_ = std::thread(&MeterMaster::runLoop, this);
+  label_ = cfg_.name.empty() ? "Meter" : "Meter '" + cfg_.name + "'";
+
+  // Modbus buses block in libmodbus and keep a thread of their own, telegram
+  // sources are driven by the shared event loops
+  if (cfg_.protocol == MeterProtocol::Modbus) {
+    poller_ = std::make_unique<ModbusPoller>(cfg_);
+    scheduler_ = std::make_unique<BusScheduler>(cfg_, *poller_);
+    worker_ = std::thread(&MeterMaster::pollLoop, this);
+  } else {
+    if (cfg_.protocol == MeterProtocol::Sml)
+      framer_ = TelegramFramer(SML_SIZE, TelegramFramer::Format::SML);
+    else if (cfg_.protocol == MeterProtocol::Dsmr)
+      framer_ = TelegramFramer(DSMR_SIZE, TelegramFramer::Format::DSMR);
+    else if (cfg_.protocol == MeterProtocol::Mbus)
+      framer_ = TelegramFramer(MBUS_SIZE, TelegramFramer::Format::MBUS);
+    else if (cfg_.iec)
+      framer_ = TelegramFramer(IEC_SIZE, TelegramFramer::Format::OBIS);
+
+    for (size_t i = 0; cfg_.mbus && i < cfg_.mbus->devices.size(); ++i) {
+      MbusTarget target;
+      target.name = cfg_.mbus->devices[i].name;
+      target.address = cfg_.mbus->devices[i].address;
+      target.secondary = cfg_.mbus->devices[i].secondary;
+      mbusTargets_.push_back(std::move(target));
+    }
+
+    // Encrypted P1 ports wrap the telegram, the keys are applied by the loop
+    if (cfg_.decryption) {
+      framer_ = TelegramFramer(DSMR_SIZE, TelegramFramer::Format::GCM);
+      decryptor_ = std::make_unique<GcmDecryptor>();
+      pendingKeys_ = cfg_.decryption;
+    }
+    framer_.setParityMarking(!cfg_.tcp);
+    deadline_ = Clock::now();
+    metricsDeadline_ =
+        deadline_ + std::chrono::seconds(cfg_.telegram.metricsInterval);
+    reactor.add(*this);
+  }
 }
 
 MeterMaster::~MeterMaster() {
-  cv_.notify_all();
   if (worker_.joinable())
     worker_.join();
   disconnect();
+  unwatchDevice();
 }
 
 void MeterMaster::disconnect(void) {
+  const bool wasConnected = link_ == LinkState::CONNECTED;
+  link_ = LinkState::DISCONNECTED;
+
+  if (serialPort_ != -1 || socket_ != -1)
+    ++fdGeneration_;
   if (serialPort_ != -1) {
     close(serialPort_);
     serialPort_ = -1;
+  }
+  if (socket_ != -1) {
+    close(socket_);
+    socket_ = -1;
+  }
+  framer_.reset();
+  linkErrors_ = 0;
+  iec_ = IecState::NONE;
+  mbus_ = MbusState::NONE;
+  for (auto &target : mbusTargets_) {
+    if (target.online && availabilityCallback_)
+      availabilityCallback_(target.name, "disconnected");
+    target.online = false;
+  }
 
+  if (wasConnected) {
     if (availabilityCallback_)
-      availabilityCallback_("disconnected");
+      availabilityCallback_("", "disconnected");
 
-    masterLogger_->info("Meter disconnected");
+    masterLogger_->info("{} disconnected", label_);
   }
-  {
-    std::unique_lock<std::mutex> lock(cbMutex_);
-    cv_.wait_for(lock, std::chrono::seconds(1),
-                 [this] { return !handler_.isRunning(); });
+
+  if (poller_ && poller_->isConnected()) {
+    poller_->close();
+
+    // Every meter on the bus is gone until it answers again
+    for (size_t dev = 0; dev < poller_->deviceCount(); ++dev) {
+      if (scheduler_->isOnline(dev))
+        publishAvailability(dev, "disconnected");
+    }
+    scheduler_->markOffline();
+
+    masterLogger_->info("{} bus '{}' disconnected", label_,
+                        poller_->endpoint());
+  }
+}
+
+std::chrono::milliseconds MeterMaster::reconnectDelay(void) {
+  // Back off a telegram source that keeps failing, reset by a good telegram
+  const auto &delay = cfg_.telegram.reconnectDelay;
+  int seconds = delay.min;
+  if (delay.exponential) {
+    const int shift = std::min(connectFailures_, 16);
+    seconds = static_cast<int>(std::min<int64_t>(
+        delay.max, static_cast<int64_t>(delay.min) << shift));
   }
+  ++connectFailures_;
+  int64_t ms = seconds * int64_t{1000};
+
+  // Jitter, meters behind one bridge or hub must not reconnect in lockstep
+  if (connectFailures_ > 1) {
+    std::uniform_int_distribution<int64_t> jitter(ms / 2, ms);
+    ms = jitter(rng_);
+  }
+
+  return std::chrono::milliseconds(ms);
 }
 
-void MeterMaster::setUpdateCallback(
-    std::function<void(std::string, MeterTypes::Values)> cb) {
+void MeterMaster::setUpdateCallback(UpdateCallback cb) {
   std::lock_guard<std::mutex> lock(cbMutex_);
   updateCallback_ = std::move(cb);
 }
 
-void MeterMaster::setDeviceCallback(
-    std::function<void(std::string, MeterTypes::Device)> cb) {
+void MeterMaster::setDeviceCallback(DeviceCallback cb) {
   std::lock_guard<std::mutex> lock(cbMutex_);
   deviceCallback_ = std::move(cb);
 }
 
-void MeterMaster::setAvailabilityCallback(std::function<void(std::string)> cb) {
+void MeterMaster::setAvailabilityCallback(AvailabilityCallback cb) {
   std::lock_guard<std::mutex> lock(cbMutex_);
   availabilityCallback_ = std::move(cb);
 }
 
+void MeterMaster::setTelegramCallback(TelegramCallback cb) {
+  std::lock_guard<std::mutex> lock(cbMutex_);
+  telegramCallback_ = std::move(cb);
+}
+
+void MeterMaster::setMetricsCallback(std::function<void(std::string)> cb) {
+  std::lock_guard<std::mutex> lock(cbMutex_);
+  metricsCallback_ = std::move(cb);
+}
+
+void MeterMaster::setDecryptionKeys(const DecryptionConfig &keys) {
+  std::lock_guard<std::mutex> lock(cbMutex_);
+  pendingKeys_ = keys;
+}
+
+void MeterMaster::setGrid(const GridConfig &grid) {
+  std::lock_guard<std::mutex> lock(cbMutex_);
+  grid_ = grid;
+}
+
+GridConfig MeterMaster::currentGrid(void) const {
+  std::lock_guard<std::mutex> lock(cbMutex_);
+  return grid_;
+}
+
+std::vector<std::thread::native_handle_type> MeterMaster::threads(void) {
+  if (!worker_.joinable())
+    return {};
+  return {worker_.native_handle()};
+}
+
+std::string MeterMaster::primarySource(void) const {
+  // Only the first meter on a Modbus bus feeds the meter slave
+  if (cfg_.protocol == MeterProtocol::Modbus)
+    return cfg_.modbus.devices.front().name;
+  return "";
+}
+
 MeterTypes::ErrorAction
-MeterMaster::handleResult(std::expected<void, ModbusError> &&result) {
+MeterMaster::handleResult(std::expected<void, ModbusError> &&result,
+                          bool recorded) {
   if (result) {
     return MeterTypes::ErrorAction::NONE;
   }
 
+  // Unless recover() has seen the error first
   const ModbusError &err = result.error();
+  if (!recorded)
+    FlightRecorder::recordError(err);
 
   if (err.severity == ModbusError::Severity::FATAL) {
     // Fatal error occurred - initiate shutdown sequence
-    masterLogger_->error("FATAL Meter error: {}", err.describe());
+    masterLogger_->error("FATAL {} error: {}", label_, err.describe());
     handler_.shutdown();
     return MeterTypes::ErrorAction::SHUTDOWN;
 
   } else if (err.severity == ModbusError::Severity::TRANSIENT) {
     // Temporary error - disconnect, wait and reconnect
-    masterLogger_->warn("Transient Meter error: {}", err.describe());
+    transientLog_.log(*masterLogger_, spdlog::level::warn,
+                      "Transient {} error: {}", label_,
+                      [&err] { return err.describe(); });
     disconnect();
     return MeterTypes::ErrorAction::RECONNECT;
 
@@ -111,11 +279,22 @@ std::expected<void, ModbusError> MeterMaster::tryConnect(void) {
         ModbusError::custom(EINTR, "tryConnect(): Shutdown in progress"));
   }
 
+  if (cfg_.tcp)
+    return tryConnectTcp();
+
   if (serialPort_ >= 0)
     return {};
 
-  serialPort_ = open(cfg_.rtu->device.c_str(), O_RDONLY | O_NOCTTY);
+  // Mode C readout and M-Bus write requests, otherwise the meter pushes
+  const int access = cfg_.iec || cfg_.mbus ? O_RDWR : O_RDONLY;
+  serialPort_ = open(cfg_.rtu->device.c_str(),
+                     access | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
   if (serialPort_ == -1) {
+    // Unplugged adapter, the node may linger until udev has removed it
+    if (errno == ENOENT || errno == ENODEV || errno == ENXIO) {
+      return std::unexpected(ModbusError::custom(
+          ENODEV, "Serial device '{}' not present", cfg_.rtu->device));
+    }
     return std::unexpected(
         ModbusError::fromErrno("Opening serial device failed"));
   }
@@ -123,6 +302,7 @@ std::expected<void, ModbusError> MeterMaster::tryConnect(void) {
   if (!isatty(serialPort_)) {
     int saved_errno = errno;
     close(serialPort_);
+    serialPort_ = -1;
     errno = saved_errno;
     return std::unexpected(ModbusError::fromErrno("Device is not a tty"));
   }
@@ -130,6 +310,7 @@ std::expected<void, ModbusError> MeterMaster::tryConnect(void) {
   if (flock(serialPort_, LOCK_EX | LOCK_NB) == -1) {
     int saved_errno = errno;
     close(serialPort_);
+    serialPort_ = -1;
     errno = saved_errno;
     return std::unexpected(
         ModbusError::fromErrno("Failed to lock serial device"));
@@ -138,6 +319,7 @@ std::expected<void, ModbusError> MeterMaster::tryConnect(void) {
   if (ioctl(serialPort_, TIOCEXCL) == -1) {
     int saved_errno = errno;
     close(serialPort_);
+    serialPort_ = -1;
     errno = saved_errno;
     return std::unexpected(
         ModbusError::fromErrno("Failed to set exclusive lock"));
@@ -147,6 +329,7 @@ std::expected<void, ModbusError> MeterMaster::tryConnect(void) {
   if (tcgetattr(serialPort_, &serialPortSettings) == -1) {
     int saved_errno = errno;
     close(serialPort_);
+    serialPort_ = -1;
     errno = saved_errno;
     return std::unexpected(
         ModbusError::fromErrno("Failed to get serial port attributes"));
@@ -160,6 +343,7 @@ std::expected<void, ModbusError> MeterMaster::tryConnect(void) {
       cfsetospeed(&serialPortSettings, baudSpeed) < 0) {
     int saved_errno = errno;
     close(serialPort_);
+    serialPort_ = -1;
     errno = saved_errno;
     return std::unexpected(ModbusError::fromErrno(
         "Failed to set serial port speed {} baud", cfg_.rtu->baud));
@@ -195,14 +379,20 @@ std::expected<void, ModbusError> MeterMaster::tryConnect(void) {
     serialPortSettings.c_cflag |= CSTOPB;
   }
 
-  // blocking read: wait until buffer has been filled, 0.5s
-  // timeout for first byte (VTIME=5)
-  serialPortSettings.c_cc[VMIN] = BUFFER_SIZE;
-  serialPortSettings.c_cc[VTIME] = 5;
+  // Mark bytes with a parity or framing error and breaks as ff 00 X instead
+  // of passing them on as data, the framer counts and drops them
+  serialPortSettings.c_iflag |= INPCK | PARMRK;
+  serialPortSettings.c_iflag &= ~(IGNPAR | IGNBRK | BRKINT | ISTRIP);
+
+  // return whatever arrived; with O_NONBLOCK an empty buffer reads as
+  // EAGAIN (VMIN 0 would read as 0, i.e. end of file)
+  serialPortSettings.c_cc[VMIN] = 1;
+  serialPortSettings.c_cc[VTIME] = 0;
 
   if (tcsetattr(serialPort_, TCSANOW, &serialPortSettings)) {
     int saved_errno = errno;
     close(serialPort_);
+    serialPort_ = -1;
     errno = saved_errno;
     return std::unexpected(
         ModbusError::fromErrno("Failed to set serial port attributes"));
@@ -211,263 +401,1982 @@ std::expected<void, ModbusError> MeterMaster::tryConnect(void) {
   // flush both directions if desired after applying settings
   tcflush(serialPort_, TCIOFLUSH);
 
-  masterLogger_->info("Meter connected ({}{}{}, {} baud)", cfg_.rtu->dataBits,
-                      parityToChar(cfg_.rtu->parity), cfg_.rtu->stopBits,
-                      cfg_.rtu->baud);
+  // The tty may have appeared right after the watch was set up
+  unwatchDevice();
+  link_ = LinkState::CONNECTED;
+  readDeadline_ =
+      Clock::now() + std::chrono::seconds(cfg_.telegram.readTimeout);
+  deadline_ = readDeadline_;
+
+  // Sign on right away
+  if (cfg_.iec) {
+    iec_ = IecState::IDLE;
+    iecBaud_ = cfg_.rtu->baud;
+    deadline_ = Clock::now();
+  }
+  if (cfg_.mbus) {
+    mbus_ = MbusState::IDLE;
+    deadline_ = Clock::now();
+  }
+
+  masterLogger_->info("{} connected ({}{}{}, {} baud)", label_,
+                      cfg_.rtu->dataBits, parityToChar(cfg_.rtu->parity),
+                      cfg_.rtu->stopBits, cfg_.rtu->baud);
 
   if (availabilityCallback_)
-    availabilityCallback_("connected");
+    availabilityCallback_("", "connected");
 
   return {};
 }
 
-std::expected<void, ModbusError> MeterMaster::readTelegram() {
-  if (!handler_.isRunning()) {
+std::expected<void, ModbusError> MeterMaster::tryConnectTcp(void) {
+  if (socket_ >= 0)
+    return {};
+
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+
+  addrinfo *res = nullptr;
+  const std::string port = std::to_string(cfg_.tcp->port);
+  int rc = getaddrinfo(cfg_.tcp->host.c_str(), port.c_str(), &hints, &res);
+  if (rc != 0) {
     return std::unexpected(
-        ModbusError::custom(EINTR, "readTelegram(): Shutdown in progress"));
+        ModbusError::custom(EHOSTUNREACH, "Resolving '{}' failed: {}",
+                            cfg_.tcp->host, gai_strerror(rc)));
   }
+  std::unique_ptr<addrinfo, decltype(&freeaddrinfo)> guard(res, freeaddrinfo);
 
-  if (serialPort_ == -1)
-    return std::unexpected(
-        ModbusError::custom(ENOTCONN, "readTelegram(): Meter not connected"));
-
-  std::vector<char> buffer(BUFFER_SIZE);
-  std::vector<char> packet(TELEGRAM_SIZE);
-  size_t packetPos = 0;
-  bool messageBegin = false;
-  bool telegramComplete = false;
-
-  // In readTelegram():
-  while (packetPos < TELEGRAM_SIZE && !telegramComplete) {
-    // Add shutdown check BEFORE blocking read
-    if (!handler_.isRunning()) {
-      return std::unexpected(
-          ModbusError::custom(EINTR, "readTelegram(): Shutdown in progress"));
-    }
+  // Use the first address (IPv6 or IPv4) that accepts the connection attempt
+  std::expected<void, ModbusError> result;
+  for (const addrinfo *ai = res; ai; ai = ai->ai_next) {
+    result = connectSocket(ai);
+    if (result)
+      break;
+  }
+  if (!result)
+    return result;
 
-    std::fill(buffer.begin(), buffer.end(), '\0');
-    ssize_t bytesReceived = ::read(serialPort_, buffer.data(), BUFFER_SIZE);
+  // The handshake completes in the event loop
+  link_ = LinkState::CONNECTING;
+  deadline_ = Clock::now() + std::chrono::seconds(cfg_.telegram.readTimeout);
 
-    if (bytesReceived == -1) {
-      return std::unexpected(
-          ModbusError::fromErrno("Failed to read serial device"));
-    }
+  return {};
+}
 
-    if (bytesReceived == 0) {
-      // Timeout - shouldn't happen mid-telegram
-      return std::unexpected(ModbusError::custom(
-          ETIMEDOUT, "readTelegram(): Timeout during read"));
-    }
-
-    // Process bytes
-    for (ssize_t i = 0; i < bytesReceived && packetPos < TELEGRAM_SIZE; ++i) {
-      char c = buffer[i];
-      if (c == '/')
-        messageBegin = true;
-      if (messageBegin) {
-        packet[packetPos++] = c;
-        if (packetPos >= 3 && packet[packetPos - 3] == '!') {
-          telegramComplete = true;
-          break;
-        }
-      }
-    }
-  }
+std::expected<void, ModbusError>
+MeterMaster::connectSocket(const addrinfo *ai) {
+  int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                  ai->ai_protocol);
+  if (fd == -1)
+    return std::unexpected(ModbusError::fromErrno("Creating socket failed"));
 
-  // Ensure we have at least 3 bytes and the third-from-last is '!'
-  if (packetPos < 3 || packet[packetPos - 3] != '!') {
-    return std::unexpected(ModbusError::custom(
-        EPROTO, "readTelegram(): telegram stream not in sync"));
+  if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == -1 &&
+      errno != EINPROGRESS) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return std::unexpected(ModbusError::fromErrno(
+        "Connecting to '{}:{}' failed", cfg_.tcp->host, cfg_.tcp->port));
   }
 
-  masterLogger_->trace("Received telegram (len {}):\n{}", packetPos,
-                       std::string(packet.begin(), packet.begin() + packetPos));
+  socket_ = fd;
+  return {};
+}
 
-  {
-    std::lock_guard<std::mutex> lock(cbMutex_);
-    telegram_.assign(packet.begin(), packet.begin() + packetPos);
+std::expected<void, ModbusError> MeterMaster::finishConnect(void) {
+  int err = 0;
+  socklen_t len = sizeof(err);
+  if (getsockopt(socket_, SOL_SOCKET, SO_ERROR, &err, &len) == -1 ||
+      err != 0) {
+    errno = err ? err : errno;
+    return std::unexpected(ModbusError::fromErrno(
+        "Connecting to '{}:{}' failed", cfg_.tcp->host, cfg_.tcp->port));
   }
 
+  tuneSocket();
+
+  link_ = LinkState::CONNECTED;
+  readDeadline_ =
+      Clock::now() + std::chrono::seconds(cfg_.telegram.readTimeout);
+  deadline_ = readDeadline_;
+
+  masterLogger_->info("{} connected ('{}:{}')", label_, cfg_.tcp->host,
+                      cfg_.tcp->port);
+
+  if (availabilityCallback_)
+    availabilityCallback_("", "connected");
+
   return {};
 }
 
-std::expected<void, ModbusError> MeterMaster::updateValuesAndJson() {
-  if (!handler_.isRunning()) {
-    return std::unexpected(ModbusError::custom(
-        EINTR, "updateValuesAndJson(): Shutdown in progress"));
-  }
-  {
-    std::lock_guard<std::mutex> lock(cbMutex_);
-    if (telegram_.empty())
-      return {};
+void MeterMaster::tuneSocket(void) {
+  const auto setOption = [this](int level, int name, int value,
+                                const char *label) {
+    if (setsockopt(socket_, level, name, &value, sizeof(value)) == -1)
+      masterLogger_->warn("tuneSocket(): Unable to set {}: {}", label,
+                          strerror(errno));
+  };
+
+  // Telegrams are small and pushed by the bridge, forward them immediately
+  if (cfg_.telegram.noDelay)
+    setOption(IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+
+  // Detect a bridge that lost power or WiFi without closing the connection
+  if (cfg_.telegram.keepalive > 0) {
+    const int idle = cfg_.telegram.keepalive;
+    setOption(SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+    setOption(IPPROTO_TCP, TCP_KEEPIDLE, idle, "TCP_KEEPIDLE");
+    setOption(IPPROTO_TCP, TCP_KEEPINTVL, std::max(idle / 3, 1),
+              "TCP_KEEPINTVL");
+    setOption(IPPROTO_TCP, TCP_KEEPCNT, 3, "TCP_KEEPCNT");
   }
 
-  MeterTypes::Values values{};
+  // Wake up once per chunk instead of once per byte of a slow serial bridge
+  if (cfg_.telegram.rcvLowat > 0)
+    setOption(SOL_SOCKET, SO_RCVLOWAT, cfg_.telegram.rcvLowat, "SO_RCVLOWAT");
+}
 
-  std::istringstream iss;
-  {
-    std::lock_guard<std::mutex> lock(cbMutex_);
-    iss.str(telegram_);
+std::expected<void, ModbusError> MeterMaster::readAvailable(void) {
+  if (!handler_.isRunning()) {
+    return std::unexpected(
+        ModbusError::custom(EINTR, "readAvailable(): Shutdown in progress"));
   }
 
-  values.time = std::chrono::duration_cast<std::chrono::milliseconds>(
-                    std::chrono::system_clock::now().time_since_epoch())
-                    .count();
-  double activeEnergy;
+  const int fd = socket_ != -1 ? socket_ : serialPort_;
+  if (fd == -1)
+    return std::unexpected(
+        ModbusError::custom(ENOTCONN, "readAvailable(): Meter not connected"));
 
-  std::regex obexRegex(R"(^([0-9]-0:[0-9]+.[0-9]+.[0-9]+\*255)\(([^)]+)\))");
-  std::string line;
+  std::array<char, BUFFER_SIZE> buffer;
 
-  int lineNum = 0;
-  while (std::getline(iss, line)) {
-    ++lineNum;
-    line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+  // Drain the descriptor, several chunks may have arrived since the last call
+  while (true) {
+    ssize_t bytesReceived = ::read(fd, buffer.data(), buffer.size());
 
-    if (line.empty() || (line.size() && (line[0] == '/' || line[0] == '!')))
+    if (bytesReceived == 0) {
+      return std::unexpected(ModbusError::custom(
+          ECONNRESET, "readAvailable(): Connection closed by meter"));
+    }
+    if (bytesReceived == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        // Below SO_RCVLOWAT epoll stays quiet, drain the tail of a telegram
+        if (socket_ != -1 && cfg_.telegram.rcvLowat > 0 &&
+            framer_.inTelegram()) {
+          deadline_ = std::min(readDeadline_, Clock::now() + TAIL_DELAY);
+        }
+        return {};
+      }
+      if (errno == EINTR)
+        continue;
+      // A failing USB adapter or a closed pty: reopen, don't give up
+      auto err = ModbusError::fromErrno("Failed to read meter");
+      if (err.code == EIO || err.code == ENXIO || err.code == ENODEV)
+        err.severity = ModbusError::Severity::TRANSIENT;
+      return std::unexpected(std::move(err));
+    }
+
+    std::string_view chunk(buffer.data(), bytesReceived);
+    FlightRecorder::record(FlightRecorder::Event::BYTES_READ, bytesReceived);
+
+    // M-Bus: answers to the requests of the poll cycle
+    if (mbus_ != MbusState::NONE) {
+      auto result = receiveMbus(chunk);
+      if (!result)
+        return result;
       continue;
+    }
 
-    try {
-      std::smatch match;
-      if (!std::regex_search(line, match, obexRegex))
-        throw std::invalid_argument("Malformed OBEX expression");
+    // IEC 62056-21 mode C: identification first, data after the baud switch
+    if (iec_ == IecState::IDLE || iec_ == IecState::SWITCH)
+      continue; // block check character or bytes at the old baud rate
+    if (iec_ == IecState::IDENT) {
+      auto result = receiveIdent(chunk);
+      if (!result)
+        return result;
+      continue;
+    }
+    if (iec_ == IecState::DATA) {
+      auto end = std::remove(buffer.begin(), buffer.begin() + bytesReceived,
+                             IEC_STX);
+      chunk = std::string_view(buffer.data(), end - buffer.begin());
+    }
 
-      std::string obis = match[1];
-      std::string value_unit = match[2];
+    readDeadline_ =
+        Clock::now() + std::chrono::seconds(cfg_.telegram.readTimeout);
+    deadline_ = readDeadline_;
 
-      if (obis == "1-0:1.8.0*255") {
-        size_t pos = value_unit.find("*");
-        activeEnergy = std::stod(value_unit.substr(0, pos));
-      } else if (obis == "1-0:16.7.0*255") {
-        size_t pos = value_unit.find("*");
-        values.activePower = std::stod(value_unit.substr(0, pos));
-      } else if (obis == "1-0:36.7.0*255") {
-        size_t pos = value_unit.find("*");
-        values.phase1.activePower = std::stod(value_unit.substr(0, pos));
-      } else if (obis == "1-0:56.7.0*255") {
-        size_t pos = value_unit.find("*");
-        values.phase2.activePower = std::stod(value_unit.substr(0, pos));
-      } else if (obis == "1-0:76.7.0*255") {
-        size_t pos = value_unit.find("*");
-        values.phase3.activePower = std::stod(value_unit.substr(0, pos));
-      } else if (obis == "1-0:32.7.0*255") {
-        size_t pos = value_unit.find("*");
-        values.phase1.phVoltage = std::stod(value_unit.substr(0, pos));
-      } else if (obis == "1-0:52.7.0*255") {
-        size_t pos = value_unit.find("*");
-        values.phase2.phVoltage = std::stod(value_unit.substr(0, pos));
-      } else if (obis == "1-0:72.7.0*255") {
-        size_t pos = value_unit.find("*");
-        values.phase3.phVoltage = std::stod(value_unit.substr(0, pos));
-      } else if (obis == "0-0:96.8.0*255") {
-        size_t pos = value_unit.find("*");
-        values.activeSensorTime =
-            std::stoul(value_unit.substr(0, pos), nullptr, 16);
+    auto status = framer_.push(chunk);
+    if (status == TelegramFramer::Status::OVERFLOW) {
+      return std::unexpected(ModbusError::custom(
+          EPROTO, "readAvailable(): telegram stream not in sync"));
+    }
+    if (status == TelegramFramer::Status::COMPLETE) {
+      // A chunk may hold several telegrams, a bad one does not cost the rest
+      std::expected<void, ModbusError> failed{};
+      while (framer_.ready()) {
+        auto result = processTelegram(framer_.take());
+        if (!result && failed)
+          failed = std::move(result);
+      }
+      if (!failed)
+        return failed;
+
+      if (iec_ == IecState::DATA) {
+        iec_ = IecState::IDLE;
+        deadline_ = nextReadout_;
       }
-    } catch (const std::exception &err) {
-      std::ostringstream oss;
-      oss << "[" << line << "]: " << err.what();
-      return std::unexpected(ModbusError::custom(EPROTO, oss.str()));
     }
   }
+}
 
-  const bool isLeading = cfg_.grid.isLeading;
-  values.powerFactor = cfg_.grid.powerFactor;
-  values.frequency = cfg_.grid.frequency;
+// --- IEC 62056-21 mode C readout ---
 
-  values.phase1.powerFactor = values.powerFactor;
-  values.phase2.powerFactor = values.powerFactor;
-  values.phase3.powerFactor = values.powerFactor;
+namespace {
 
-  const auto apparentPower = [](double active, double pf) {
-    return std::abs(active / pf);
-  };
+// Baud rate characters '0'..'6' of mode C
+constexpr std::array<int, 7> IEC_BAUD_RATES = {300,  600,  1200, 2400,
+                                               4800, 9600, 19200};
 
-  const double sign = isLeading ? -1.0 : 1.0;
-  const auto reactivePower = [sign](double active, double pf) {
-    return sign * std::tan(std::acos(std::abs(pf))) * active;
-  };
+} // namespace
 
-  // active power — direction from power factor sign
-  const double powerSign = values.powerFactor > 0.0 ? 1.0 : -1.0;
-  values.activePower *= powerSign;
-  values.phase1.activePower *= powerSign;
-  values.phase2.activePower *= powerSign;
-  values.phase3.activePower *= powerSign;
+std::expected<void, ModbusError> MeterMaster::requestReadout(void) {
+  // The meter is back at the initial baud rate after each readout
+  if (iecBaud_ != cfg_.rtu->baud) {
+    auto result = setBaud(cfg_.rtu->baud);
+    if (!result)
+      return result;
+  }
+  tcflush(serialPort_, TCIOFLUSH);
+  framer_.reset();
+  identLine_.clear();
 
-  // apparent power
-  values.apparentPower = apparentPower(values.activePower, values.powerFactor);
-  values.phase1.apparentPower =
-      apparentPower(values.phase1.activePower, values.powerFactor);
-  values.phase2.apparentPower =
-      apparentPower(values.phase2.activePower, values.powerFactor);
-  values.phase3.apparentPower =
-      apparentPower(values.phase3.activePower, values.powerFactor);
+  auto result = writeSerial(std::format("/?{}!\r\n", cfg_.iec->address));
+  if (!result)
+    return result;
 
-  // reactive power
-  values.reactivePower = reactivePower(values.activePower, values.powerFactor);
-  values.phase1.reactivePower =
-      reactivePower(values.phase1.activePower, values.powerFactor);
-  values.phase2.reactivePower =
-      reactivePower(values.phase2.activePower, values.powerFactor);
-  values.phase3.reactivePower =
-      reactivePower(values.phase3.activePower, values.powerFactor);
+  const auto now = Clock::now();
+  iec_ = IecState::IDENT;
+  nextReadout_ = now + std::chrono::seconds(cfg_.iec->interval);
+  readDeadline_ = now + std::chrono::seconds(cfg_.telegram.readTimeout);
+  deadline_ = readDeadline_;
 
-  // active energy — direction from power factor sign
-  values.activeEnergyImport = values.powerFactor > 0.0 ? activeEnergy : 0.0;
-  values.activeEnergyExport = values.powerFactor < 0.0 ? activeEnergy : 0.0;
+  return {};
+}
 
-  // apparent energy — magnitude only, direction from isLeading
-  const double apparentEnergy = std::abs(activeEnergy / values.powerFactor);
-  values.apparentEnergyImport = isLeading ? 0.0 : apparentEnergy;
-  values.apparentEnergyExport = isLeading ? apparentEnergy : 0.0;
+std::expected<void, ModbusError>
+MeterMaster::receiveIdent(std::string_view chunk) {
+  const size_t eol = chunk.find('\n');
+  identLine_.append(chunk.substr(0, eol));
+  if (identLine_.size() > IDENT_SIZE) {
+    return std::unexpected(ModbusError::custom(
+        EPROTO, "receiveIdent(): Identification line too long"));
+  }
+  if (eol == std::string_view::npos)
+    return {};
 
-  // reactive energy — magnitude only, direction from isLeading
-  const double phi = std::acos(std::abs(values.powerFactor));
-  const double reactiveEnergy = std::sin(phi) * apparentEnergy;
-  values.reactiveEnergyImport = isLeading ? 0.0 : reactiveEnergy;
-  values.reactiveEnergyExport = isLeading ? reactiveEnergy : 0.0;
+  // "/XXXZident": manufacturer, highest baud rate character, identification
+  const size_t start = identLine_.find('/');
+  if (start == std::string::npos || identLine_.size() < start + 5) {
+    return std::unexpected(ModbusError::custom(
+        EPROTO, "receiveIdent(): Malformed identification [{}]", identLine_));
+  }
+  std::string_view ident(identLine_);
+  ident = ident.substr(start);
+  if (ident.ends_with('\r'))
+    ident.remove_suffix(1);
 
-  // voltages
-  const auto ppVoltage = [](double va, double vb) {
-    return std::sqrt(va * va + vb * vb + va * vb);
-  };
+  const char rate = ident[4];
+  if (rate < '0' || rate > '6') {
+    return std::unexpected(ModbusError::custom(
+        EPROTO, "receiveIdent(): Meter does not support mode C [{}]", ident));
+  }
 
-  values.phVoltage = (values.phase1.phVoltage + values.phase2.phVoltage +
-                      values.phase3.phVoltage) /
-                     3.0;
+  // Highest baud rate supported by both sides
+  size_t index = rate - '0';
+  while (index > 0 && IEC_BAUD_RATES[index] > cfg_.iec->maxBaud)
+    --index;
 
-  values.phase1.ppVoltage =
-      ppVoltage(values.phase1.phVoltage, values.phase2.phVoltage);
-  values.phase2.ppVoltage =
-      ppVoltage(values.phase2.phVoltage, values.phase3.phVoltage);
-  values.phase3.ppVoltage =
-      ppVoltage(values.phase3.phVoltage, values.phase1.phVoltage);
+  // ACK, normal protocol, baud rate, data readout
+  const std::string ack = std::format("\x06" "0{}0\r\n", index);
+  auto result = writeSerial(ack);
+  if (!result)
+    return result;
 
-  values.ppVoltage = (values.phase1.ppVoltage + values.phase2.ppVoltage +
-                      values.phase3.ppVoltage) /
-                     3.0;
+  // The identification line heads the telegram
+  framer_.push(ident);
+  framer_.push("\r\n");
 
-  // currents
-  const auto phaseCurrent = [&values](double activePower, double phVoltage) {
-    return std::abs(activePower / (phVoltage * values.powerFactor));
-  };
+  iecNextBaud_ = IEC_BAUD_RATES[index];
+  masterLogger_->debug("{} identified as '{}', reading at {} baud", label_,
+                       ident, iecNextBaud_);
 
-  values.phase1.current =
-      phaseCurrent(values.phase1.activePower, values.phase1.phVoltage);
-  values.phase2.current =
-      phaseCurrent(values.phase2.activePower, values.phase2.phVoltage);
-  values.phase3.current =
-      phaseCurrent(values.phase3.activePower, values.phase3.phVoltage);
-  values.current =
-      values.phase1.current + values.phase2.current + values.phase3.current;
+  if (iecNextBaud_ == iecBaud_) {
+    iec_ = IecState::DATA;
+    return {};
+  }
 
-  json newJson;
-  json phases = json::array();
+  // Follow the meter to the new rate once the acknowledgement is sent
+  // (10 bits per character)
+  iec_ = IecState::SWITCH;
+  deadline_ = Clock::now() +
+              std::chrono::milliseconds(ack.size() * 10'000 / iecBaud_) +
+              IEC_SWITCH_MARGIN;
 
-  phases.push_back({
-      {"id", 1},
-      {"power_active", JsonUtils::roundTo(values.phase1.activePower, 2)},
-      {"power_apparent", JsonUtils::roundTo(values.phase1.apparentPower, 2)},
+  return {};
+}
+
+std::expected<void, ModbusError> MeterMaster::switchBaud(void) {
+  auto result = setBaud(iecNextBaud_);
+  if (!result)
+    return result;
+
+  iec_ = IecState::DATA;
+  readDeadline_ =
+      Clock::now() + std::chrono::seconds(cfg_.telegram.readTimeout);
+  deadline_ = readDeadline_;
+
+  return {};
+}
+
+std::expected<void, ModbusError> MeterMaster::setBaud(int baud) {
+  termios settings;
+  if (tcgetattr(serialPort_, &settings) == -1) {
+    return std::unexpected(
+        ModbusError::fromErrno("Failed to get serial port attributes"));
+  }
+
+  speed_t speed = baudToSpeed(baud);
+  if (cfsetispeed(&settings, speed) < 0 || cfsetospeed(&settings, speed) < 0 ||
+      tcsetattr(serialPort_, TCSANOW, &settings) == -1) {
+    return std::unexpected(ModbusError::fromErrno(
+        "Failed to set serial port speed {} baud", baud));
+  }
+
+  iecBaud_ = baud;
+  return {};
+}
+
+std::expected<void, ModbusError>
+MeterMaster::writeSerial(std::string_view data) {
+  ssize_t written = ::write(serialPort_, data.data(), data.size());
+  if (written == -1 && errno != EAGAIN && errno != EWOULDBLOCK)
+    return std::unexpected(ModbusError::fromErrno("Failed to write meter"));
+  if (written != static_cast<ssize_t>(data.size())) {
+    return std::unexpected(ModbusError::custom(
+        ENOBUFS, "writeSerial(): Serial output buffer full"));
+  }
+  return {};
+}
+
+// --- Wired M-Bus master ---
+
+namespace {
+
+constexpr const char *MBUS_FUNCTIONS[] = {"instantaneous", "maximum",
+                                          "minimum", "error"};
+
+} // namespace
+
+std::expected<void, ModbusError> MeterMaster::onMbusTimer(void) {
+  // Start of a poll cycle
+  if (mbus_ == MbusState::IDLE) {
+    nextReadout_ = Clock::now() + std::chrono::seconds(cfg_.mbus->interval);
+    mbusIndex_ = 0;
+    return pollMbusTarget();
+  }
+
+  // The meter stayed silent, or garbled answers collided during a scan
+  if (mbus_ == MbusState::SCAN_SELECT || mbus_ == MbusState::SCAN_READ)
+    return advanceMbusScan(mbusBytes_ > 0);
+
+  if (mbusAttempts_++ < cfg_.mbus->retries) {
+    masterLogger_->debug("{}: No answer from M-Bus meter '{}', retrying",
+                         label_, mbusTargets_[mbusIndex_].name);
+    return mbus_ == MbusState::REQUEST ? requestMbusData() : pollMbusTarget();
+  }
+  return nextMbusTarget(false);
+}
+
+std::expected<void, ModbusError>
+MeterMaster::sendMbus(const std::string &frame, MbusState state) {
+  framer_.reset();
+  auto result = writeSerial(frame);
+  if (!result)
+    return result;
+
+  mbus_ = state;
+  mbusBytes_ = 0;
+  deadline_ = Clock::now() +
+              std::chrono::seconds(cfg_.mbus->responseTimeout.sec) +
+              std::chrono::microseconds(cfg_.mbus->responseTimeout.usec);
+  return {};
+}
+
+std::expected<void, ModbusError> MeterMaster::pollMbusTarget(void) {
+  // The first cycle ends with the scan, the identification numbers of
+  // meters with a primary address are known by then
+  if (mbusIndex_ >= mbusTargets_.size() && cfg_.mbus->scan && !mbusScanned_) {
+    masterLogger_->info("{}: Scanning M-Bus for secondary addresses", label_);
+    mbusScan_.assign(16, 'F');
+    mbusScan_[0] = '0';
+    mbusScanDigit_ = 0;
+    return sendMbus(MbusDecoder::selectFrame(mbusScan_),
+                    MbusState::SCAN_SELECT);
+  }
+
+  // End of the cycle, sleep until the next one
+  if (mbusIndex_ >= mbusTargets_.size()) {
+    mbus_ = MbusState::IDLE;
+    deadline_ = nextReadout_;
+    return {};
+  }
+
+  // Both SND_NKE and a selection reset the frame count bit
+  MbusTarget &target = mbusTargets_[mbusIndex_];
+  target.fcb = true;
+  mbusTelegrams_ = 0;
+  mbusRecords_ = json::array();
+  mbusValues_ = MeterTypes::Values{};
+
+  if (target.address >= 0) {
+    return sendMbus(MbusDecoder::shortFrame(MbusDecoder::SND_NKE,
+                                            static_cast<uint8_t>(
+                                                target.address)),
+                    MbusState::RESET);
+  }
+  return sendMbus(MbusDecoder::selectFrame(target.secondary),
+                  MbusState::SELECT);
+}
+
+std::expected<void, ModbusError> MeterMaster::requestMbusData(void) {
+  const MbusTarget &target = mbusTargets_[mbusIndex_];
+  const uint8_t address = target.address >= 0
+                              ? static_cast<uint8_t>(target.address)
+                              : MbusDecoder::ADDRESS_SECONDARY;
+  const uint8_t control =
+      MbusDecoder::REQ_UD2 | (target.fcb ? MbusDecoder::FCB : 0);
+
+  return sendMbus(MbusDecoder::shortFrame(control, address),
+                  MbusState::REQUEST);
+}
+
+std::expected<void, ModbusError> MeterMaster::nextMbusTarget(bool answered) {
+  MbusTarget &target = mbusTargets_[mbusIndex_];
+
+  // Warn once per outage, the meter is tried again every cycle
+  if (!answered) {
+    if (!target.missing) {
+      masterLogger_->warn("{}: M-Bus meter '{}' did not answer", label_,
+                          target.name);
+      target.missing = true;
+    }
+    if (target.online) {
+      target.online = false;
+      std::lock_guard<std::mutex> lock(cbMutex_);
+      if (availabilityCallback_)
+        availabilityCallback_(target.name, "disconnected");
+    }
+  }
+
+  ++mbusIndex_;
+  mbusAttempts_ = 0;
+  return pollMbusTarget();
+}
+
+std::expected<void, ModbusError>
+MeterMaster::receiveMbus(std::string_view chunk) {
+  // The answer is over once the line has been quiet for the response timeout
+  mbusBytes_ += chunk.size();
+  if (mbus_ != MbusState::IDLE) {
+    deadline_ = Clock::now() +
+                std::chrono::seconds(cfg_.mbus->responseTimeout.sec) +
+                std::chrono::microseconds(cfg_.mbus->responseTimeout.usec);
+  }
+
+  if (framer_.push(chunk) != TelegramFramer::Status::COMPLETE)
+    return {};
+
+  // Each request resets the framer, frames left over were not asked for
+  while (framer_.ready()) {
+    auto result = receiveMbusFrame(framer_.take());
+    if (!result)
+      return result;
+  }
+  return {};
+}
+
+std::expected<void, ModbusError>
+MeterMaster::receiveMbusFrame(const std::string &frame) {
+  const bool ack = frame.size() == 1 && frame[0] == MbusDecoder::ACK;
+
+  switch (mbus_) {
+  case MbusState::RESET:
+  case MbusState::SELECT:
+    return ack ? requestMbusData() : std::expected<void, ModbusError>{};
+  case MbusState::REQUEST:
+    return ack ? std::expected<void, ModbusError>{} : receiveMbusData(frame);
+  case MbusState::SCAN_SELECT:
+    // A single acknowledgement may still be two meters answering in step
+    if (!ack)
+      return {};
+    return sendMbus(MbusDecoder::shortFrame(MbusDecoder::REQ_UD2 |
+                                                MbusDecoder::FCB,
+                                            MbusDecoder::ADDRESS_SECONDARY),
+                    MbusState::SCAN_READ);
+  case MbusState::SCAN_READ: {
+    auto header = MbusDecoder::decode(frame, [](const auto &) {});
+    if (!header)
+      return advanceMbusScan(true);
+    addScannedTarget(*header);
+    return advanceMbusScan(false);
+  }
+  default:
+    return {}; // stray bytes between two cycles
+  }
+}
+
+std::expected<void, ModbusError>
+MeterMaster::receiveMbusData(std::string_view frame) {
+  MbusTarget &target = mbusTargets_[mbusIndex_];
+
+  auto header = MbusDecoder::decode(frame, [&](const MbusDecoder::Record &r) {
+    json record;
+    record["quantity"] = r.quantity;
+    if (r.numeric)
+      record["value"] = JsonUtils::roundTo(r.value, 6);
+    else
+      record["value"] = r.text;
+    record["unit"] = r.unit;
+    record["storage"] = r.storage;
+    record["tariff"] = r.tariff;
+    record["subunit"] = r.subunit;
+    record["function"] = MBUS_FUNCTIONS[r.function];
+    mbusRecords_.push_back(std::move(record));
+
+    // Current values also go to the sinks as sub-meter channels
+    if (r.numeric && r.storage == 0 && r.function == 0) {
+      MeterTypes::Channel channel;
+      channel.id = static_cast<int>(mbusValues_.channels.size());
+      channel.value = r.value;
+      channel.unit = r.unit;
+      mbusValues_.channels.push_back(std::move(channel));
+    }
+  });
+
+  if (!header) {
+    // Retry the same request, the frame count bit stays as it is
+    masterLogger_->warn("{}: M-Bus meter '{}': {}", label_, target.name,
+                        header.error().message());
+    if (mbusAttempts_++ < cfg_.mbus->retries)
+      return requestMbusData();
+    return nextMbusTarget(false);
+  }
+
+  // Multi-telegram answer: toggle the frame count bit to get the next one
+  target.fcb = !target.fcb;
+  if (header->moreFollows && ++mbusTelegrams_ < MBUS_MAX_TELEGRAMS) {
+    mbusAttempts_ = 0;
+    return requestMbusData();
+  }
+
+  publishMbus(target, *header);
+  return nextMbusTarget(true);
+}
+
+std::expected<void, ModbusError>
+MeterMaster::advanceMbusScan(bool collision) {
+  // Several meters match the pattern, fix the next digit as well
+  if (collision && mbusScanDigit_ < 7) {
+    mbusScan_[++mbusScanDigit_] = '0';
+    return sendMbus(MbusDecoder::selectFrame(mbusScan_),
+                    MbusState::SCAN_SELECT);
+  }
+  if (collision) {
+    masterLogger_->warn("{}: M-Bus meters collide at identification {}",
+                        label_, mbusScan_.substr(0, 8));
+  }
+
+  // Next value of the last fixed digit, back up when it is exhausted
+  while (mbusScanDigit_ >= 0) {
+    char &digit = mbusScan_[mbusScanDigit_];
+    if (digit < '9') {
+      ++digit;
+      return sendMbus(MbusDecoder::selectFrame(mbusScan_),
+                      MbusState::SCAN_SELECT);
+    }
+    digit = 'F';
+    --mbusScanDigit_;
+  }
+
+  // Meters found by the scan are read right away
+  mbusScanned_ = true;
+  masterLogger_->info("{}: M-Bus scan done, polling {} meter(s)", label_,
+                      mbusTargets_.size());
+  return pollMbusTarget();
+}
+
+void MeterMaster::addScannedTarget(const MbusDecoder::Header &header) {
+  const std::string secondary = header.secondaryAddress();
+  masterLogger_->info("{}: Found M-Bus meter {} ({} {}, version {})", label_,
+                      secondary, header.manufacturer,
+                      MbusDecoder::mediumName(header.medium), header.version);
+
+  // Configured meters keep their name
+  for (const auto &target : mbusTargets_) {
+    if (target.id == header.id || target.name == header.id ||
+        (target.address < 0 && target.secondary.starts_with(header.id)))
+      return;
+  }
+  MbusTarget target;
+  target.name = header.id;
+  target.secondary = secondary;
+  target.id = header.id;
+  mbusTargets_.push_back(std::move(target));
+}
+
+void MeterMaster::publishMbus(MbusTarget &target,
+                              const MbusDecoder::Header &header) {
+  const uint64_t now =
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+          std::chrono::system_clock::now().time_since_epoch())
+          .count();
+
+  const char *medium = MbusDecoder::mediumName(header.medium);
+  target.id = header.id;
+  target.missing = false;
+  mbusValues_.time = now;
+  for (auto &channel : mbusValues_.channels) {
+    channel.medium = header.medium;
+    channel.serialNumber = header.id;
+    channel.time = now;
+  }
+
+  json values;
+  values["time"] = now;
+  values["id"] = header.id;
+  values["manufacturer"] = header.manufacturer;
+  values["medium"] = medium;
+  values["access"] = header.access;
+  values["status"] = header.status;
+  values["records"] = std::move(mbusRecords_);
+  mbusRecords_ = json::array();
+
+  MeterTypes::Device device;
+  device.manufacturer = header.manufacturer;
+  device.model = medium;
+  device.serialNumber = header.id;
+  device.fwVersion = std::to_string(header.version);
+
+  masterLogger_->debug("{}: M-Bus meter '{}' read, {} records", label_,
+                       target.name, values["records"].size());
+
+  if (!handler_.isRunning())
+    return;
+
+  std::lock_guard<std::mutex> lock(cbMutex_);
+  if (!target.online) {
+    target.online = true;
+    if (availabilityCallback_)
+      availabilityCallback_(target.name, "connected");
+    if (deviceCallback_)
+      deviceCallback_(target.name, buildDeviceJson(device).dump(), device);
+  }
+  if (updateCallback_) {
+    std::string payload = values.dump();
+    PROBE(dispatch, target.name.c_str(), payload.size());
+    const size_t length = payload.size();
+    const auto start = Clock::now();
+    updateCallback_(target.name, std::move(payload), std::move(mbusValues_));
+    recordCallback(length, start);
+  }
+  mbusValues_ = MeterTypes::Values{};
+}
+
+std::expected<void, ModbusError>
+MeterMaster::processTelegram(std::string telegram) {
+  std::expected<void, ModbusError> result;
+
+  {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    if (telegramCallback_)
+      telegramCallback_("", telegram);
+  }
+  if (decryptor_)
+    result = decryptFrame(telegram);
+
+  const auto protocol = static_cast<int>(cfg_.protocol);
+  const auto parseStart = Clock::now();
+  PROBE(parse_start, protocol, telegram.size());
+
+  if (!result) {
+    // Handled below like any other telegram error
+  } else if (cfg_.protocol == MeterProtocol::Sml) {
+    masterLogger_->trace("Received SML file (len {})", telegram.size());
+    result = updateFromSml(telegram);
+  } else if (cfg_.protocol == MeterProtocol::Dsmr) {
+    masterLogger_->trace("Received telegram (len {}):\n{}", telegram.size(),
+                         telegram);
+    result = updateFromDsmr(telegram);
+  } else if (cfg_.iec) {
+    masterLogger_->trace("Received readout (len {}):\n{}", telegram.size(),
+                         telegram);
+    result = updateFromIec(telegram);
+  } else {
+    masterLogger_->trace("Received telegram (len {}):\n{}", telegram.size(),
+                         telegram);
+    {
+      std::lock_guard<std::mutex> lock(cbMutex_);
+      telegram_ = std::move(telegram);
+    }
+    result = updateDeviceAndJson();
+    if (result)
+      result = updateValuesAndJson();
+  }
+  const int64_t parseUs =
+      std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() -
+                                                            parseStart)
+          .count();
+  PROBE(parse_end, protocol, result.has_value(), parseUs);
+  FlightRecorder::record(FlightRecorder::Event::PARSE, protocol,
+                         result.has_value(), parseUs);
+  if (!result)
+    return result;
+  if (decryptor_)
+    decryptor_->accept();
+
+  if (handler_.isRunning()) {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    if (deviceCallback_) {
+      deviceCallback_("", jsonDevice_.dump(), device_);
+    }
+    if (updateCallback_) {
+      std::string payload = jsonValues_.dump();
+      PROBE(dispatch, cfg_.name.c_str(), payload.size());
+      const size_t length = payload.size();
+      const auto start = Clock::now();
+      updateCallback_("", std::move(payload), values_);
+      recordCallback(length, start);
+    }
+  }
+
+  connectFailures_ = 0;
+  linkErrors_ = 0;
+  return {};
+}
+
+std::expected<void, ModbusError>
+MeterMaster::decryptFrame(std::string &frame) {
+  std::optional<DecryptionConfig> keys;
+  {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    keys.swap(pendingKeys_);
+  }
+  if (keys) {
+    auto result = decryptor_->setKeys(keys->key, keys->authKey);
+    if (!result)
+      return result;
+    masterLogger_->debug("{}: Decryption keys set", label_);
+  }
+
+  const auto start = Clock::now();
+  auto result = decryptor_->decrypt(frame);
+  if (!result)
+    return result;
+
+  masterLogger_->trace(
+      "Decrypted frame {} (len {}) in {} us", decryptor_->frameCounter(),
+      frame.size(),
+      std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() -
+                                                            start)
+          .count());
+  return {};
+}
+
+// --- MeterReactor::Source ---
+
+int MeterMaster::fd(void) const {
+  if (link_ == LinkState::DISCONNECTED)
+    return hotplugFd_;
+  return socket_ != -1 ? socket_ : serialPort_;
+}
+
+uint32_t MeterMaster::events(void) const {
+  return link_ == LinkState::CONNECTING ? EPOLLOUT : EPOLLIN;
+}
+
+void MeterMaster::onEvent(uint32_t events) {
+  if (link_ == LinkState::DISCONNECTED) {
+    onHotplug();
+    return;
+  }
+  if (link_ == LinkState::CONNECTING) {
+    handleLinkResult(finishConnect());
+    return;
+  }
+
+  // Hangup without pending data, e.g. USB adapter unplugged
+  if ((events & (EPOLLERR | EPOLLHUP)) && !(events & EPOLLIN)) {
+    handleLinkResult(std::unexpected(
+        ModbusError::custom(ECONNRESET, "onEvent(): Meter connection lost")));
+    return;
+  }
+
+  handleLinkResult(readAvailable());
+}
+
+void MeterMaster::onTimer(Clock::time_point now) {
+  if (now >= metricsDeadline_) {
+    publishLineMetrics();
+    metricsDeadline_ =
+        now + std::chrono::seconds(cfg_.telegram.metricsInterval);
+    if (now < deadline_)
+      return;
+  }
+
+  switch (link_) {
+  case LinkState::DISCONNECTED:
+    handleLinkResult(tryConnect());
+    break;
+  case LinkState::CONNECTING:
+    handleLinkResult(std::unexpected(
+        ModbusError::custom(ETIMEDOUT, "Connecting to '{}:{}' timed out",
+                            cfg_.tcp->host, cfg_.tcp->port)));
+    break;
+  case LinkState::CONNECTED:
+    if (mbus_ != MbusState::NONE) {
+      handleLinkResult(onMbusTimer());
+      break;
+    }
+    if (iec_ == IecState::IDLE) {
+      handleLinkResult(requestReadout());
+      break;
+    }
+    if (iec_ == IecState::SWITCH) {
+      handleLinkResult(switchBaud());
+      break;
+    }
+    if (now < readDeadline_) {
+      handleLinkResult(readAvailable());
+      break;
+    }
+    handleLinkResult(std::unexpected(ModbusError::custom(
+        ETIMEDOUT, "onTimer(): No data from meter for {} s",
+        cfg_.telegram.readTimeout)));
+    break;
+  }
+}
+
+namespace {
+
+// --- Recovery policy of a connected telegram source ---
+enum class Recovery : uint8_t {
+  RESYNC, // drop the frame, the framer hunts for the next start sequence
+  RETRY,  // keep the port and read (or sign on) again
+  REOPEN  // close the port and reconnect after the back-off
+};
+
+constexpr std::array<std::pair<int, Recovery>, 4> RECOVERY_POLICY{{
+    {EPROTO, Recovery::RESYNC},   // framing or parse error
+    {EBADMSG, Recovery::RESYNC},  // checksum, decryption, replay
+    {ENOBUFS, Recovery::RESYNC},  // value list too large
+    {ETIMEDOUT, Recovery::RETRY}, // no data within read_timeout
+}};
+
+// I/O errors and a vanished device or bridge need a new descriptor
+Recovery recoveryFor(int code) {
+  for (const auto &[errorCode, recovery] : RECOVERY_POLICY) {
+    if (errorCode == code)
+      return recovery;
+  }
+  return Recovery::REOPEN;
+}
+
+} // namespace
+
+bool MeterMaster::recover(const ModbusError &err) {
+  // A CRC error or a timeout is as much a glitch to capture as a reconnect
+  FlightRecorder::recordError(err);
+  const Recovery recovery = recoveryFor(err.code);
+  if (recovery == Recovery::REOPEN)
+    return false;
+
+  // Errors in a row without a good telegram point to the port after all
+  if (++linkErrors_ > cfg_.telegram.maxRetries) {
+    masterLogger_->warn("{}: {} errors in a row, reopening the port", label_,
+                        linkErrors_);
+    return false;
+  }
+
+  const auto now = Clock::now();
+  if (recovery == Recovery::RESYNC) {
+    recoverLog_.log(*masterLogger_, spdlog::level::warn, "{}: {}, dropped",
+                    label_, [&err] { return err.message(); });
+  } else {
+    recoverLog_.log(*masterLogger_, spdlog::level::warn,
+                    "{}: {}, retry {} of {}", label_,
+                    [&err] { return err.message(); }, linkErrors_,
+                    cfg_.telegram.maxRetries);
+    framer_.reset();
+    readDeadline_ = now + std::chrono::seconds(cfg_.telegram.readTimeout);
+    deadline_ = readDeadline_;
+  }
+
+  // Mode C starts over with a new sign-on, M-Bus waits for its own timeout
+  if (iec_ != IecState::NONE) {
+    iec_ = IecState::IDLE;
+    deadline_ = now;
+  }
+  return true;
+}
+
+void MeterMaster::handleLinkResult(std::expected<void, ModbusError> &&result) {
+  // Errors that leave the port usable are handled without a reconnect
+  const bool recoverable =
+      !result && link_ == LinkState::CONNECTED &&
+      result.error().severity == ModbusError::Severity::TRANSIENT;
+  if (recoverable && recover(result.error()))
+    return;
+
+  const int code = result ? 0 : result.error().code;
+  auto action = handleResult(std::move(result), recoverable);
+
+  if (action == MeterTypes::ErrorAction::RECONNECT) {
+    // Sleep until a missing tty is plugged in again instead of polling
+    if (!cfg_.tcp && access(cfg_.rtu->device.c_str(), F_OK) == -1 &&
+        watchDevice())
+      return;
+    const auto delay = reconnectDelay();
+    FlightRecorder::record(FlightRecorder::Event::RECONNECT, code,
+                           delay.count());
+    deadline_ = Clock::now() + delay;
+  } else if (action == MeterTypes::ErrorAction::SHUTDOWN) {
+    deadline_ = Clock::time_point::max();
+    metricsDeadline_ = Clock::time_point::max();
+  }
+}
+
+// --- Hot-plug: wait for the tty (or its by-id symlink) to reappear ---
+
+bool MeterMaster::watchDevice(void) {
+  // Deepest existing directory on the way, /dev/serial/by-id itself is
+  // removed together with the last USB serial adapter
+  std::string dir = cfg_.rtu->device;
+  do {
+    const auto slash = dir.rfind('/');
+    dir = slash == 0 || slash == std::string::npos ? "/" : dir.substr(0, slash);
+  } while (dir != "/" && access(dir.c_str(), F_OK) == -1);
+
+  const bool first = hotplugFd_ == -1;
+  if (first)
+    hotplugFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (hotplugFd_ == -1) {
+    masterLogger_->warn("{}: inotify unavailable, polling for '{}': {}",
+                        label_, cfg_.rtu->device, strerror(errno));
+    return false;
+  }
+
+  // One watch per inotify descriptor, a new one replaces the last
+  if (hotplugWatch_ != -1)
+    inotify_rm_watch(hotplugFd_, hotplugWatch_);
+  hotplugWatch_ = inotify_add_watch(hotplugFd_, dir.c_str(),
+                                    IN_CREATE | IN_MOVED_TO | IN_ATTRIB |
+                                        IN_ONLYDIR);
+  if (hotplugWatch_ == -1) {
+    masterLogger_->warn("{}: Unable to watch '{}', polling for '{}': {}",
+                        label_, dir, cfg_.rtu->device, strerror(errno));
+    unwatchDevice();
+    return false;
+  }
+
+  if (first) {
+    masterLogger_->info("{}: Waiting for '{}' to be plugged in", label_,
+                        cfg_.rtu->device);
+  }
+
+  // It may have appeared before the watch was set up
+  deadline_ = access(cfg_.rtu->device.c_str(), F_OK) == 0
+                  ? Clock::now()
+                  : Clock::time_point::max();
+  return true;
+}
+
+void MeterMaster::unwatchDevice(void) {
+  if (hotplugFd_ != -1) {
+    close(hotplugFd_);
+    ++fdGeneration_;
+  }
+  hotplugFd_ = -1;
+  hotplugWatch_ = -1;
+}
+
+void MeterMaster::onHotplug(void) {
+  // The names do not matter, the whole path is checked below
+  alignas(inotify_event) std::array<char, 4096> events;
+  while (read(hotplugFd_, events.data(), events.size()) > 0) {
+  }
+
+  // udev sets owner and mode after creating the node (IN_ATTRIB)
+  const int mode = cfg_.iec || cfg_.mbus ? R_OK | W_OK : R_OK;
+  if (access(cfg_.rtu->device.c_str(), mode) == 0) {
+    masterLogger_->info("{}: '{}' plugged in", label_, cfg_.rtu->device);
+    unwatchDevice();
+    connectFailures_ = 0;
+    deadline_ = Clock::now();
+    return;
+  }
+
+  // A directory on the way may have appeared, e.g. /dev/serial/by-id
+  if (!watchDevice()) {
+    unwatchDevice();
+    deadline_ = Clock::now() + reconnectDelay();
+  }
+}
+
+void MeterMaster::publishLineMetrics(void) {
+  const auto &stats = framer_.stats();
+  json metrics;
+  metrics["time"] = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        std::chrono::system_clock::now().time_since_epoch())
+                        .count();
+  metrics["source"] = cfg_.tcp
+                          ? std::format("{}:{}", cfg_.tcp->host, cfg_.tcp->port)
+                          : cfg_.rtu->device;
+  metrics["state"] =
+      link_ == LinkState::CONNECTED ? "connected" : "disconnected";
+  metrics["bytes"] = stats.bytes;
+  metrics["telegrams"] = stats.telegrams;
+  metrics["framer"] = {
+      {"parity_marked", stats.parityErrors},
+      {"truncated", stats.truncated},
+      {"overflows", stats.overflows},
+      {"resyncs", stats.resyncs},
+      {"discarded_bytes", stats.discarded},
+  };
+
+  // Driver counters since the UART was probed, ptys and bridges have none
+  uint64_t errors = stats.parityErrors - parityMarked_;
+  std::optional<uint64_t> uartErrors;
+  struct serial_icounter_struct icount{};
+  if (serialPort_ != -1 && ioctl(serialPort_, TIOCGICOUNT, &icount) == 0) {
+    metrics["uart"] = {
+        {"rx", icount.rx},
+        {"frame", icount.frame},
+        {"parity", icount.parity},
+        {"overrun", icount.overrun},
+        {"break", icount.brk},
+        {"buffer_overrun", icount.buf_overrun},
+    };
+    uartErrors = static_cast<uint64_t>(icount.frame) + icount.parity +
+                 icount.overrun + icount.brk + icount.buf_overrun;
+
+    // The marked bytes are counted by the driver as well
+    if (uartErrors_ && *uartErrors > *uartErrors_)
+      errors = std::max(errors, *uartErrors - *uartErrors_);
+  }
+  parityMarked_ = stats.parityErrors;
+  uartErrors_ = uartErrors;
+
+  // A failing cable or optical head shows up here long before telegrams go
+  // missing
+  if (errors) {
+    masterLogger_->warn("{}: {} line error(s) in the last {} s, check the "
+                        "cable, the optical head and the baud rate",
+                        label_, errors, cfg_.telegram.metricsInterval);
+  }
+
+  masterLogger_->debug("{}", metrics.dump());
+
+  std::lock_guard<std::mutex> lock(cbMutex_);
+  if (metricsCallback_)
+    metricsCallback_(metrics.dump());
+}
+
+std::expected<void, ModbusError> MeterMaster::updateValuesAndJson() {
+  if (!handler_.isRunning()) {
+    return std::unexpected(ModbusError::custom(
+        EINTR, "updateValuesAndJson(): Shutdown in progress"));
+  }
+  {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    if (telegram_.empty())
+      return {};
+  }
+
+  MeterTypes::Values values{};
+
+  std::istringstream iss;
+  {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    iss.str(telegram_);
+  }
+
+  values.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count();
+  double activeEnergy;
+
+  std::regex obexRegex(R"(^([0-9]-0:[0-9]+.[0-9]+.[0-9]+\*255)\(([^)]+)\))");
+  std::string line;
+
+  int lineNum = 0;
+  while (std::getline(iss, line)) {
+    ++lineNum;
+    line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+
+    if (line.empty() || (line.size() && (line[0] == '/' || line[0] == '!')))
+      continue;
+
+    try {
+      std::smatch match;
+      if (!std::regex_search(line, match, obexRegex))
+        throw std::invalid_argument("Malformed OBEX expression");
+
+      std::string obis = match[1];
+      std::string value_unit = match[2];
+
+      if (obis == "1-0:1.8.0*255") {
+        size_t pos = value_unit.find("*");
+        activeEnergy = std::stod(value_unit.substr(0, pos));
+      } else if (obis == "1-0:16.7.0*255") {
+        size_t pos = value_unit.find("*");
+        values.activePower = std::stod(value_unit.substr(0, pos));
+      } else if (obis == "1-0:36.7.0*255") {
+        size_t pos = value_unit.find("*");
+        values.phase1.activePower = std::stod(value_unit.substr(0, pos));
+      } else if (obis == "1-0:56.7.0*255") {
+        size_t pos = value_unit.find("*");
+        values.phase2.activePower = std::stod(value_unit.substr(0, pos));
+      } else if (obis == "1-0:76.7.0*255") {
+        size_t pos = value_unit.find("*");
+        values.phase3.activePower = std::stod(value_unit.substr(0, pos));
+      } else if (obis == "1-0:32.7.0*255") {
+        size_t pos = value_unit.find("*");
+        values.phase1.phVoltage = std::stod(value_unit.substr(0, pos));
+      } else if (obis == "1-0:52.7.0*255") {
+        size_t pos = value_unit.find("*");
+        values.phase2.phVoltage = std::stod(value_unit.substr(0, pos));
+      } else if (obis == "1-0:72.7.0*255") {
+        size_t pos = value_unit.find("*");
+        values.phase3.phVoltage = std::stod(value_unit.substr(0, pos));
+      } else if (obis == "0-0:96.8.0*255") {
+        size_t pos = value_unit.find("*");
+        values.activeSensorTime =
+            std::stoul(value_unit.substr(0, pos), nullptr, 16);
+      }
+    } catch (const std::exception &err) {
+      return std::unexpected(
+          ModbusError::custom(EPROTO, "[{}]: {}", line, err.what()));
+    }
+  }
+
+  // active power and energy — direction from power factor sign
+  const double powerFactor = currentGrid().powerFactor;
+  const double powerSign = powerFactor > 0.0 ? 1.0 : -1.0;
+  values.activePower *= powerSign;
+  values.phase1.activePower *= powerSign;
+  values.phase2.activePower *= powerSign;
+  values.phase3.activePower *= powerSign;
+  values.activeEnergyImport = powerFactor > 0.0 ? activeEnergy : 0.0;
+  values.activeEnergyExport = powerFactor < 0.0 ? activeEnergy : 0.0;
+
+  deriveValues(values);
+
+  json newJson = buildValuesJson(values);
+
+  // Update shared values and JSON with lock
+  {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    values_ = std::move(values);
+    jsonValues_ = std::move(newJson);
+  }
+
+  masterLogger_->debug("{}", jsonValues_.dump());
+
+  return {};
+}
+
+// Complete the measured active power, voltages and energies with the
+// quantities derived from the assumed grid power factor
+void MeterMaster::deriveValues(MeterTypes::Values &values) const {
+  const GridConfig grid = currentGrid();
+  const bool isLeading = grid.isLeading;
+  values.powerFactor = grid.powerFactor;
+  if (values.frequency == 0.0)
+    values.frequency = grid.frequency;
+
+  values.phase1.powerFactor = values.powerFactor;
+  values.phase2.powerFactor = values.powerFactor;
+  values.phase3.powerFactor = values.powerFactor;
+
+  const auto apparentPower = [](double active, double pf) {
+    return std::abs(active / pf);
+  };
+
+  const double sign = isLeading ? -1.0 : 1.0;
+  const auto reactivePower = [sign](double active, double pf) {
+    return sign * std::tan(std::acos(std::abs(pf))) * active;
+  };
+
+  // apparent power
+  values.apparentPower = apparentPower(values.activePower, values.powerFactor);
+  values.phase1.apparentPower =
+      apparentPower(values.phase1.activePower, values.powerFactor);
+  values.phase2.apparentPower =
+      apparentPower(values.phase2.activePower, values.powerFactor);
+  values.phase3.apparentPower =
+      apparentPower(values.phase3.activePower, values.powerFactor);
+
+  // reactive power
+  values.reactivePower = reactivePower(values.activePower, values.powerFactor);
+  values.phase1.reactivePower =
+      reactivePower(values.phase1.activePower, values.powerFactor);
+  values.phase2.reactivePower =
+      reactivePower(values.phase2.activePower, values.powerFactor);
+  values.phase3.reactivePower =
+      reactivePower(values.phase3.activePower, values.powerFactor);
+
+  // apparent energy — magnitude only, direction from isLeading
+  const double activeEnergy =
+      values.activeEnergyImport + values.activeEnergyExport;
+  const double apparentEnergy = std::abs(activeEnergy / values.powerFactor);
+  values.apparentEnergyImport = isLeading ? 0.0 : apparentEnergy;
+  values.apparentEnergyExport = isLeading ? apparentEnergy : 0.0;
+
+  // reactive energy — magnitude only, direction from isLeading
+  const double phi = std::acos(std::abs(values.powerFactor));
+  const double reactiveEnergy = std::sin(phi) * apparentEnergy;
+  values.reactiveEnergyImport = isLeading ? 0.0 : reactiveEnergy;
+  values.reactiveEnergyExport = isLeading ? reactiveEnergy : 0.0;
+
+  // voltages
+  const auto ppVoltage = [](double va, double vb) {
+    return std::sqrt(va * va + vb * vb + va * vb);
+  };
+
+  values.phVoltage = (values.phase1.phVoltage + values.phase2.phVoltage +
+                      values.phase3.phVoltage) /
+                     3.0;
+
+  values.phase1.ppVoltage =
+      ppVoltage(values.phase1.phVoltage, values.phase2.phVoltage);
+  values.phase2.ppVoltage =
+      ppVoltage(values.phase2.phVoltage, values.phase3.phVoltage);
+  values.phase3.ppVoltage =
+      ppVoltage(values.phase3.phVoltage, values.phase1.phVoltage);
+
+  values.ppVoltage = (values.phase1.ppVoltage + values.phase2.ppVoltage +
+                      values.phase3.ppVoltage) /
+                     3.0;
+
+  // currents
+  const auto phaseCurrent = [&values](double activePower, double phVoltage) {
+    if (phVoltage == 0.0)
+      return 0.0;
+    return std::abs(activePower / (phVoltage * values.powerFactor));
+  };
+
+  for (auto *phase : {&values.phase1, &values.phase2, &values.phase3}) {
+    if (phase->current == 0.0)
+      phase->current = phaseCurrent(phase->activePower, phase->phVoltage);
+  }
+  values.current =
+      values.phase1.current + values.phase2.current + values.phase3.current;
+}
+
+std::expected<void, ModbusError> MeterMaster::updateDeviceAndJson() {
+  if (!handler_.isRunning()) {
+    return std::unexpected(ModbusError::custom(
+        EINTR, "updateDeviceAndJson(): Shutdown in progress"));
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    if (telegram_.empty())
+      return {};
+  }
+
+  MeterTypes::Device newDevice{};
+
+  std::istringstream iss;
+  {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    iss.str(telegram_);
+  }
+
+  std::regex obexRegex(R"(^([0-9]-0:[0-9]+.[0-9]+.[0-9]+\*255)\(([^)]+)\))");
+  std::regex versionRegex(R"(^(\/[A-Za-z0-9]+)_([A-Za-z0-9]+)$)");
+  std::string line;
+
+  int lineNum = 0;
+  while (std::getline(iss, line)) {
+    ++lineNum;
+    line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+
+    if (line.empty() || line[0] == '!')
+      continue;
+
+    try {
+      // Version line
+      if (!line.empty() && line[0] == '/') {
+        std::smatch versionMatch;
+        if (!std::regex_search(line, versionMatch, versionRegex)) {
+          throw std::invalid_argument("Malformed version expression");
+        }
+        newDevice.fwVersion = versionMatch[2].str();
+        continue;
+      }
+
+      // OBEX line
+      std::smatch obexMatch;
+      if (!std::regex_search(line, obexMatch, obexRegex)) {
+        throw std::invalid_argument("Malformed OBEX expression");
+      }
+
+      std::string obis = obexMatch[1];
+      if (obis == "1-0:96.1.0*255") {
+        newDevice.serialNumber = obexMatch[2].str();
+      } else if (obis == "1-0:96.5.0*255") {
+        newDevice.status = obexMatch[2].str();
+      }
+
+    } catch (const std::exception &err) {
+      return std::unexpected(
+          ModbusError::custom(EPROTO, "[{}]: {}", line, err.what()));
+    }
+  }
+
+  newDevice.manufacturer = "EasyMeter";
+  newDevice.model = "DD3-BZ06-ETA-ODZ1";
+  newDevice.options = std::string(PROJECT_VERSION) + "-" + GIT_COMMIT_HASH;
+  newDevice.phases = 3;
+
+  json newJson = buildDeviceJson(newDevice);
+
+  masterLogger_->debug("{}", newJson.dump());
+
+  // ---- Commit values ----
+  {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    jsonDevice_ = std::move(newJson);
+    device_ = std::move(newDevice);
+  }
+
+  return {};
+}
+
+// --- SML (protocol sml) ---
+
+namespace {
+
+constexpr uint8_t SML_UNIT_WH = 30;
+
+// Electricity object names A=1, keyed by C.D.E
+constexpr uint32_t obisKey(uint8_t c, uint8_t d, uint8_t e) {
+  return static_cast<uint32_t>(c) << 16 | static_cast<uint32_t>(d) << 8 | e;
+}
+
+std::string toHex(std::string_view bytes) {
+  static constexpr char digits[] = "0123456789abcdef";
+  std::string hex;
+  hex.reserve(bytes.size() * 2);
+  for (unsigned char c : bytes) {
+    hex.push_back(digits[c >> 4]);
+    hex.push_back(digits[c & 0x0f]);
+  }
+  return hex;
+}
+
+bool isPrintable(std::string_view bytes) {
+  return !bytes.empty() && std::all_of(bytes.begin(), bytes.end(), [](char c) {
+    return c >= 0x20 && c < 0x7f;
+  });
+}
+
+} // namespace
+
+std::expected<void, ModbusError> MeterMaster::updateFromSml(std::string &file) {
+  if (!handler_.isRunning()) {
+    return std::unexpected(
+        ModbusError::custom(EINTR, "updateFromSml(): Shutdown in progress"));
+  }
+
+  MeterTypes::Values values{};
+  MeterTypes::Device newDevice{};
+  std::string_view serverId;
+  bool polyphase = false;
+
+  values.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count();
+
+  auto result = SmlDecoder::decode(file, [&](const SmlDecoder::Entry &entry) {
+    serverId = entry.serverId;
+    if (entry.obis.size() != 6)
+      return;
+    const auto *code =
+        reinterpret_cast<const unsigned char *>(entry.obis.data());
+
+    // Manufacturer, 129-129:199.130.3
+    if (code[0] == 129 && code[1] == 129 && code[2] == 199 &&
+        code[3] == 130 && code[4] == 3) {
+      newDevice.manufacturer = entry.octets;
+      return;
+    }
+    if (code[0] != 1)
+      return;
+
+    const uint32_t key = obisKey(code[2], code[3], code[4]);
+
+    // Device id, 1-0:96.1.0 or 1-0:0.0.9
+    if (!entry.numeric) {
+      if (key == obisKey(96, 1, 0) || key == obisKey(0, 0, 9)) {
+        newDevice.serialNumber = isPrintable(entry.octets)
+                                     ? std::string(entry.octets)
+                                     : toHex(entry.octets);
+      }
+      return;
+    }
+
+    double value = entry.scaled();
+    if (entry.unit == SML_UNIT_WH)
+      value /= 1000.0; // kWh like the OBIS telegrams
+
+    switch (key) {
+    case obisKey(1, 8, 0):
+      values.activeEnergyImport = value;
+      break;
+    case obisKey(2, 8, 0):
+      values.activeEnergyExport = value;
+      break;
+    case obisKey(16, 7, 0):
+      values.activePower = value;
+      break;
+    case obisKey(36, 7, 0):
+      values.phase1.activePower = value;
+      break;
+    case obisKey(56, 7, 0):
+      values.phase2.activePower = value;
+      break;
+    case obisKey(76, 7, 0):
+      values.phase3.activePower = value;
+      break;
+    case obisKey(32, 7, 0):
+      values.phase1.phVoltage = value;
+      break;
+    case obisKey(52, 7, 0):
+      values.phase2.phVoltage = value;
+      polyphase = true;
+      break;
+    case obisKey(72, 7, 0):
+      values.phase3.phVoltage = value;
+      polyphase = true;
+      break;
+    case obisKey(31, 7, 0):
+      values.phase1.current = value;
+      break;
+    case obisKey(51, 7, 0):
+      values.phase2.current = value;
+      break;
+    case obisKey(71, 7, 0):
+      values.phase3.current = value;
+      break;
+    case obisKey(14, 7, 0):
+      values.frequency = value;
+      break;
+    }
+  });
+  if (!result)
+    return result;
+
+  // Power is signed and the counters are split by direction already
+  deriveValues(values);
+
+  // The server id carries the FLAG manufacturer code in bytes 2..4
+  if (newDevice.manufacturer.empty() && serverId.size() >= 5 &&
+      isPrintable(serverId.substr(2, 3)))
+    newDevice.manufacturer = serverId.substr(2, 3);
+  if (newDevice.serialNumber.empty())
+    newDevice.serialNumber = toHex(serverId);
+  newDevice.model = "SML";
+  newDevice.options = std::string(PROJECT_VERSION) + "-" + GIT_COMMIT_HASH;
+  newDevice.phases = polyphase ? 3 : 1;
+
+  json newValuesJson = buildValuesJson(values);
+  json newDeviceJson = buildDeviceJson(newDevice);
+
+  {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    values_ = std::move(values);
+    jsonValues_ = std::move(newValuesJson);
+    device_ = std::move(newDevice);
+    jsonDevice_ = std::move(newDeviceJson);
+  }
+
+  masterLogger_->debug("{}", jsonDevice_.dump());
+  masterLogger_->debug("{}", jsonValues_.dump());
+
+  return {};
+}
+
+// --- DSMR P1 (protocol dsmr) ---
+
+namespace {
+
+// "0-1:24.2.1(230101120000W)(01234.567*m3)" split into id and value groups
+struct DsmrLine {
+  std::string_view id;
+  std::array<std::string_view, 2> groups;
+  size_t count{0};
+};
+
+bool splitDsmrLine(std::string_view line, DsmrLine &out) {
+  const size_t open = line.find('(');
+  if (open == std::string_view::npos || open == 0)
+    return false;
+  out.id = line.substr(0, open);
+  out.count = 0;
+
+  size_t pos = open;
+  while (pos < line.size() && line[pos] == '(') {
+    const size_t close = line.find(')', pos);
+    if (close == std::string_view::npos)
+      return false;
+    // Keep the last two groups, e.g. timestamp and value of a channel
+    if (out.count == out.groups.size()) {
+      out.groups[0] = out.groups[1];
+      --out.count;
+    }
+    out.groups[out.count++] = line.substr(pos + 1, close - pos - 1);
+    pos = close + 1;
+  }
+  return out.count > 0;
+}
+
+// "001234.567*kWh" → 1234.567, unit "kWh"
+bool parseDsmrNumber(std::string_view group, double &value,
+                     std::string_view *unit = nullptr) {
+  const size_t star = group.find('*');
+  const std::string_view number = group.substr(0, star);
+  auto [ptr, ec] =
+      std::from_chars(number.data(), number.data() + number.size(), value);
+  if (ec != std::errc() || ptr != number.data() + number.size())
+    return false;
+  if (unit)
+    *unit = star == std::string_view::npos ? std::string_view()
+                                           : group.substr(star + 1);
+  return true;
+}
+
+// "YYMMDDhhmmssX", X = S (CEST) or W (CET) → Unix time in ms
+uint64_t parseDsmrTime(std::string_view group) {
+  if (group.size() != 13)
+    return 0;
+  int digits[12];
+  for (size_t i = 0; i < 12; ++i) {
+    if (group[i] < '0' || group[i] > '9')
+      return 0;
+    digits[i] = group[i] - '0';
+  }
+  const auto field = [&digits](int i) {
+    return digits[i] * 10 + digits[i + 1];
+  };
+
+  std::tm tm{};
+  tm.tm_year = 100 + field(0);
+  tm.tm_mon = field(2) - 1;
+  tm.tm_mday = field(4);
+  tm.tm_hour = field(6);
+  tm.tm_min = field(8);
+  tm.tm_sec = field(10);
+  const int offset = group[12] == 'S' ? 2 * 3600 : 3600;
+  return static_cast<uint64_t>(timegm(&tm) - offset) * 1000;
+}
+
+// Equipment identifiers are sent as hex encoded ASCII
+std::string decodeDsmrHex(std::string_view hex) {
+  std::string text;
+  if (hex.size() % 2 != 0)
+    return std::string(hex);
+  for (size_t i = 0; i < hex.size(); i += 2) {
+    unsigned int c = 0;
+    auto [ptr, ec] = std::from_chars(hex.data() + i, hex.data() + i + 2, c, 16);
+    if (ec != std::errc() || ptr != hex.data() + i + 2 || c < 0x20 ||
+        c >= 0x7f)
+      return std::string(hex);
+    text.push_back(static_cast<char>(c));
+  }
+  return text;
+}
+
+} // namespace
+
+std::expected<void, ModbusError>
+MeterMaster::updateFromDsmr(std::string_view telegram) {
+  if (!handler_.isRunning()) {
+    return std::unexpected(
+        ModbusError::custom(EINTR, "updateFromDsmr(): Shutdown in progress"));
+  }
+
+  // The CRC covers everything from '/' up to and including '!'
+  const size_t bang = telegram.rfind('!');
+  if (bang == std::string_view::npos) {
+    return std::unexpected(
+        ModbusError::custom(EPROTO, "updateFromDsmr(): Missing trailer"));
+  }
+  std::string_view trailer = telegram.substr(bang + 1);
+  trailer = trailer.substr(0, trailer.find_last_not_of("\r\n") + 1);
+
+  // Only DSMR 2.2/3 has no CRC, anything else has to be four hex digits
+  if (!trailer.empty()) {
+    const bool hex =
+        trailer.size() == 4 &&
+        std::all_of(trailer.begin(), trailer.end(), [](char c) {
+          return std::isxdigit(static_cast<unsigned char>(c));
+        });
+    if (!hex) {
+      return std::unexpected(ModbusError::custom(
+          EBADMSG, "updateFromDsmr(): Malformed CRC ({} bytes)",
+          trailer.size()));
+    }
+    unsigned int received = 0;
+    std::from_chars(trailer.data(), trailer.data() + 4, received, 16);
+    const uint16_t computed = Crc16::arc(telegram.substr(0, bang + 1));
+    if (received != computed) {
+      return std::unexpected(ModbusError::custom(
+          EBADMSG, "updateFromDsmr(): CRC mismatch (received {}, computed "
+                   "{:04X})",
+          trailer, computed));
+    }
+  }
+
+  MeterTypes::Values values{};
+  MeterTypes::Device newDevice{};
+  double powerImport = 0.0;
+  double powerExport = 0.0;
+  MeterTypes::Phase *phases[] = {&values.phase1, &values.phase2,
+                                 &values.phase3};
+
+  values.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count();
+
+  const auto channel = [&values](int id) -> MeterTypes::Channel & {
+    for (auto &ch : values.channels) {
+      if (ch.id == id)
+        return ch;
+    }
+    values.channels.push_back({});
+    values.channels.back().id = id;
+    return values.channels.back();
+  };
+
+  size_t pos = 0;
+  while (pos < bang) {
+    size_t eol = telegram.find('\n', pos);
+    if (eol == std::string_view::npos || eol > bang)
+      eol = bang;
+    std::string_view line = telegram.substr(pos, eol - pos);
+    pos = eol + 1;
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+    if (line.empty())
+      continue;
+
+    // Header "/ISK5\2M550T-1012": FLAG manufacturer id, baud rate, model
+    if (line[0] == '/') {
+      newDevice.manufacturer = line.substr(1, 3);
+      const size_t backslash = line.find('\\');
+      if (backslash != std::string_view::npos && backslash + 2 <= line.size())
+        newDevice.model = line.substr(backslash + 2);
+      continue;
+    }
+
+    DsmrLine fields;
+    if (!splitDsmrLine(line, fields)) {
+      return std::unexpected(ModbusError::custom(
+          EPROTO, "updateFromDsmr(): Malformed line [{}]", line));
+    }
+    const std::string_view id = fields.id;
+    const std::string_view group = fields.groups[fields.count - 1];
+    double value = 0.0;
+
+    // M-Bus channels 0-n:..., n = 1..4
+    if (id.size() > 4 && id[0] == '0' && id[1] == '-' && id[2] >= '1' &&
+        id[2] <= '4' && id[3] == ':') {
+      auto &ch = channel(id[2] - '0');
+      const std::string_view code = id.substr(4);
+      std::string_view unit;
+      if (code == "24.1.0") {
+        std::from_chars(group.data(), group.data() + group.size(), ch.medium);
+      } else if (code == "96.1.0") {
+        ch.serialNumber = decodeDsmrHex(group);
+      } else if ((code == "24.2.1" || code == "24.2.3") &&
+                 parseDsmrNumber(group, ch.value, &unit)) {
+        ch.unit = unit;
+        if (fields.count == 2)
+          ch.time = parseDsmrTime(fields.groups[0]);
+      }
+      continue;
+    }
+
+    if (id == "1-3:0.2.8") {
+      newDevice.fwVersion = group;
+    } else if (id == "0-0:96.1.1") {
+      newDevice.serialNumber = decodeDsmrHex(group);
+    } else if (id == "0-0:96.14.0") {
+      std::from_chars(group.data(), group.data() + group.size(),
+                      values.tariff);
+    } else if (id.starts_with("1-0:") && parseDsmrNumber(group, value)) {
+      const std::string_view code = id.substr(4);
+      if (code == "1.8.1" || code == "1.8.2") {
+        values.activeEnergyImport += value;
+      } else if (code == "2.8.1" || code == "2.8.2") {
+        values.activeEnergyExport += value;
+      } else if (code == "1.7.0") {
+        powerImport = value;
+      } else if (code == "2.7.0") {
+        powerExport = value;
+      } else if (code.ends_with(".7.0")) {
+        // Phases L1..L3 at C = 21/41/61 import, 22/42/62 export power (kW),
+        // 31/51/71 current, 32/52/72 voltage
+        int c = 0;
+        std::from_chars(code.data(), code.data() + code.size() - 4, c);
+        if (c < 21 || c > 72)
+          continue;
+        const int phase = (c - 21) / 20;
+        switch (c - 20 * phase) {
+        case 21:
+          phases[phase]->activePower += value * 1000.0;
+          break;
+        case 22:
+          phases[phase]->activePower -= value * 1000.0;
+          break;
+        case 31:
+          phases[phase]->current = value;
+          break;
+        case 32:
+          phases[phase]->phVoltage = value;
+          break;
+        }
+      }
+    }
+  }
+
+  values.activePower = (powerImport - powerExport) * 1000.0;
+
+  // Power is signed by direction, the counters are split already
+  deriveValues(values);
+
+  newDevice.options = std::string(PROJECT_VERSION) + "-" + GIT_COMMIT_HASH;
+  newDevice.phases = values.phase2.phVoltage > 0.0 ? 3 : 1;
+
+  json newValuesJson = buildValuesJson(values);
+  json newDeviceJson = buildDeviceJson(newDevice);
+
+  {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    values_ = std::move(values);
+    jsonValues_ = std::move(newValuesJson);
+    device_ = std::move(newDevice);
+    jsonDevice_ = std::move(newDeviceJson);
+  }
+
+  masterLogger_->debug("{}", jsonDevice_.dump());
+  masterLogger_->debug("{}", jsonValues_.dump());
+
+  return {};
+}
+
+// --- IEC 62056-21 mode C readout (protocol obis with iec) ---
+
+namespace {
+
+// "1-0:1.8.0*255" or "1.8.0" → "1.8.0"; group A-B and the billing period
+// F are optional in a readout. Values of past billing periods, e.g.
+// "1.8.0*03", give an empty code.
+std::string_view iecCode(std::string_view id) {
+  const size_t colon = id.find(':');
+  if (colon != std::string_view::npos)
+    id.remove_prefix(colon + 1);
+  const size_t star = id.find_first_of("*&");
+  if (star != std::string_view::npos && id.substr(star + 1) != "255")
+    return {};
+  return id.substr(0, star);
+}
+
+// Energies are published in kWh and power in W, whatever the meter sends
+double iecScale(std::string_view unit, bool energy) {
+  if (energy)
+    return unit == "Wh" ? 0.001 : 1.0;
+  return unit == "kW" ? 1000.0 : 1.0;
+}
+
+} // namespace
+
+std::expected<void, ModbusError>
+MeterMaster::updateFromIec(std::string_view telegram) {
+  if (!handler_.isRunning()) {
+    return std::unexpected(
+        ModbusError::custom(EINTR, "updateFromIec(): Shutdown in progress"));
+  }
+
+  MeterTypes::Values values{};
+  MeterTypes::Device newDevice{};
+  double energyImport[2] = {0.0, 0.0}; // total, sum of the tariffs
+  double energyExport[2] = {0.0, 0.0};
+  bool hasTotal[2] = {false, false};
+  std::optional<double> power;
+  double powerImport = 0.0;
+  double powerExport = 0.0;
+  size_t dataSets = 0;
+  MeterTypes::Phase *phases[] = {&values.phase1, &values.phase2,
+                                 &values.phase3};
+
+  values.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count();
+
+  size_t pos = 0;
+  while (pos < telegram.size()) {
+    size_t eol = telegram.find('\n', pos);
+    if (eol == std::string_view::npos)
+      eol = telegram.size();
+    std::string_view line = telegram.substr(pos, eol - pos);
+    pos = eol + 1;
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+    if (line.empty() || line[0] == '!')
+      continue;
+
+    // Identification "/ISk5MT174-0001": manufacturer, baud rate character
+    // and the model, "\W" of an enhanced identification skipped
+    if (line[0] == '/') {
+      newDevice.manufacturer = line.substr(1, 3);
+      std::string_view model = line.substr(std::min<size_t>(5, line.size()));
+      if (model.size() >= 2 && model[0] == '\\')
+        model.remove_prefix(2);
+      newDevice.model = model;
+      continue;
+    }
+
+    // Unknown or vendor specific data sets are skipped
+    DsmrLine fields;
+    if (!splitDsmrLine(line, fields))
+      continue;
+    ++dataSets;
+    const std::string_view code = iecCode(fields.id);
+    const std::string_view group = fields.groups[fields.count - 1];
+    std::string_view unit;
+    double value = 0.0;
+
+    if (code == "C.1.0" || code == "96.1.0" || code == "0.0.0") {
+      if (newDevice.serialNumber.empty() || code != "0.0.0")
+        newDevice.serialNumber = group;
+      continue;
+    }
+    if (code == "0.2.0" || code == "C.1.1") {
+      newDevice.fwVersion = group;
+      continue;
+    }
+    if (code == "96.14.0" || code == "C.52.0") {
+      std::from_chars(group.data(), group.data() + group.size(),
+                      values.tariff);
+      continue;
+    }
+    if (!parseDsmrNumber(group, value, &unit))
+      continue;
+
+    // Energy registers C.8.T, T = 0 total, 1..9 tariffs
+    if ((code.starts_with("1.8.") || code.starts_with("2.8.")) &&
+        code.size() == 5) {
+      const int direction = code[0] == '1' ? 0 : 1;
+      double *energy = direction == 0 ? energyImport : energyExport;
+      value *= iecScale(unit, true);
+      if (code[4] == '0') {
+        energy[0] = value;
+        hasTotal[direction] = true;
+      } else {
+        energy[1] += value;
+      }
+      continue;
+    }
+    if (!code.ends_with(".7.0"))
+      continue;
+
+    value *= iecScale(unit, false);
+    int c = 0;
+    std::from_chars(code.data(), code.data() + code.size() - 4, c);
+    if (c == 1) {
+      powerImport = value;
+    } else if (c == 2) {
+      powerExport = value;
+    } else if (c == 16) {
+      power = value; // signed sum of all phases
+    } else if (c == 14) {
+      values.frequency = value;
+    } else if (c >= 21 && c <= 76) {
+      // Phases L1..L3 at C = 21/41/61 import, 22/42/62 export power,
+      // 31/51/71 current, 32/52/72 voltage, 36/56/76 signed power
+      const int phase = (c - 21) / 20;
+      switch (c - 20 * phase) {
+      case 21:
+      case 36:
+        phases[phase]->activePower += value;
+        break;
+      case 22:
+        phases[phase]->activePower -= value;
+        break;
+      case 31:
+        phases[phase]->current = value;
+        break;
+      case 32:
+        phases[phase]->phVoltage = value;
+        break;
+      }
+    }
+  }
+
+  if (dataSets == 0) {
+    return std::unexpected(
+        ModbusError::custom(EPROTO, "updateFromIec(): Readout without data"));
+  }
+
+  values.activeEnergyImport = hasTotal[0] ? energyImport[0] : energyImport[1];
+  values.activeEnergyExport = hasTotal[1] ? energyExport[0] : energyExport[1];
+  values.activePower = power ? *power : powerImport - powerExport;
+
+  // Power is signed by direction, the counters are split already
+  deriveValues(values);
+
+  newDevice.options = std::string(PROJECT_VERSION) + "-" + GIT_COMMIT_HASH;
+  newDevice.phases = values.phase2.phVoltage > 0.0 ? 3 : 1;
+
+  json newValuesJson = buildValuesJson(values);
+  json newDeviceJson = buildDeviceJson(newDevice);
+
+  {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    values_ = std::move(values);
+    jsonValues_ = std::move(newValuesJson);
+    device_ = std::move(newDevice);
+    jsonDevice_ = std::move(newDeviceJson);
+  }
+
+  masterLogger_->debug("{}", jsonDevice_.dump());
+  masterLogger_->debug("{}", jsonValues_.dump());
+
+  return {};
+}
+
+json MeterMaster::buildValuesJson(const MeterTypes::Values &values) {
+  json newJson;
+  json phases = json::array();
+
+  phases.push_back({
+      {"id", 1},
+      {"power_active", JsonUtils::roundTo(values.phase1.activePower, 2)},
+      {"power_apparent", JsonUtils::roundTo(values.phase1.apparentPower, 2)},
       {"power_reactive", JsonUtils::roundTo(values.phase1.reactivePower, 2)},
       {"power_factor", JsonUtils::roundTo(values.phase1.powerFactor, 2)},
       {"voltage_ph", JsonUtils::roundTo(values.phase1.phVoltage, 1)},
@@ -522,155 +2431,253 @@ std::expected<void, ModbusError> MeterMaster::updateValuesAndJson() {
   newJson["voltage_pp"] = JsonUtils::roundTo(values.ppVoltage, 1);
   newJson["phases"] = phases;
 
-  // Update shared values and JSON with lock
-  {
-    std::lock_guard<std::mutex> lock(cbMutex_);
-    values_ = std::move(values);
-    jsonValues_ = std::move(newJson);
+  // DSMR: tariff indicator and sub-meters on the M-Bus channels
+  if (values.tariff)
+    newJson["tariff"] = values.tariff;
+  if (!values.channels.empty()) {
+    json channels = json::array();
+    for (const auto &ch : values.channels) {
+      channels.push_back({
+          {"channel", ch.id},
+          {"medium", ch.medium},
+          {"serial_number", ch.serialNumber},
+          {"value", JsonUtils::roundTo(ch.value, 3)},
+          {"unit", ch.unit},
+          {"time", ch.time},
+      });
+    }
+    newJson["mbus"] = channels;
   }
 
-  masterLogger_->debug("{}", jsonValues_.dump());
+  return newJson;
+}
 
-  return {};
+json MeterMaster::buildDeviceJson(const MeterTypes::Device &device) {
+  json newJson;
+
+  newJson["manufacturer"] = device.manufacturer;
+  newJson["model"] = device.model;
+  newJson["serial_number"] = device.serialNumber;
+  newJson["firmware_version"] = device.fwVersion;
+  newJson["options"] = device.options;
+  newJson["phases"] = device.phases;
+  newJson["status"] = device.status;
+
+  return newJson;
 }
 
-std::expected<void, ModbusError> MeterMaster::updateDeviceAndJson() {
+std::expected<void, ModbusError> MeterMaster::tryConnectModbus(void) {
   if (!handler_.isRunning()) {
-    return std::unexpected(ModbusError::custom(
-        EINTR, "updateDeviceAndJson(): Shutdown in progress"));
+    return std::unexpected(
+        ModbusError::custom(EINTR, "tryConnectModbus(): Shutdown in progress"));
   }
 
-  {
-    std::lock_guard<std::mutex> lock(cbMutex_);
-    if (telegram_.empty())
-      return {};
-  }
+  if (poller_->isConnected())
+    return {};
 
-  MeterTypes::Device newDevice{};
+  auto result = poller_->connect();
+  if (!result)
+    return result;
 
-  std::istringstream iss;
-  {
-    std::lock_guard<std::mutex> lock(cbMutex_);
-    iss.str(telegram_);
-  }
+  masterLogger_->info("{} bus connected ('{}', {} meter(s))", label_,
+                      poller_->endpoint(), poller_->deviceCount());
 
-  std::regex obexRegex(R"(^([0-9]-0:[0-9]+.[0-9]+.[0-9]+\*255)\(([^)]+)\))");
-  std::regex versionRegex(R"(^(\/[A-Za-z0-9]+)_([A-Za-z0-9]+)$)");
-  std::string line;
+  // Meters are announced individually once they answer
+  scheduler_->reset(BusScheduler::Clock::now());
 
-  int lineNum = 0;
-  while (std::getline(iss, line)) {
-    ++lineNum;
-    line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+  return {};
+}
 
-    if (line.empty() || line[0] == '!')
-      continue;
+std::expected<void, ModbusError>
+MeterMaster::pollDeviceAndJson(size_t device) {
+  if (!handler_.isRunning()) {
+    return std::unexpected(ModbusError::custom(
+        EINTR, "pollDeviceAndJson(): Shutdown in progress"));
+  }
 
-    try {
-      // Version line
-      if (!line.empty() && line[0] == '/') {
-        std::smatch versionMatch;
-        if (!std::regex_search(line, versionMatch, versionRegex)) {
-          throw std::invalid_argument("Malformed version expression");
-        }
-        newDevice.fwVersion = versionMatch[2].str();
-        continue;
-      }
+  MeterTypes::Device newDevice{};
+  auto result = poller_->readDevice(device, newDevice);
+  if (!result)
+    return result;
 
-      // OBEX line
-      std::smatch obexMatch;
-      if (!std::regex_search(line, obexMatch, obexRegex)) {
-        throw std::invalid_argument("Malformed OBEX expression");
-      }
+  newDevice.options = std::string(PROJECT_VERSION) + "-" + GIT_COMMIT_HASH;
 
-      std::string obis = obexMatch[1];
-      if (obis == "1-0:96.1.0*255") {
-        newDevice.serialNumber = obexMatch[2].str();
-      } else if (obis == "1-0:96.5.0*255") {
-        newDevice.status = obexMatch[2].str();
-      }
+  json newJson = buildDeviceJson(newDevice);
 
-    } catch (const std::exception &err) {
-      std::ostringstream oss;
-      oss << "[" << line << "]: " << err.what();
-      return std::unexpected(ModbusError::custom(EPROTO, oss.str()));
+  masterLogger_->debug("{}", newJson.dump());
+
+  if (handler_.isRunning()) {
+    std::lock_guard<std::mutex> lock(cbMutex_);
+    if (deviceCallback_) {
+      deviceCallback_(poller_->device(device).cfg.name, newJson.dump(),
+                      std::move(newDevice));
     }
   }
 
-  newDevice.manufacturer = "EasyMeter";
-  newDevice.model = "DD3-BZ06-ETA-ODZ1";
-  newDevice.options = std::string(PROJECT_VERSION) + "-" + GIT_COMMIT_HASH;
-  newDevice.phases = 3;
+  return {};
+}
 
-  // ---- Build ordered JSON ----
-  json newJson;
+std::expected<void, ModbusError>
+MeterMaster::pollValuesAndJson(size_t device, MeterProfiles::Rate rate) {
+  if (!handler_.isRunning()) {
+    return std::unexpected(ModbusError::custom(
+        EINTR, "pollValuesAndJson(): Shutdown in progress"));
+  }
+
+  auto result = poller_->readValues(device, rate);
+  if (!result)
+    return result;
+
+  // Energy counters keep their last value between slow reads
+  MeterTypes::Values values = poller_->device(device).values;
+  values.time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::system_clock::now().time_since_epoch())
+                    .count();
 
-  newJson["manufacturer"] = newDevice.manufacturer;
-  newJson["model"] = newDevice.model;
-  newJson["serial_number"] = newDevice.serialNumber;
-  newJson["firmware_version"] = newDevice.fwVersion;
-  newJson["options"] = newDevice.options;
-  newJson["phases"] = newDevice.phases;
-  newJson["status"] = newDevice.status;
+  json newJson = buildValuesJson(values);
 
   masterLogger_->debug("{}", newJson.dump());
 
-  // ---- Commit values ----
-  {
+  if (handler_.isRunning()) {
     std::lock_guard<std::mutex> lock(cbMutex_);
-    jsonDevice_ = std::move(newJson);
-    device_ = std::move(newDevice);
+    if (updateCallback_) {
+      const std::string &name = poller_->device(device).cfg.name;
+      std::string payload = newJson.dump();
+      PROBE(dispatch, name.c_str(), payload.size());
+      const size_t length = payload.size();
+      const auto start = Clock::now();
+      updateCallback_(name, std::move(payload), std::move(values));
+      recordCallback(length, start);
+    }
   }
 
   return {};
 }
 
-void MeterMaster::runLoop() {
+void MeterMaster::publishAvailability(size_t device,
+                                      const char *availability) {
+  std::lock_guard<std::mutex> lock(cbMutex_);
+  if (availabilityCallback_)
+    availabilityCallback_(poller_->device(device).cfg.name, availability);
+}
+
+void MeterMaster::publishMetrics(BusScheduler::Clock::time_point now) {
+  json metrics = scheduler_->metrics(now);
+
+  masterLogger_->debug("{}", metrics.dump());
+
+  std::lock_guard<std::mutex> lock(cbMutex_);
+  if (metricsCallback_)
+    metricsCallback_(metrics.dump());
+}
+
+void MeterMaster::waitReconnect(void) {
+  waitUntil(BusScheduler::Clock::now() + std::chrono::seconds(1));
+}
+
+void MeterMaster::waitUntil(BusScheduler::Clock::time_point until) {
+  // The shutdown event ends the wait right away, whenever it is raised
+  struct pollfd fds = {handler_.shutdownFd(), POLLIN, 0};
+  const auto timeout = std::chrono::ceil<std::chrono::milliseconds>(
+      until - BusScheduler::Clock::now());
+  if (timeout.count() <= 0)
+    return;
+  const int ms = static_cast<int>(
+      std::min<int64_t>(timeout.count(), std::numeric_limits<int>::max()));
+  while (poll(&fds, 1, ms) == -1 && errno == EINTR) {
+  }
+}
+
+void MeterMaster::pollLoop() {
+  Scheduling::prefaultStack();
+  using Clock = BusScheduler::Clock;
+  const auto metricsInterval =
+      std::chrono::seconds(cfg_.modbus.metricsInterval);
+  std::vector<bool> deviceKnown(poller_->deviceCount(), false);
+  auto metricsDue = Clock::now() + metricsInterval;
+
+  const double load = scheduler_->expectedLoad();
+  masterLogger_->info("Expected bus load {:.0f}% for {} meter(s) on '{}'",
+                      load * 100.0, poller_->deviceCount(),
+                      poller_->endpoint());
+  if (load > 1.0) {
+    masterLogger_->warn("Poll intervals exceed the bus capacity, meters will "
+                        "be polled less often than configured");
+  }
 
   while (handler_.isRunning()) {
 
-    // Connect to meter
-    auto connectAction = handleResult(tryConnect());
+    // Connect to bus, device info is read again after every reconnect
+    if (!poller_->isConnected())
+      std::fill(deviceKnown.begin(), deviceKnown.end(), false);
+
+    auto connectAction = handleResult(tryConnectModbus());
     if (connectAction == MeterTypes::ErrorAction::SHUTDOWN)
       break;
-    else if (connectAction == MeterTypes::ErrorAction::RECONNECT)
+    else if (connectAction == MeterTypes::ErrorAction::RECONNECT) {
+      waitReconnect();
       continue;
+    }
 
-    // Read telegram - on any error, loop restarts (will try reconnect)
-    auto readAction = handleResult(readTelegram());
-    if (readAction == MeterTypes::ErrorAction::SHUTDOWN)
-      break;
-    else if (readAction == MeterTypes::ErrorAction::RECONNECT)
-      continue;
+    auto now = Clock::now();
+    if (now >= metricsDue) {
+      publishMetrics(now);
+      metricsDue = now + metricsInterval;
+    }
 
-    // Update device
-    auto deviceAction = handleResult(updateDeviceAndJson());
-    if (deviceAction == MeterTypes::ErrorAction::SHUTDOWN)
-      break;
-    else if (deviceAction == MeterTypes::ErrorAction::RECONNECT)
+    // Wait until the next task is due or a backed off meter is retried
+    Clock::time_point wakeAt;
+    auto next = scheduler_->next(now, wakeAt);
+    if (!next) {
+      waitUntil(std::min(wakeAt, metricsDue));
       continue;
+    }
 
-    if (handler_.isRunning()) {
-      std::lock_guard<std::mutex> lock(cbMutex_);
-      if (deviceCallback_) {
-        deviceCallback_(jsonDevice_.dump(), device_);
-      }
+    const BusScheduler::Task &task = scheduler_->task(*next);
+    const size_t device = task.device;
+    const auto start = Clock::now();
+
+    std::expected<void, ModbusError> result;
+    if (!deviceKnown[device]) {
+      result = pollDeviceAndJson(device);
+      deviceKnown[device] = result.has_value();
     }
+    if (result)
+      result = pollValuesAndJson(device, task.rate);
 
-    // Update values
-    auto updateAction = handleResult(updateValuesAndJson());
-    if (updateAction == MeterTypes::ErrorAction::SHUTDOWN)
-      break;
-    else if (updateAction == MeterTypes::ErrorAction::RECONNECT)
+    const auto end = Clock::now();
+
+    if (result) {
+      if (scheduler_->complete(*next, end, end - start)) {
+        masterLogger_->info("Meter {} online",
+                            poller_->device(device).describe());
+        publishAvailability(device, "connected");
+      }
       continue;
+    }
 
-    if (handler_.isRunning()) {
-      std::lock_guard<std::mutex> lock(cbMutex_);
-      if (updateCallback_) {
-        updateCallback_(jsonValues_.dump(), values_);
+    // A silent meter is backed off, the other meters keep being polled
+    if (ModbusPoller::isDeviceError(result.error())) {
+      masterLogger_->debug("Meter {} error: {}",
+                           poller_->device(device).describe(),
+                           result.error().describe());
+      if (scheduler_->fail(*next, end, end - start)) {
+        masterLogger_->warn("Meter {} offline: {}",
+                            poller_->device(device).describe(),
+                            result.error().describe());
+        deviceKnown[device] = false;
+        publishAvailability(device, "disconnected");
       }
+      continue;
     }
+
+    // Bus errors - reconnect
+    auto pollAction = handleResult(std::move(result));
+    if (pollAction == MeterTypes::ErrorAction::SHUTDOWN)
+      break;
+    else if (pollAction == MeterTypes::ErrorAction::RECONNECT)
+      waitReconnect();
   }
 
-  masterLogger_->debug("Meter run loop stopped.");
-}
\ No newline at end of file
+  masterLogger_->debug("Meter poll loop stopped.");
+}
@@ -0,0 +1,186 @@
+#include "meter_reactor.h"
+#include "scheduling.h"
+#include "signal_handler.h"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+MeterReactor::MeterReactor(int threads, SignalHandler &signalHandler)
+    : handler_(signalHandler) {
+
+  masterLogger_ = spdlog::get("meter.master");
+  if (!masterLogger_)
+    masterLogger_ = spdlog::default_logger();
+
+  for (int i = 0; i < std::max(threads, 1); ++i) {
+    auto loop = std::make_unique<Loop>();
+
+    loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->epollFd == -1 || loop->wakeFd == -1) {
+      std::string err = strerror(errno);
+      if (loop->epollFd != -1)
+        close(loop->epollFd);
+      if (loop->wakeFd != -1)
+        close(loop->wakeFd);
+      throw std::runtime_error("Failed to create meter event loop: " + err);
+    }
+
+    // The wake and shutdown descriptors are marked with an index past all
+    // sources, either of them ends the loop
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u32 = UINT32_MAX;
+    epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->wakeFd, &ev);
+    epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, handler_.shutdownFd(), &ev);
+
+    loops_.push_back(std::move(loop));
+  }
+}
+
+MeterReactor::~MeterReactor() {
+  stop();
+  for (auto &loop : loops_) {
+    close(loop->epollFd);
+    close(loop->wakeFd);
+  }
+}
+
+void MeterReactor::add(Source &source) {
+  if (started_)
+    throw std::logic_error("MeterReactor::add(): reactor already started");
+
+  // Least loaded loop first
+  auto it = std::min_element(
+      loops_.begin(), loops_.end(), [](const auto &a, const auto &b) {
+        return a->entries.size() < b->entries.size();
+      });
+  (*it)->entries.push_back({&source, -1, 0, source.generation()});
+}
+
+void MeterReactor::start(void) {
+  if (started_)
+    return;
+  started_ = true;
+
+  size_t sources = 0;
+  for (auto &loop : loops_) {
+    if (loop->entries.empty())
+      continue;
+    sources += loop->entries.size();
+    loop->thread = std::thread(&MeterReactor::run, this, std::ref(*loop));
+  }
+
+  if (sources) {
+    masterLogger_->debug(
+        "Meter event loops started ({} meter(s), {} thread(s))", sources,
+        std::min(sources, loops_.size()));
+  }
+}
+
+void MeterReactor::stop(void) {
+  for (auto &loop : loops_) {
+    if (!loop->thread.joinable())
+      continue;
+    const uint64_t one = 1;
+    if (write(loop->wakeFd, &one, sizeof(one)) == -1)
+      masterLogger_->warn("stop(): Unable to wake meter event loop");
+    loop->thread.join();
+  }
+}
+
+std::vector<std::thread::native_handle_type> MeterReactor::threads(void) {
+  std::vector<std::thread::native_handle_type> handles;
+  for (auto &loop : loops_) {
+    if (loop->thread.joinable())
+      handles.push_back(loop->thread.native_handle());
+  }
+  return handles;
+}
+
+void MeterReactor::sync(Loop &loop, uint32_t idx) {
+  Entry &entry = loop.entries[idx];
+  const int fd = entry.source->fd();
+  const uint32_t events = fd == -1 ? 0 : entry.source->events();
+  const uint64_t generation = entry.source->generation();
+
+  // The same number may be a new descriptor, e.g. inotify after the tty
+  const bool reused = fd == entry.fd && generation != entry.generation;
+  if (fd == entry.fd && events == entry.events && !reused)
+    return;
+
+  // A closed descriptor has already left the epoll set, ignore ENOENT/EBADF
+  if (entry.fd != -1 && (entry.fd != fd || reused))
+    epoll_ctl(loop.epollFd, EPOLL_CTL_DEL, entry.fd, nullptr);
+
+  if (fd != -1) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.u32 = idx;
+    const int op =
+        entry.fd == fd && !reused ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (epoll_ctl(loop.epollFd, op, fd, &ev) == -1) {
+      masterLogger_->error("sync(): Unable to watch descriptor {}: {}", fd,
+                           strerror(errno));
+    }
+  }
+
+  entry.fd = fd;
+  entry.events = events;
+  entry.generation = generation;
+}
+
+void MeterReactor::run(Loop &loop) {
+  Scheduling::prefaultStack();
+  std::array<epoll_event, 16> events;
+
+  while (handler_.isRunning()) {
+    auto now = Clock::now();
+
+    // Sleep until the nearest deadline, without one until the next event
+    auto wakeAt = Clock::time_point::max();
+    for (const auto &entry : loop.entries)
+      wakeAt = std::min(wakeAt, entry.source->deadline());
+    int timeout = -1;
+    if (wakeAt != Clock::time_point::max()) {
+      const auto ms =
+          std::chrono::ceil<std::chrono::milliseconds>(wakeAt - now).count();
+      timeout = static_cast<int>(std::clamp<int64_t>(ms, 0, INT32_MAX));
+    }
+
+    int count = epoll_wait(loop.epollFd, events.data(),
+                           static_cast<int>(events.size()), timeout);
+    if (count == -1) {
+      if (errno == EINTR)
+        continue;
+      masterLogger_->error("run(): epoll_wait failed: {}", strerror(errno));
+      handler_.shutdown();
+      break;
+    }
+
+    for (int i = 0; i < count; ++i) {
+      const uint32_t idx = events[i].data.u32;
+      if (idx == UINT32_MAX)
+        return; // stop() or shutdown requested
+      loop.entries[idx].source->onEvent(events[i].events);
+      sync(loop, idx);
+    }
+
+    now = Clock::now();
+    for (uint32_t idx = 0; idx < loop.entries.size(); ++idx) {
+      if (loop.entries[idx].source->deadline() <= now) {
+        loop.entries[idx].source->onTimer(now);
+        sync(loop, idx);
+      }
+    }
+  }
+}
@@ -1,20 +1,68 @@
 #include "meter_slave.h"
 #include "common_registers.h"
+#include "flight_recorder.h"
 #include "meter_registers.h"
 #include "meter_types.h"
 #include "modbus_error.h"
 #include "modbus_utils.h"
+#include "probes.h"
 #include "signal_handler.h"
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <chrono>
+#include <cstdint>
 #include <cstring>
 #include <expected>
 #include <memory>
 #include <modbus/modbus.h>
 #include <poll.h>
+#include <pthread.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#include <vector>
+
+namespace {
+
+// SunSpec blocks from the common model to the end block of the float model
+constexpr uint16_t IMAGE_BEGIN = C001::SID.ADDR;
+constexpr uint16_t IMAGE_END =
+    M_END::L.withOffset(M_END::FLOAT_OFFSET).ADDR + 1;
+
+// Milliseconds left until the given time, rounded up, for poll()
+int remainingMs(std::chrono::steady_clock::time_point until) {
+  const auto left = std::chrono::ceil<std::chrono::milliseconds>(
+      until - std::chrono::steady_clock::now());
+  return static_cast<int>(std::clamp<int64_t>(left.count(), 0, INT32_MAX));
+}
+
+// Traces a request with function code, first address and register count
+void traceRequest(modbus_t *ctx, const uint8_t *query, int length) {
+  const int pdu = modbus_get_header_length(ctx);
+  auto field = [&](int offset) {
+    return pdu + offset + 1 < length
+               ? (query[pdu + offset] << 8) | query[pdu + offset + 1]
+               : 0;
+  };
+  PROBE(modbus_request, query[pdu], field(1), field(3));
+  FlightRecorder::record(FlightRecorder::Event::MODBUS_REQUEST, query[pdu],
+                         field(1), field(3));
+}
+
+// Traces a reply with its length (-1 if it failed) and the time since the
+// request was received
+void traceReply(modbus_t *ctx, const uint8_t *query, int sent,
+                std::chrono::steady_clock::time_point received) {
+  const int function = query[modbus_get_header_length(ctx)];
+  const int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - received)
+                         .count();
+  PROBE(modbus_reply, function, sent, us);
+  FlightRecorder::record(FlightRecorder::Event::MODBUS_REPLY, function, sent,
+                         us);
+}
+
+} // namespace
 
 MeterSlave::MeterSlave(const MeterSlaveConfig &cfg,
                        SignalHandler &signalHandler)
@@ -138,6 +186,7 @@ MeterSlave::handleResult(std::expected<void, ModbusError> &&result) {
   }
 
   const ModbusError &err = result.error();
+  FlightRecorder::recordError(err);
 
   if (err.severity == ModbusError::Severity::FATAL) {
     // Fatal error occurred - initiate shutdown sequence
@@ -147,7 +196,9 @@ MeterSlave::handleResult(std::expected<void, ModbusError> &&result) {
 
   } else if (err.severity == ModbusError::Severity::TRANSIENT) {
     // Temporary error - disconnect and reconnect
-    modbusLogger_->warn("Transient Modbus error: {}", err.describe());
+    transientLog_.log(*modbusLogger_, spdlog::level::warn,
+                      "Transient Modbus error: {}",
+                      [&err] { return err.describe(); });
     return MeterTypes::ErrorAction::RECONNECT;
 
   } else if (err.severity == ModbusError::Severity::SHUTDOWN) {
@@ -466,7 +517,61 @@ void MeterSlave::updateDevice(MeterTypes::Device device) {
   deviceUpdated_ = true;
 }
 
+std::vector<uint16_t> MeterSlave::registers(void) const {
+  auto regs = regs_.load();
+  if (!regs)
+    return {};
+  return std::vector<uint16_t>(regs->tab_registers + IMAGE_BEGIN,
+                               regs->tab_registers + IMAGE_END);
+}
+
+std::expected<void, ModbusError>
+MeterSlave::restoreRegisters(const std::vector<uint16_t> &image) {
+  auto oldRegs = regs_.load();
+  if (!oldRegs) {
+    return std::unexpected(ModbusError::custom(
+        ENOMEM, "restoreRegisters(): No existing mapping to base on"));
+  }
+  if (image.size() != IMAGE_END - IMAGE_BEGIN) {
+    return std::unexpected(ModbusError::custom(
+        EBADMSG, "restoreRegisters(): Image has {} registers, expected {}",
+        image.size(), IMAGE_END - IMAGE_BEGIN));
+  }
+
+  // The model written by startListener() has to match, e.g. float vs. int
+  const uint16_t model = cfg_.useFloatModel ? M21X::ID.ADDR : M20X::ID.ADDR;
+  if (image[model - IMAGE_BEGIN] != oldRegs->tab_registers[model]) {
+    return std::unexpected(ModbusError::custom(
+        EBADMSG, "restoreRegisters(): Image holds model {}, configured is {}",
+        image[model - IMAGE_BEGIN], oldRegs->tab_registers[model]));
+  }
+
+  auto newRegs = std::shared_ptr<modbus_mapping_t>(
+      modbus_mapping_new(0, 0, MODBUS_REGISTERS, 0), ModbusDeleter{});
+  if (!newRegs) {
+    return std::unexpected(ModbusError::custom(
+        ENOMEM, "restoreRegisters(): Unable to allocate new Modbus mapping"));
+  }
+
+  std::memcpy(newRegs->tab_registers, oldRegs->tab_registers,
+              static_cast<size_t>(MODBUS_REGISTERS) * sizeof(uint16_t));
+  std::copy(image.begin(), image.end(), newRegs->tab_registers + IMAGE_BEGIN);
+
+  // The unit id may have changed since the snapshot was taken
+  newRegs->tab_registers[C001::DA.ADDR] = cfg_.slaveId;
+
+  regs_.store(newRegs);
+  return {};
+}
+
+std::vector<std::thread::native_handle_type> MeterSlave::threads(void) {
+  if (!worker_.joinable())
+    return {};
+  return {worker_.native_handle()};
+}
+
 void MeterSlave::tcpClientWorker(int socket) {
+  pthread_setname_np(pthread_self(), "modbus-client");
 
   modbus_t *ctx = modbus_new_tcp(nullptr, 0);
   if (!ctx) {
@@ -487,7 +592,7 @@ void MeterSlave::tcpClientWorker(int socket) {
     return;
   }
 
-  // Set request timeout - controls how long modbus_receive() waits per call
+  // Set request timeout - limits modbus_receive() once a request has started
   modbus_set_indication_timeout(ctx, cfg_.requestTimeout, 0);
 
   // Set libmodbus debug - enable only if logger is at trace level
@@ -499,7 +604,8 @@ void MeterSlave::tcpClientWorker(int socket) {
 
   // Extract client connection information (IPv4 and IPv6 compatible)
   auto [client_ip, client_port] = ModbusUtils::getClientInfo(socket);
-  modbusLogger_->info("Client connected from {}:{}", client_ip, client_port);
+  connectLog_.log(*modbusLogger_, spdlog::level::info,
+                  "Client connected from {}:{}", client_ip, client_port);
 
   uint8_t query[MODBUS_TCP_MAX_ADU_LENGTH];
 
@@ -508,11 +614,22 @@ void MeterSlave::tcpClientWorker(int socket) {
   auto idleTimeout = std::chrono::seconds(cfg_.idleTimeout);
 
   while (handler_.isRunning()) {
+
+    // Sleep until the client sends, goes idle or the gateway shuts down
+    if (!waitRequest(socket, remainingMs(lastActivity + idleTimeout))) {
+      if (!handler_.isRunning())
+        break;
+      modbusLogger_->info("Client {}:{} idle timeout ({}s), disconnecting",
+                          client_ip, client_port, cfg_.idleTimeout);
+      break;
+    }
+
     int rc = modbus_receive(ctx, query);
 
     if (rc > 0) {
       // Valid request received - update activity timestamp
       lastActivity = std::chrono::steady_clock::now();
+      traceRequest(ctx, query, rc);
 
       auto regs = regs_.load();
       if (!regs) {
@@ -522,7 +639,9 @@ void MeterSlave::tcpClientWorker(int socket) {
       }
 
       auto replyStart = std::chrono::steady_clock::now();
-      if (modbus_reply(ctx, query, rc, regs.get()) == -1) {
+      const int sent = modbus_reply(ctx, query, rc, regs.get());
+      traceReply(ctx, query, sent, lastActivity);
+      if (sent == -1) {
         modbusLogger_->warn("tcpClientWorker(): Modbus reply failed: {}",
                             modbus_strerror(errno));
         break;
@@ -537,8 +656,9 @@ void MeterSlave::tcpClientWorker(int socket) {
 
     // --- Empty frame (connection closed by client gracefully) ---
     if (rc == 0) {
-      modbusLogger_->info("Client {}:{} closed connection", client_ip,
-                          client_port);
+      disconnectLog_.log(*modbusLogger_, spdlog::level::info,
+                         "Client {}:{} closed connection", client_ip,
+                         client_port);
       break;
     }
 
@@ -561,8 +681,9 @@ void MeterSlave::tcpClientWorker(int socket) {
     }
 
     // Connection issue, protocol error or abrupt disconnection
-    modbusLogger_->info("Client {}:{} disconnected: {}", client_ip, client_port,
-                        modbus_strerror(errno));
+    disconnectLog_.log(*modbusLogger_, spdlog::level::info,
+                       "Client {}:{} disconnected: {}", client_ip, client_port,
+                       modbus_strerror(errno));
     break;
   }
 
@@ -582,7 +703,7 @@ void MeterSlave::rtuClientHandler() {
     return;
   }
 
-  // Set request timeout - controls how long modbus_receive() waits per call
+  // Set request timeout - limits modbus_receive() once a request has started
   modbus_set_indication_timeout(listenCtx_, cfg_.requestTimeout, 0);
 
   // Set libmodbus debug - enable only if logger is at trace level
@@ -598,8 +719,23 @@ void MeterSlave::rtuClientHandler() {
   auto lastActivity = std::chrono::steady_clock::now();
   auto idleTimeout = std::chrono::seconds(cfg_.idleTimeout);
   bool isActive = false;
+  const int fd = modbus_get_socket(listenCtx_);
 
   while (handler_.isRunning()) {
+
+    // Sleep until a request arrives, without a client until the next one
+    const int timeout =
+        isActive ? remainingMs(lastActivity + idleTimeout) : -1;
+    if (!waitRequest(fd, timeout)) {
+      if (!handler_.isRunning())
+        break;
+      modbusLogger_->info("Client disconnected, idle for {}s",
+                          cfg_.idleTimeout);
+      lastActivity = std::chrono::steady_clock::now();
+      isActive = false;
+      continue;
+    }
+
     int rc = modbus_receive(listenCtx_, query);
 
     // --- Valid request received ---
@@ -612,6 +748,7 @@ void MeterSlave::rtuClientHandler() {
         isActive = true;
       }
       lastActivity = std::chrono::steady_clock::now();
+      traceRequest(listenCtx_, query, rc);
 
       auto regs = regs_.load();
       if (!regs) {
@@ -620,7 +757,9 @@ void MeterSlave::rtuClientHandler() {
         break;
       }
 
-      if (modbus_reply(listenCtx_, query, rc, regs.get()) == -1) {
+      const int sent = modbus_reply(listenCtx_, query, rc, regs.get());
+      traceReply(listenCtx_, query, sent, lastActivity);
+      if (sent == -1) {
         modbusLogger_->warn("rtuClientHandler(): reply failed: {}",
                             modbus_strerror(errno));
       }
@@ -666,6 +805,20 @@ void MeterSlave::rtuClientHandler() {
   modbusLogger_->debug("Modbus RTU slave run loop stopped");
 }
 
+bool MeterSlave::waitRequest(int fd, int timeout) {
+  // timeout in ms, -1 waits forever; false on timeout or shutdown
+  struct pollfd fds[2] = {{fd, POLLIN, 0}, {handler_.shutdownFd(), POLLIN, 0}};
+  int ret;
+  do {
+    ret = poll(fds, 2, timeout);
+  } while (ret == -1 && errno == EINTR);
+
+  if (fds[1].revents & POLLIN)
+    return false;
+  // Errors and hangups are left to modbus_receive() to report
+  return ret != 0;
+}
+
 void MeterSlave::tcpClientHandler(void) {
 
   // TCP mode - accept connections and spawn client threads
@@ -675,14 +828,14 @@ void MeterSlave::tcpClientHandler(void) {
     return;
   }
 
-  struct pollfd pfd;
-  pfd.fd = serverSocket_;
-  pfd.events = POLLIN;
+  struct pollfd fds[2] = {{serverSocket_, POLLIN, 0},
+                          {handler_.shutdownFd(), POLLIN, 0}};
+  struct pollfd &pfd = fds[0];
 
   while (handler_.isRunning()) {
 
-    // Use timeout to allow periodic checking of isRunning()
-    int ret = poll(&pfd, 1, 500);
+    // No timeout, a shutdown makes the second descriptor readable
+    int ret = poll(fds, 2, -1);
 
     if (ret < 0) {
       if (errno == EINTR) {
@@ -692,9 +845,8 @@ void MeterSlave::tcpClientHandler(void) {
       auto pollAction = handleResult(std::unexpected(
           ModbusError::fromErrno("tcpClientHandler(): poll failed")));
       break;
-    } else if (ret == 0) {
-      // Timeout - loop back and check isRunning()
-      continue;
+    } else if (fds[1].revents & POLLIN) {
+      break;
     }
 
     // Check for incoming connection
@@ -716,11 +868,22 @@ void MeterSlave::tcpClientHandler(void) {
         continue;
       }
 
-      // spawn a thread to handle the client
+      // spawn a thread to handle the client, reap those already finished
       {
         std::lock_guard<std::mutex> lock(clientMutex_);
-        clientThreads_.emplace_back(
-            [clientSocket, this]() { tcpClientWorker(clientSocket); });
+        std::erase_if(clientThreads_, [](ClientThread &t) {
+          if (!t.done->load())
+            return false;
+          t.thread.join();
+          return true;
+        });
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        clientThreads_.push_back(
+            {std::thread([clientSocket, done, this]() {
+               tcpClientWorker(clientSocket);
+               done->store(true);
+             }),
+             done});
       }
     }
 
@@ -741,8 +904,8 @@ void MeterSlave::tcpClientHandler(void) {
   {
     std::lock_guard<std::mutex> lock(clientMutex_);
     for (auto &t : clientThreads_) {
-      if (t.joinable())
-        t.join();
+      if (t.thread.joinable())
+        t.thread.join();
     }
     clientThreads_.clear();
   }
@@ -0,0 +1,272 @@
+#include "modbus_poller.h"
+#include "config_yaml.h"
+#include "meter_profiles.h"
+#include "meter_types.h"
+#include "modbus_error.h"
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <expected>
+#include <modbus/modbus.h>
+#include <spdlog/spdlog.h>
+#include <string>
+
+ModbusPoller::ModbusPoller(const MeterMasterConfig &cfg) : cfg_(cfg) {
+
+  masterLogger_ = spdlog::get("meter.master");
+  if (!masterLogger_)
+    masterLogger_ = spdlog::default_logger();
+
+  uint16_t maxCount = 0;
+  for (const auto &devCfg : cfg_.modbus.devices) {
+    Device dev{devCfg, MeterProfiles::get(devCfg.model), {}, {}};
+    for (auto rate : {MeterProfiles::Rate::FAST, MeterProfiles::Rate::SLOW}) {
+      auto &blocks = dev.blocks[static_cast<size_t>(rate)];
+      blocks = planBlocks(dev.profile.fields, cfg_.modbus.maxGap, rate);
+      for (const auto &block : blocks)
+        maxCount = std::max(maxCount, block.count);
+    }
+    devices_.push_back(std::move(dev));
+  }
+  buffer_.resize(maxCount);
+}
+
+ModbusPoller::~ModbusPoller() { close(); }
+
+std::vector<ModbusPoller::Block>
+ModbusPoller::planBlocks(std::span<const MeterProfiles::Field> fields,
+                         int maxGap, MeterProfiles::Rate rate, int maxCount) {
+  // Visit fields in address order so neighbours end up in the same block
+  std::vector<size_t> order;
+  for (size_t idx = 0; idx < fields.size(); ++idx) {
+    if (fields[idx].rate == rate)
+      order.push_back(idx);
+  }
+  std::sort(order.begin(), order.end(), [&fields](size_t a, size_t b) {
+    return fields[a].reg.ADDR < fields[b].reg.ADDR;
+  });
+
+  std::vector<Block> blocks;
+  for (size_t idx : order) {
+    const Register &reg = fields[idx].reg;
+    const int end = reg.ADDR + reg.NB;
+
+    if (!blocks.empty()) {
+      Block &last = blocks.back();
+      const int lastEnd = last.start + last.count;
+      // Merge if the gap is small and the read stays within protocol limits
+      if (reg.ADDR <= lastEnd + maxGap && end - last.start <= maxCount) {
+        last.count =
+            static_cast<uint16_t>(std::max(lastEnd, end) - last.start);
+        last.fields.push_back(idx);
+        continue;
+      }
+    }
+    blocks.push_back({reg.ADDR, reg.NB, {idx}});
+  }
+
+  return blocks;
+}
+
+std::string ModbusPoller::endpoint(void) const {
+  if (cfg_.tcp)
+    return cfg_.tcp->host + ":" + std::to_string(cfg_.tcp->port);
+  return cfg_.rtu->device;
+}
+
+std::expected<void, ModbusError> ModbusPoller::connect(void) {
+  if (ctx_)
+    return {};
+
+  if (cfg_.tcp) {
+    ctx_ = modbus_new_tcp_pi(cfg_.tcp->host.c_str(),
+                             std::to_string(cfg_.tcp->port).c_str());
+  } else {
+    ctx_ = modbus_new_rtu(cfg_.rtu->device.c_str(), cfg_.rtu->baud,
+                          parityToChar(cfg_.rtu->parity), cfg_.rtu->dataBits,
+                          cfg_.rtu->stopBits);
+  }
+  if (!ctx_) {
+    return std::unexpected(
+        ModbusError::custom(ENOMEM, "Unable to create the libmodbus {} context",
+                            (cfg_.tcp ? "TCP" : "RTU")));
+  }
+
+  modbus_set_response_timeout(ctx_, cfg_.modbus.responseTimeout.sec,
+                              cfg_.modbus.responseTimeout.usec);
+
+  // Set libmodbus debug - enable only if logger is at trace level
+  if (masterLogger_->level() == spdlog::level::trace) {
+    if (modbus_set_debug(ctx_, true) == -1) {
+      masterLogger_->warn("connect(): Unable to set debug flag");
+    }
+  }
+
+  // Flush the line after timeouts and CRC errors of a single meter
+  modbus_set_error_recovery(ctx_, MODBUS_ERROR_RECOVERY_PROTOCOL);
+
+  if (modbus_connect(ctx_) == -1) {
+    int saved_errno = errno;
+    close();
+    errno = saved_errno;
+    return std::unexpected(
+        ModbusError::fromErrno("Connecting to meter '{}' failed", endpoint()));
+  }
+
+  for (const auto &dev : devices_) {
+    masterLogger_->debug(
+        "Polling {} registers of {} {} (unit id {}) in {} fast and {} slow "
+        "block reads",
+        dev.profile.fields.size(), dev.profile.manufacturer, dev.profile.model,
+        dev.cfg.slaveId, dev.blocks[0].size(), dev.blocks[1].size());
+  }
+
+  return {};
+}
+
+void ModbusPoller::close(void) {
+  if (ctx_) {
+    modbus_close(ctx_);
+    modbus_free(ctx_);
+    ctx_ = nullptr;
+  }
+  selectedSlave_ = -1;
+}
+
+bool ModbusPoller::isDeviceError(const ModbusError &err) {
+  // Errors caused by a single meter, the bus itself is still usable
+  switch (err.code) {
+  case ETIMEDOUT:
+  case EMBBADCRC:
+  case EMBBADDATA:
+  case EMBBADEXC:
+  case EMBUNKEXC:
+  case EMBBADSLAVE:
+  case EMBMDATA:
+    return true;
+  default:
+    // Modbus exception responses (illegal function, address, ...)
+    return err.code > MODBUS_ENOBASE && err.code < EMBBADCRC;
+  }
+}
+
+std::expected<void, ModbusError>
+ModbusPoller::selectDevice(const Device &dev) {
+  if (!ctx_)
+    return std::unexpected(
+        ModbusError::custom(ENOTCONN, "selectDevice(): Meter not connected"));
+
+  if (selectedSlave_ == dev.cfg.slaveId)
+    return {};
+
+  if (modbus_set_slave(ctx_, dev.cfg.slaveId) == -1) {
+    return std::unexpected(ModbusError::fromErrno(
+        "Setting meter unit id '{}' failed", dev.cfg.slaveId));
+  }
+  selectedSlave_ = dev.cfg.slaveId;
+
+  return {};
+}
+
+std::expected<void, ModbusError>
+ModbusPoller::readBlock(const Device &dev, const Block &block) {
+  auto selected = selectDevice(dev);
+  if (!selected)
+    return selected;
+
+  int rc;
+  if (dev.profile.function == MeterProfiles::Function::INPUT)
+    rc = modbus_read_input_registers(ctx_, block.start, block.count,
+                                     buffer_.data());
+  else
+    rc = modbus_read_registers(ctx_, block.start, block.count, buffer_.data());
+
+  if (rc == -1) {
+    return std::unexpected(ModbusError::fromErrno(
+        "Reading registers {:#06x}-{:#06x} of unit id {} failed", block.start,
+        block.start + block.count - 1, dev.cfg.slaveId));
+  }
+  if (rc != block.count) {
+    return std::unexpected(ModbusError::custom(
+        EMBBADDATA, "Short read at register {:#06x}: {} of {} registers",
+        block.start, rc, block.count));
+  }
+
+  return {};
+}
+
+double ModbusPoller::decode(const MeterProfiles::Profile &profile,
+                            const MeterProfiles::Field &field,
+                            const uint16_t *src) {
+  const bool highFirst =
+      profile.wordOrder == MeterProfiles::WordOrder::HIGH_FIRST;
+  const uint16_t hi = highFirst ? src[0] : src[1];
+  const uint16_t lo = highFirst ? src[1] : src[0];
+  const uint32_t u32 = (static_cast<uint32_t>(hi) << 16) | lo;
+
+  switch (field.reg.TYPE) {
+  case Register::Type::UINT16:
+    return src[0];
+  case Register::Type::INT16:
+    return static_cast<int16_t>(src[0]);
+  case Register::Type::UINT32:
+    return u32;
+  case Register::Type::INT32:
+    return static_cast<int32_t>(u32);
+  case Register::Type::FLOAT:
+    return highFirst ? modbus_get_float_abcd(src) : modbus_get_float_cdab(src);
+  default:
+    return std::nan("");
+  }
+}
+
+std::expected<void, ModbusError>
+ModbusPoller::readValues(size_t device, MeterProfiles::Rate rate) {
+  Device &dev = devices_[device];
+
+  for (const auto &block : dev.blocks[static_cast<size_t>(rate)]) {
+    auto result = readBlock(dev, block);
+    if (!result)
+      return result;
+
+    for (size_t idx : block.fields) {
+      const MeterProfiles::Field &field = dev.profile.fields[idx];
+      double raw =
+          decode(dev.profile, field, &buffer_[field.reg.ADDR - block.start]);
+      if (!std::isfinite(raw)) {
+        return std::unexpected(ModbusError::custom(
+            EMBBADDATA, "Invalid value in register {}", field.reg.describe()));
+      }
+      field.apply(dev.values, raw * field.scale);
+    }
+  }
+
+  return {};
+}
+
+std::expected<void, ModbusError>
+ModbusPoller::readDevice(size_t device, MeterTypes::Device &info) {
+  const Device &dev = devices_[device];
+
+  info.manufacturer = dev.profile.manufacturer;
+  info.model = dev.profile.model;
+  info.phases = dev.profile.phases;
+
+  if (!dev.profile.serialNumber)
+    return {};
+
+  auto selected = selectDevice(dev);
+  if (!selected)
+    return selected;
+
+  const Register &reg = *dev.profile.serialNumber;
+  uint16_t regs[2]{};
+  if (modbus_read_registers(ctx_, reg.ADDR, reg.NB, regs) == -1) {
+    return std::unexpected(ModbusError::fromErrno(
+        "Reading serial number register {} failed", reg.describe()));
+  }
+  info.serialNumber = std::to_string(static_cast<uint32_t>(
+      (static_cast<uint32_t>(regs[0]) << 16) | regs[1]));
+
+  return {};
+}
@@ -1,6 +1,9 @@
 #include "mqtt_client.h"
 #include "config_yaml.h"
+#include "flight_recorder.h"
+#include "probes.h"
 #include "signal_handler.h"
+#include <chrono>
 #include <functional>
 #include <mosquitto.h>
 #include <spdlog/spdlog.h>
@@ -64,11 +67,13 @@ MqttClient::~MqttClient() {
     worker_.join();
 
   if (mosq_) {
-    mosquitto_disconnect(mosq_);
-
-    // Give the disconnect callback time to execute and log
-    // mosquitto_disconnect() is async, the callback runs on another thread
-    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    // mosquitto_disconnect() is async, wait for the callback on the network
+    // thread to confirm, but not longer than the broker deserves
+    if (mosquitto_disconnect(mosq_) == MOSQ_ERR_SUCCESS) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait_for(lock, DISCONNECT_TIMEOUT,
+                   [this] { return !connected_.load(); });
+    }
 
     mosquitto_loop_stop(mosq_, true);
     mosquitto_destroy(mosq_);
@@ -78,6 +83,12 @@ MqttClient::~MqttClient() {
   mosquitto_lib_cleanup();
 }
 
+std::vector<std::thread::native_handle_type> MqttClient::threads(void) {
+  if (!worker_.joinable())
+    return {};
+  return {worker_.native_handle()};
+}
+
 bool MqttClient::hasQueuedMessages() const {
   return std::any_of(topicQueues_.begin(), topicQueues_.end(),
                      [](const auto &p) { return !p.second.empty(); });
@@ -102,7 +113,10 @@ void MqttClient::publish(std::string payload, const std::string &topic) {
     droppedCount_[topic]++;         // track total drops for this topic
   }
 
-  q.push({payload}); // push new message
+  q.push({std::move(payload), std::chrono::steady_clock::now()});
+  PROBE(mqtt_enqueue, topic.c_str(), q.back().payload.size(), q.size());
+  FlightRecorder::record(FlightRecorder::Event::MQTT_ENQUEUE,
+                         q.back().payload.size(), q.size());
 
   // Logging only if disconnected
   if (!connected_.load()) {
@@ -143,10 +157,18 @@ void MqttClient::run() {
     for (auto &[topic, q] : topicQueues_) {
       while (!q.empty() && connected_.load()) {
         auto payload = q.front().payload;
+        const auto queued = q.front().queued;
         lock.unlock();
 
         int rc = mosquitto_publish(mosq_, nullptr, opt_c_str(topic),
                                    payload.size(), payload.c_str(), 1, true);
+        const int64_t us =
+            std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - queued)
+                .count();
+        PROBE(mqtt_publish, topic.c_str(), payload.size(), us, rc);
+        FlightRecorder::record(FlightRecorder::Event::MQTT_PUBLISH,
+                               payload.size(), rc, us);
 
         lock.lock();
         if (rc == MOSQ_ERR_SUCCESS) {
@@ -182,7 +204,11 @@ void MqttClient::onConnect(struct mosquitto *, void *obj, int rc) {
 void MqttClient::onDisconnect(struct mosquitto *mosq, void *obj, int rc) {
   MqttClient *self = static_cast<MqttClient *>(obj);
 
-  self->connected_ = false;
+  {
+    std::lock_guard<std::mutex> lock(self->mutex_);
+    self->connected_ = false;
+  }
+  self->cv_.notify_all();
 
   if (rc == 0) {
     self->mqttLogger_->info("MQTT disconnected");
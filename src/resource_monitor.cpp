@@ -0,0 +1,157 @@
+#include "resource_monitor.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <format>
+#include <fstream>
+#include <malloc.h>
+#include <nlohmann/json.hpp>
+#include <spdlog/spdlog.h>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using json = nlohmann::ordered_json;
+
+namespace {
+
+// Numeric entries of a /proc directory, i.e. thread ids or descriptors
+std::vector<int> listProc(const char *path) {
+  std::vector<int> entries;
+  DIR *dir = opendir(path);
+  if (!dir)
+    return entries;
+  while (const dirent *entry = readdir(dir)) {
+    char *end = nullptr;
+    long n = std::strtol(entry->d_name, &end, 10);
+    if (end != entry->d_name && *end == '\0')
+      entries.push_back(static_cast<int>(n));
+  }
+  closedir(dir);
+  return entries;
+}
+
+// Name and user + system CPU ticks of a thread, see proc(5)
+bool readTaskStat(int tid, std::string &name, uint64_t &ticks) {
+  std::ifstream file(std::format("/proc/self/task/{}/stat", tid));
+  std::string line;
+  if (!std::getline(file, line))
+    return false;
+
+  // The name is in parentheses and may contain spaces
+  const auto open = line.find('(');
+  const auto close = line.rfind(')');
+  if (open == std::string::npos || close == std::string::npos)
+    return false;
+  name = line.substr(open + 1, close - open - 1);
+
+  // Fields after the name start with the state (3), utime and stime are 14
+  // and 15
+  std::istringstream fields(line.substr(close + 2));
+  std::string field;
+  uint64_t utime = 0, stime = 0;
+  for (int i = 3; i <= 15 && fields >> field; ++i) {
+    if (i == 14)
+      utime = std::stoull(field);
+    else if (i == 15)
+      stime = std::stoull(field);
+  }
+  ticks = utime + stime;
+  return true;
+}
+
+} // namespace
+
+ResourceMonitor::ResourceMonitor(const StatsConfig &cfg)
+    : cfg_(cfg), deadline_(Clock::now() + std::chrono::seconds(cfg.interval)),
+      lastSample_(Clock::now()) {
+  logger_ = spdlog::get("main");
+  if (!logger_)
+    logger_ = spdlog::default_logger();
+}
+
+void ResourceMonitor::setStatsCallback(std::function<void(std::string)> cb) {
+  std::lock_guard<std::mutex> lock(cbMutex_);
+  statsCallback_ = std::move(cb);
+}
+
+void ResourceMonitor::onTimer(Clock::time_point now) {
+  deadline_ = now + std::chrono::seconds(cfg_.interval);
+
+  std::string stats = sample();
+  logger_->debug("{}", stats);
+
+  std::lock_guard<std::mutex> lock(cbMutex_);
+  if (statsCallback_)
+    statsCallback_(std::move(stats));
+}
+
+std::string ResourceMonitor::sample(void) {
+  const auto now = Clock::now();
+  const double elapsed =
+      std::chrono::duration<double>(now - lastSample_).count();
+  lastSample_ = now;
+  static const long ticksPerSecond = sysconf(_SC_CLK_TCK);
+
+  json stats;
+  stats["time"] = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      std::chrono::system_clock::now().time_since_epoch())
+                      .count();
+
+  // --- CPU time per thread, share of one CPU since the last sample ---
+  const std::vector<int> tids = listProc("/proc/self/task");
+  std::map<int, uint64_t> ticks;
+  json threads = json::array();
+  for (int tid : tids) {
+    std::string name;
+    uint64_t total = 0;
+    if (!readTaskStat(tid, name, total))
+      continue; // exited meanwhile
+    ticks[tid] = total;
+
+    auto last = lastTicks_.find(tid);
+    const uint64_t delta = last != lastTicks_.end() && total >= last->second
+                               ? total - last->second
+                               : total;
+    const double percent =
+        elapsed > 0.0 ? 100.0 * delta / ticksPerSecond / elapsed : 0.0;
+    threads.push_back({
+        {"name", name},
+        {"tid", tid},
+        {"cpu_time", static_cast<double>(total) / ticksPerSecond},
+        {"cpu_percent", std::round(percent * 10.0) / 10.0},
+    });
+  }
+  lastTicks_ = std::move(ticks);
+  stats["thread_count"] = threads.size();
+
+  // --- Memory: resident set and C library heap ---
+  long pages = 0, residentPages = 0;
+  if (FILE *statm = std::fopen("/proc/self/statm", "r")) {
+    if (std::fscanf(statm, "%ld %ld", &pages, &residentPages) != 2)
+      residentPages = 0;
+    std::fclose(statm);
+  }
+  const long pageSize = sysconf(_SC_PAGESIZE);
+  stats["rss_kb"] = residentPages * pageSize / 1024;
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 33)
+  const struct mallinfo2 heap = mallinfo2();
+  stats["heap"] = {
+      {"arena_kb", (heap.arena + heap.hblkhd) / 1024},
+      {"used_kb", (heap.uordblks + heap.hblkhd) / 1024},
+      {"free_kb", heap.fordblks / 1024},
+  };
+#endif
+#endif
+
+  // --- Open descriptors, without the one listing them ---
+  const size_t fds = listProc("/proc/self/fd").size();
+  stats["fd_count"] = fds > 0 ? fds - 1 : 0;
+
+  stats["threads"] = std::move(threads);
+  return stats.dump();
+}
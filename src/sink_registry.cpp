@@ -0,0 +1,210 @@
+#include "sink_registry.h"
+#include "config_yaml.h"
+#include "logger.h"
+#include "sink.h"
+#include "sinks.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+// Input a record of this kind is delivered for
+unsigned inputOf(SinkRecord::Kind kind) {
+  switch (kind) {
+  case SinkRecord::Kind::TELEGRAM:
+    return Sink::TELEGRAMS;
+  case SinkRecord::Kind::VALUES:
+  case SinkRecord::Kind::DEVICE:
+    return Sink::VALUES | Sink::PAYLOADS;
+  default:
+    return Sink::PAYLOADS;
+  }
+}
+
+} // namespace
+
+// Queue and thread of one sink
+class SinkRegistry::Worker {
+public:
+  Worker(std::string name, std::unique_ptr<Sink> sink,
+         const SinkOptions &options, std::shared_ptr<spdlog::logger> logger)
+      : name_(std::move(name)), sink_(std::move(sink)), options_(options),
+        inputs_(sink_->inputs()), logger_(std::move(logger)) {
+    thread_ = std::thread(&Worker::run, this);
+  }
+
+  ~Worker() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_one();
+    if (thread_.joinable())
+      thread_.join();
+  }
+
+  const std::string &name(void) const { return name_; }
+  unsigned inputs(void) const { return inputs_; }
+  std::thread::native_handle_type thread(void) {
+    return thread_.native_handle();
+  }
+
+  void push(const Sink::Record &record) {
+    bool wake = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (queue_.size() >= static_cast<size_t>(options_.queue)) {
+        ++dropped_;
+        if (options_.drop == DropPolicy::Newest)
+          return;
+        queue_.pop_front();
+      }
+      queue_.push_back(record);
+
+      // The thread waits for the first record or for a full batch
+      wake = queue_.size() == 1 ||
+             queue_.size() == static_cast<size_t>(options_.batch);
+    }
+    if (wake)
+      cv_.notify_one();
+  }
+
+private:
+  void run(void) {
+    const std::chrono::milliseconds flushInterval(options_.flushInterval);
+    const auto batchSize = static_cast<size_t>(options_.batch);
+    std::vector<Sink::Record> batch;
+    batch.reserve(batchSize);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (queue_.empty())
+        break; // stopping and all written
+
+      // A partial batch waits for more, at most flush_interval
+      if (queue_.size() < batchSize && flushInterval.count() > 0 &&
+          !stopping_) {
+        cv_.wait_for(lock, flushInterval, [this, batchSize] {
+          return stopping_ || queue_.size() >= batchSize;
+        });
+      }
+
+      const auto count =
+          static_cast<std::ptrdiff_t>(std::min(queue_.size(), batchSize));
+      std::move(queue_.begin(), queue_.begin() + count,
+                std::back_inserter(batch));
+      queue_.erase(queue_.begin(), queue_.begin() + count);
+      const uint64_t dropped = std::exchange(dropped_, 0);
+      lock.unlock();
+
+      if (dropped) {
+        dropLog_.log(*logger_, spdlog::level::warn,
+                     "Sink '{}' not keeping up, {} record(s) dropped", name_,
+                     dropped);
+      }
+      auto result = sink_->write(batch);
+      if (!result) {
+        errorLog_.log(*logger_, spdlog::level::warn, "Sink '{}': {}", name_,
+                      [&result] { return result.error().describe(); });
+      }
+      batch.clear();
+
+      lock.lock();
+    }
+  }
+
+  const std::string name_;
+  std::unique_ptr<Sink> sink_;
+  const SinkOptions options_;
+  const unsigned inputs_;
+  std::shared_ptr<spdlog::logger> logger_;
+  LogLimiter dropLog_;
+  LogLimiter errorLog_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Sink::Record> queue_;
+  uint64_t dropped_{0}; // since the last write
+  bool stopping_{false};
+  std::thread thread_;
+};
+
+SinkRegistry::SinkRegistry(void) {
+  sinkLogger_ = spdlog::get("sink");
+  if (!sinkLogger_)
+    sinkLogger_ = spdlog::default_logger();
+
+  addType("file", [](const SinkConfig &cfg) {
+    return std::make_unique<FileSink>(*cfg.file);
+  });
+  addType("influx", [](const SinkConfig &cfg) {
+    return std::make_unique<InfluxSink>(*cfg.influx);
+  });
+}
+
+// Workers are destroyed in reverse order, each writes what is left queued
+SinkRegistry::~SinkRegistry() {
+  while (!workers_.empty())
+    workers_.pop_back();
+}
+
+void SinkRegistry::addType(const std::string &type, Factory factory) {
+  factories_[type] = std::move(factory);
+}
+
+void SinkRegistry::create(const SinkConfig &cfg) {
+  auto it = factories_.find(cfg.type);
+  if (it == factories_.end())
+    throw std::invalid_argument("Sink '" + cfg.name + "': unknown type '" +
+                                cfg.type + "'");
+  add(cfg.name, it->second(cfg), cfg.options);
+}
+
+void SinkRegistry::add(const std::string &name, std::unique_ptr<Sink> sink,
+                       const SinkOptions &options) {
+  const bool used = std::any_of(
+      workers_.begin(), workers_.end(),
+      [&name](const auto &worker) { return worker->name() == name; });
+  if (used)
+    throw std::invalid_argument("Sink name '" + name + "' is already used");
+
+  inputs_ |= sink->inputs();
+  workers_.push_back(
+      std::make_unique<Worker>(name, std::move(sink), options, sinkLogger_));
+  sinkLogger_->debug("Started sink '{}' (queue {}, batch {}, flush {} ms)",
+                     name, options.queue, options.batch,
+                     options.flushInterval);
+}
+
+bool SinkRegistry::wants(Sink::Input input) const { return inputs_ & input; }
+
+void SinkRegistry::dispatch(SinkRecord record) {
+  const unsigned input = inputOf(record.kind);
+  if (!(inputs_ & input))
+    return;
+
+  record.time = std::chrono::system_clock::now();
+  const Sink::Record shared =
+      std::make_shared<const SinkRecord>(std::move(record));
+  for (const auto &worker : workers_) {
+    if (worker->inputs() & input)
+      worker->push(shared);
+  }
+}
+
+std::vector<std::pair<std::string, std::thread::native_handle_type>>
+SinkRegistry::threads(void) {
+  std::vector<std::pair<std::string, std::thread::native_handle_type>> threads;
+  for (const auto &worker : workers_)
+    threads.emplace_back(worker->name(), worker->thread());
+  return threads;
+}
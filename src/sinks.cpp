@@ -0,0 +1,399 @@
+#include "sinks.h"
+#include "config_yaml.h"
+#include "json_utils.h"
+#include "meter_types.h"
+#include "modbus_error.h"
+#include "sink.h"
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <iterator>
+#include <map>
+#include <netdb.h>
+#include <nlohmann/json.hpp>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/un.h>
+#include <unistd.h>
+
+using json = nlohmann::json;
+
+namespace {
+
+// Fields of an Influx line, named and rounded like the values document
+struct ValueField {
+  const char *key;
+  double MeterTypes::Values::*value;
+  int decimals;
+};
+
+struct PhaseField {
+  const char *key;
+  double MeterTypes::Phase::*value;
+  int decimals;
+};
+
+constexpr std::array<ValueField, 13> VALUE_FIELDS = {{
+    {"energy_active_import", &MeterTypes::Values::activeEnergyImport, 3},
+    {"energy_active_export", &MeterTypes::Values::activeEnergyExport, 3},
+    {"energy_apparent_import", &MeterTypes::Values::apparentEnergyImport, 3},
+    {"energy_apparent_export", &MeterTypes::Values::apparentEnergyExport, 3},
+    {"energy_reactive_import", &MeterTypes::Values::reactiveEnergyImport, 3},
+    {"energy_reactive_export", &MeterTypes::Values::reactiveEnergyExport, 3},
+    {"power_active", &MeterTypes::Values::activePower, 2},
+    {"power_apparent", &MeterTypes::Values::apparentPower, 2},
+    {"power_reactive", &MeterTypes::Values::reactivePower, 2},
+    {"power_factor", &MeterTypes::Values::powerFactor, 2},
+    {"frequency", &MeterTypes::Values::frequency, 2},
+    {"voltage_ph", &MeterTypes::Values::phVoltage, 1},
+    {"voltage_pp", &MeterTypes::Values::ppVoltage, 1},
+}};
+
+constexpr std::array<PhaseField, 7> PHASE_FIELDS = {{
+    {"power_active", &MeterTypes::Phase::activePower, 2},
+    {"power_apparent", &MeterTypes::Phase::apparentPower, 2},
+    {"power_reactive", &MeterTypes::Phase::reactivePower, 2},
+    {"power_factor", &MeterTypes::Phase::powerFactor, 2},
+    {"voltage_ph", &MeterTypes::Phase::phVoltage, 1},
+    {"voltage_pp", &MeterTypes::Phase::ppVoltage, 1},
+    {"current", &MeterTypes::Phase::current, 3},
+}};
+
+// Line protocol escaping: measurements escape commas and spaces, tag keys
+// and values also the equals sign
+void escape(std::string &out, std::string_view text, bool tag) {
+  for (char c : text) {
+    if (c == ',' || c == ' ' || (tag && c == '='))
+      out += '\\';
+    out += c;
+  }
+}
+
+// M-Bus devices only have channels, an electricity meter always reads some
+// energy or voltage
+bool hasElectricity(const MeterTypes::Values &values) {
+  return values.activeEnergyImport != 0.0 ||
+         values.activeEnergyExport != 0.0 || values.phVoltage != 0.0 ||
+         values.phase1.phVoltage != 0.0 || values.activePower != 0.0;
+}
+
+} // namespace
+
+std::expected<void, ModbusError>
+MqttSink::write(std::span<const Record> batch) {
+  const auto root = topicRoot_.load();
+  for (const Record &record : batch)
+    mqtt_.publish(record->payload, *root + record->path());
+  return {};
+}
+
+std::expected<void, ModbusError>
+HttpSink::write(std::span<const Record> batch) {
+  for (const Record &record : batch) {
+    // Availability is plain text and only meant for MQTT
+    if (record->kind != SinkRecord::Kind::AVAILABILITY)
+      http_.publish(record->path(), record->payload);
+  }
+  return {};
+}
+
+std::expected<void, ModbusError>
+SlaveSink::write(std::span<const Record> batch) {
+  bool updated = false;
+  for (const Record &record : batch) {
+    if (!record->primary)
+      continue;
+    if (record->values) {
+      slave_.updateValues(*record->values);
+      updated = true;
+    } else if (record->device) {
+      slave_.updateDevice(*record->device);
+      updated = true;
+    }
+  }
+
+  // The register image once per batch
+  if (updated && snapshot_)
+    snapshot_->setRegisters(slave_.registers());
+  return {};
+}
+
+std::expected<void, ModbusError>
+SnapshotSink::write(std::span<const Record> batch) {
+  const auto root = topicRoot_.load();
+  for (const Record &record : batch) {
+    if (record->kind == SinkRecord::Kind::VALUES)
+      snapshot_.setValues(*root + record->source, record->payload);
+    else if (record->kind == SinkRecord::Kind::DEVICE)
+      snapshot_.setDevice(*root + record->source, record->payload);
+  }
+  return {};
+}
+
+FileSink::FileSink(const FileSinkConfig &cfg) : cfg_(cfg) {
+  fd_ = open(cfg_.path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+             0644);
+  if (fd_ == -1) {
+    throw std::runtime_error(
+        ModbusError::fromErrno("Unable to open sink file '{}'", cfg_.path)
+            .describe());
+  }
+}
+
+FileSink::~FileSink() {
+  if (fd_ != -1)
+    close(fd_);
+}
+
+unsigned FileSink::inputs(void) const {
+  return cfg_.telegrams ? PAYLOADS | TELEGRAMS : PAYLOADS;
+}
+
+std::expected<void, ModbusError>
+FileSink::write(std::span<const Record> batch) {
+  buffer_.clear();
+  for (const Record &record : batch) {
+    const int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           record->time.time_since_epoch())
+                           .count();
+    buffer_ += std::format("{{\"time\":{},\"path\":\"{}\",", ms,
+                           record->path());
+
+    if (record->kind == SinkRecord::Kind::TELEGRAM) {
+      buffer_ += "\"hex\":\"";
+      for (unsigned char c : record->payload)
+        buffer_ += std::format("{:02x}", c);
+      buffer_ += "\"}\n";
+    } else if (record->kind == SinkRecord::Kind::AVAILABILITY) {
+      // Plain text, the documents are JSON already
+      buffer_ += "\"payload\":" + json(record->payload).dump() + "}\n";
+    } else {
+      buffer_ += "\"payload\":" + record->payload + "}\n";
+    }
+  }
+
+  size_t written = 0;
+  while (written < buffer_.size()) {
+    ssize_t n =
+        ::write(fd_, buffer_.data() + written, buffer_.size() - written);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1)
+      return std::unexpected(
+          ModbusError::fromErrno("Unable to write '{}'", cfg_.path));
+    written += static_cast<size_t>(n);
+  }
+  return {};
+}
+
+InfluxSink::InfluxSink(const InfluxSinkConfig &cfg) : cfg_(cfg) {
+  if (!cfg_.socket.empty()) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (cfg_.socket.size() >= sizeof(addr.sun_path)) {
+      throw std::runtime_error("Influx socket path '" + cfg_.socket +
+                               "' is too long");
+    }
+    std::memcpy(addr.sun_path, cfg_.socket.c_str(), cfg_.socket.size() + 1);
+    std::memcpy(&address_, &addr, sizeof(addr));
+    addressLength_ = sizeof(addr);
+    endpoint_ = cfg_.socket;
+    return;
+  }
+
+  addrinfo hints{};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_DGRAM;
+  addrinfo *res = nullptr;
+  int rc = getaddrinfo(cfg_.host.c_str(), std::to_string(cfg_.port).c_str(),
+                       &hints, &res);
+  if (rc != 0) {
+    throw std::runtime_error(std::format(
+        "Unable to resolve Influx host '{}': {}", cfg_.host, gai_strerror(rc)));
+  }
+  std::memcpy(&address_, res->ai_addr, res->ai_addrlen);
+  addressLength_ = res->ai_addrlen;
+  freeaddrinfo(res);
+  endpoint_ = cfg_.host + ":" + std::to_string(cfg_.port);
+}
+
+InfluxSink::~InfluxSink() {
+  if (fd_ != -1)
+    close(fd_);
+}
+
+std::expected<void, ModbusError> InfluxSink::connect(void) {
+  fd_ = socket(address_.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (fd_ == -1) {
+    return std::unexpected(ModbusError::fromErrno(
+        "Unable to create socket for Influx listener '{}'", endpoint_));
+  }
+  if (::connect(fd_, reinterpret_cast<const sockaddr *>(&address_),
+                addressLength_) == -1) {
+    auto err = ModbusError::fromErrno(
+        "Unable to connect to Influx listener '{}'", endpoint_);
+    close(fd_);
+    fd_ = -1;
+    return std::unexpected(std::move(err));
+  }
+  return {};
+}
+
+const std::string &InfluxSink::prefix(const std::string &source) {
+  auto it = prefixes_.find(source);
+  if (it != prefixes_.end())
+    return it->second;
+
+  // Measurement and tags, sorted by key as Influx prefers
+  std::map<std::string, std::string> tags = cfg_.tags;
+  if (!source.empty())
+    tags["meter"] = source.substr(1);
+  std::string line;
+  escape(line, cfg_.measurement, false);
+  for (const auto &[key, value] : tags) {
+    line += ',';
+    escape(line, key, true);
+    line += '=';
+    escape(line, value, true);
+  }
+  return prefixes_.emplace(source, std::move(line)).first->second;
+}
+
+void InfluxSink::endLine(size_t start) {
+  buffer_ += '\n';
+
+  // A line that does not fit starts the next datagram
+  if (buffer_.size() - packetStart_ > static_cast<size_t>(cfg_.packetSize) &&
+      start > packetStart_) {
+    packets_.push_back(start);
+    packetStart_ = start;
+  }
+}
+
+void InfluxSink::appendValues(const SinkRecord &record) {
+  const MeterTypes::Values &values = *record.values;
+  const std::string &tags = prefix(record.source);
+  const int64_t recordNs =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          record.time.time_since_epoch())
+          .count();
+  const int64_t ns =
+      values.time ? static_cast<int64_t>(values.time) * 1000000 : recordNs;
+  auto out = std::back_inserter(buffer_);
+
+  if (hasElectricity(values)) {
+    const size_t start = buffer_.size();
+    buffer_ += tags;
+    // Line protocol has no nan or inf, such a field is left out
+    char separator = ' ';
+    for (const auto &field : VALUE_FIELDS) {
+      if (!std::isfinite(values.*field.value))
+        continue;
+      std::format_to(out, "{}{}={}", separator, field.key,
+                     JsonUtils::roundTo(values.*field.value, field.decimals));
+      separator = ',';
+    }
+    const bool threePhase = values.phase2.phVoltage > 0.0;
+    const std::array<const MeterTypes::Phase *, 3> phases = {
+        &values.phase1, &values.phase2, &values.phase3};
+    for (size_t i = 0; i < (threePhase ? phases.size() : 1); ++i) {
+      for (const auto &field : PHASE_FIELDS) {
+        if (!std::isfinite(phases[i]->*field.value))
+          continue;
+        std::format_to(
+            out, "{}{}_l{}={}", separator, field.key, i + 1,
+            JsonUtils::roundTo(phases[i]->*field.value, field.decimals));
+        separator = ',';
+      }
+    }
+    std::format_to(out, "{}active_time={}i", separator,
+                   values.activeSensorTime);
+    if (values.tariff)
+      std::format_to(out, ",tariff={}i", values.tariff);
+    std::format_to(out, " {}", ns);
+    endLine(start);
+  }
+
+  // Gas, water and heat: a line per channel, at its own capture time
+  for (const auto &channel : values.channels) {
+    if (!std::isfinite(channel.value))
+      continue; // the value is the only field
+    const size_t start = buffer_.size();
+    buffer_ += tags;
+    std::format_to(out, ",channel={},medium={}", channel.id, channel.medium);
+    if (!channel.serialNumber.empty()) {
+      buffer_ += ",serial=";
+      escape(buffer_, channel.serialNumber, true);
+    }
+    if (!channel.unit.empty()) {
+      buffer_ += ",unit=";
+      escape(buffer_, channel.unit, true);
+    }
+    std::format_to(out, " value={} {}", JsonUtils::roundTo(channel.value, 3),
+                   channel.time ? static_cast<int64_t>(channel.time) * 1000000
+                                : ns);
+    endLine(start);
+  }
+}
+
+std::expected<void, ModbusError>
+InfluxSink::write(std::span<const Record> batch) {
+  buffer_.clear();
+  packets_.clear();
+  packetStart_ = 0;
+  for (const Record &record : batch) {
+    if (record->kind == SinkRecord::Kind::VALUES && record->values)
+      appendValues(*record);
+  }
+  if (buffer_.size() > packetStart_)
+    packets_.push_back(buffer_.size());
+  if (packets_.empty())
+    return {};
+
+  if (fd_ == -1) {
+    auto result = connect();
+    if (!result)
+      return result;
+  }
+
+  // All datagrams of the batch in one call
+  iov_.resize(packets_.size());
+  messages_.resize(packets_.size());
+  size_t begin = 0;
+  for (size_t i = 0; i < packets_.size(); ++i) {
+    iov_[i] = {buffer_.data() + begin, packets_[i] - begin};
+    messages_[i] = {};
+    messages_[i].msg_hdr.msg_iov = &iov_[i];
+    messages_[i].msg_hdr.msg_iovlen = 1;
+    begin = packets_[i];
+  }
+
+  size_t sent = 0;
+  while (sent < messages_.size()) {
+    int n = sendmmsg(fd_, messages_.data() + sent,
+                     static_cast<unsigned>(messages_.size() - sent),
+                     MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return std::unexpected(ModbusError::custom(
+          EAGAIN, "Influx listener '{}' not keeping up, {} datagram(s) lost",
+          endpoint_, messages_.size() - sent));
+    }
+    if (n == -1) {
+      // E.g. nothing listening; connected again with the next batch
+      auto err = ModbusError::fromErrno(
+          "Unable to send to Influx listener '{}'", endpoint_);
+      close(fd_);
+      fd_ = -1;
+      return std::unexpected(std::move(err));
+    }
+    sent += static_cast<size_t>(n);
+  }
+  return {};
+}
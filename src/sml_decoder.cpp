@@ -0,0 +1,274 @@
+#include "sml_decoder.h"
+#include "crc16.h"
+#include "modbus_error.h"
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <string>
+#include <string_view>
+
+namespace {
+
+// Type field of the type-length byte
+constexpr uint8_t TYPE_OCTETS = 0x00;
+constexpr uint8_t TYPE_BOOL = 0x40;
+constexpr uint8_t TYPE_INT = 0x50;
+constexpr uint8_t TYPE_UINT = 0x60;
+constexpr uint8_t TYPE_LIST = 0x70;
+
+constexpr uint8_t END_OF_MESSAGE = 0x00;
+constexpr uint8_t OPTIONAL_NOT_SET = 0x01;
+constexpr int64_t GET_LIST_RESPONSE = 0x0701;
+constexpr int MAX_DEPTH = 16;
+
+constexpr size_t SEQUENCE_SIZE = 8; // start and end escape sequences
+constexpr char ESCAPE[] = "\x1b\x1b\x1b\x1b";
+
+/**
+ * Walks the type-length-value encoding of SML. Any error moves the cursor to
+ * the end, so a chain of calls joined with && stops at the first problem.
+ */
+class Cursor {
+public:
+  Cursor(const unsigned char *begin, const unsigned char *end)
+      : begin_(begin), p_(begin), end_(end) {}
+
+  bool atEnd(void) const { return p_ >= end_; }
+  size_t offset(void) const { return p_ - begin_; }
+  unsigned char peek(void) const { return atEnd() ? END_OF_MESSAGE : *p_; }
+
+  bool endOfMessage(void) {
+    if (peek() != END_OF_MESSAGE || atEnd())
+      return fail();
+    ++p_;
+    return true;
+  }
+
+  bool list(size_t &count) {
+    uint8_t type;
+    if (!header(type, count))
+      return false;
+    return type == TYPE_LIST || fail();
+  }
+
+  bool listOf(size_t expected) {
+    size_t count;
+    return list(count) && (count == expected || fail());
+  }
+
+  bool skip(int depth = 0) {
+    uint8_t type;
+    size_t len;
+    if (depth > MAX_DEPTH || !header(type, len))
+      return fail();
+    if (type != TYPE_LIST) {
+      p_ += len;
+      return true;
+    }
+    for (size_t i = 0; i < len; ++i) {
+      if (!skip(depth + 1))
+        return false;
+    }
+    return true;
+  }
+
+  // An optional octet string that is not set reads as empty
+  bool octets(std::string_view &out) {
+    uint8_t type;
+    size_t len;
+    if (!header(type, len))
+      return false;
+    if (type != TYPE_OCTETS)
+      return fail();
+    out = std::string_view(reinterpret_cast<const char *>(p_), len);
+    p_ += len;
+    return true;
+  }
+
+  bool integer(int64_t &out, bool &isSet) {
+    isSet = false;
+    if (peek() == OPTIONAL_NOT_SET) {
+      ++p_;
+      return true;
+    }
+
+    uint8_t type;
+    size_t len;
+    if (!header(type, len))
+      return false;
+    if (len == 0 || len > 8 ||
+        (type != TYPE_INT && type != TYPE_UINT && type != TYPE_BOOL))
+      return fail();
+
+    uint64_t raw = 0;
+    for (size_t i = 0; i < len; ++i)
+      raw = (raw << 8) | *p_++;
+
+    // Sign extend negative integers shorter than 8 bytes
+    if (type == TYPE_INT && len < 8 && (raw >> (len * 8 - 1)) & 1)
+      raw |= ~uint64_t{0} << (len * 8);
+
+    out = static_cast<int64_t>(raw);
+    isSet = true;
+    return true;
+  }
+
+  bool value(SmlDecoder::Entry &entry) {
+    const uint8_t type = peek() & 0x70;
+    if (type == TYPE_LIST)
+      return skip();
+    if (type == TYPE_OCTETS)
+      return octets(entry.octets);
+    return integer(entry.value, entry.numeric);
+  }
+
+private:
+  // Returns the payload length, or the element count of a list
+  bool header(uint8_t &type, size_t &len) {
+    if (atEnd())
+      return fail();
+
+    unsigned char b = *p_++;
+    type = b & 0x70;
+    len = b & 0x0f;
+    size_t fieldSize = 1;
+    while (b & 0x80) {
+      if (atEnd() || fieldSize == 4)
+        return fail();
+      b = *p_++;
+      len = (len << 4) | (b & 0x0f);
+      ++fieldSize;
+    }
+
+    if (type == TYPE_LIST)
+      return true;
+
+    // The length of a value includes its type-length field
+    if (len < fieldSize)
+      return fail();
+    len -= fieldSize;
+    return len <= static_cast<size_t>(end_ - p_) || fail();
+  }
+
+  bool fail(void) {
+    p_ = end_;
+    return false;
+  }
+
+  const unsigned char *begin_;
+  const unsigned char *p_;
+  const unsigned char *end_;
+};
+
+bool decodeList(Cursor &cur, const SmlDecoder::Visitor &visitor) {
+  std::string_view serverId;
+  size_t count;
+
+  if (!(cur.listOf(7) && cur.skip() /* clientId */ && cur.octets(serverId) &&
+        cur.skip() /* listName */ && cur.skip() /* actSensorTime */ &&
+        cur.list(count)))
+    return false;
+
+  for (size_t i = 0; i < count; ++i) {
+    SmlDecoder::Entry entry;
+    entry.serverId = serverId;
+    int64_t unit = 0;
+    int64_t scaler = 0;
+    bool isSet;
+
+    if (!(cur.listOf(7) && cur.octets(entry.obis) && cur.skip() /* status */ &&
+          cur.skip() /* valTime */ && cur.integer(unit, isSet) &&
+          cur.integer(scaler, isSet) && cur.value(entry) &&
+          cur.skip() /* valueSignature */))
+      return false;
+
+    entry.unit = static_cast<uint8_t>(unit);
+    entry.scaler = static_cast<int8_t>(scaler);
+    visitor(entry);
+  }
+
+  return cur.skip() /* listSignature */ && cur.skip() /* actGatewayTime */;
+}
+
+bool decodeMessage(Cursor &cur, const SmlDecoder::Visitor &visitor) {
+  int64_t tag = 0;
+  bool isSet;
+
+  return cur.listOf(6) && cur.skip() /* transactionId */ &&
+         cur.skip() /* groupNo */ && cur.skip() /* abortOnError */ &&
+         cur.listOf(2) && cur.integer(tag, isSet) &&
+         (tag == GET_LIST_RESPONSE ? decodeList(cur, visitor) : cur.skip()) &&
+         cur.skip() /* crc16 */ && cur.endOfMessage();
+}
+
+} // namespace
+
+double SmlDecoder::Entry::scaled(void) const {
+  return static_cast<double>(value) * std::pow(10.0, scaler);
+}
+
+std::expected<void, ModbusError>
+SmlDecoder::decode(std::string &frame, const Visitor &visitor) {
+  const size_t size = frame.size();
+  if (size < 2 * SEQUENCE_SIZE) {
+    return std::unexpected(
+        ModbusError::custom(EPROTO, "decode(): Truncated SML file"));
+  }
+
+  auto *raw = reinterpret_cast<unsigned char *>(frame.data());
+
+  // The checksum covers everything up to the checksum itself, little endian
+  const uint16_t received = raw[size - 2] | raw[size - 1] << 8;
+  const uint16_t computed =
+      Crc16::x25(std::string_view(frame.data(), size - 2));
+  if (received != computed) {
+    return std::unexpected(ModbusError::custom(
+        EBADMSG, "decode(): SML checksum mismatch (received {:04x}, "
+                 "computed {:04x})",
+        received, computed));
+  }
+
+  const size_t padding = raw[size - 3];
+
+  // Unescape in place, the payload only shrinks
+  const size_t end = size - SEQUENCE_SIZE;
+  size_t out = SEQUENCE_SIZE;
+  int escapeRun = 0;
+  for (size_t in = SEQUENCE_SIZE; in < end;) {
+    const unsigned char c = raw[in++];
+    raw[out++] = c;
+    escapeRun = c == ESCAPE[0] ? escapeRun + 1 : 0;
+    if (escapeRun == 4) {
+      if (end - in < 4 || std::memcmp(raw + in, ESCAPE, 4) != 0) {
+        return std::unexpected(ModbusError::custom(
+            EPROTO, "decode(): Unexpected SML escape sequence"));
+      }
+      in += 4;
+      escapeRun = 0;
+    }
+  }
+
+  if (padding > 3 || out - SEQUENCE_SIZE < padding) {
+    return std::unexpected(ModbusError::custom(
+        EPROTO, "decode(): Invalid SML padding {}", padding));
+  }
+
+  Cursor cur(raw + SEQUENCE_SIZE, raw + out - padding);
+  while (!cur.atEnd()) {
+    // Fill bytes between messages
+    if (cur.peek() == END_OF_MESSAGE) {
+      cur.endOfMessage();
+      continue;
+    }
+
+    const size_t offset = cur.offset();
+    if (!decodeMessage(cur, visitor)) {
+      return std::unexpected(ModbusError::custom(
+          EPROTO, "decode(): Malformed SML message at offset {}", offset));
+    }
+  }
+
+  return {};
+}
@@ -0,0 +1,237 @@
+#include "snapshot.h"
+#include "config_yaml.h"
+#include "crc16.h"
+#include "modbus_error.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <expected>
+#include <fcntl.h>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <sstream>
+#include <string>
+#include <unistd.h>
+
+using json = nlohmann::ordered_json;
+
+namespace {
+
+constexpr std::string_view MAGIC = "smartmeter-gateway snapshot";
+
+uint64_t nowMs(void) {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+Snapshot::Snapshot(const SnapshotConfig &cfg)
+    : cfg_(cfg), deadline_(Clock::now() + std::chrono::seconds(cfg.interval)) {
+  logger_ = spdlog::get("main");
+  if (!logger_)
+    logger_ = spdlog::default_logger();
+}
+
+void Snapshot::setValues(const std::string &topic, std::string json) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  data_.topics[topic].values = std::move(json);
+  data_.time = nowMs();
+  dirty_ = true;
+}
+
+void Snapshot::setDevice(const std::string &topic, std::string json) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  data_.topics[topic].device = std::move(json);
+  data_.time = nowMs();
+  dirty_ = true;
+}
+
+void Snapshot::setRegisters(std::vector<uint16_t> registers) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  data_.registers = std::move(registers);
+  data_.time = nowMs();
+  dirty_ = true;
+}
+
+void Snapshot::restore(Data data) {
+  // Keeps the time of the readings, a restart does not make them fresh
+  std::lock_guard<std::mutex> lock(mutex_);
+  data_ = std::move(data);
+  dirty_ = false;
+}
+
+void Snapshot::onTimer(Clock::time_point now) {
+  deadline_ = now + std::chrono::seconds(cfg_.interval);
+
+  auto result = save();
+  if (!result)
+    logger_->warn("Unable to write snapshot: {}", result.error().describe());
+}
+
+std::expected<void, ModbusError> Snapshot::save(void) {
+  // A copy keeps the sinks updating while it is encoded and written
+  Data data;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!dirty_)
+      return {};
+    dirty_ = false;
+    data = data_;
+  }
+
+  // Payloads are stored as JSON, not as escaped strings, to stay readable
+  json topics = json::object();
+  for (const auto &[topic, payloads] : data.topics) {
+    json entry = json::object();
+    json values = json::parse(payloads.values, nullptr, false);
+    json device = json::parse(payloads.device, nullptr, false);
+    if (!values.is_discarded())
+      entry["values"] = std::move(values);
+    if (!device.is_discarded())
+      entry["device"] = std::move(device);
+    topics[topic] = std::move(entry);
+  }
+
+  json body;
+  body["time"] = data.time;
+  body["topics"] = std::move(topics);
+  body["registers"] = std::move(data.registers);
+
+  const std::string text = body.dump();
+  const std::string content =
+      std::format("{} {} {} {:04x}\n{}", MAGIC, VERSION, text.size(),
+                  Crc16::x25(text), text);
+
+  auto result = write(content);
+  if (!result) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dirty_ = true;
+    return result;
+  }
+
+  logger_->debug("Snapshot written to '{}' ({} bytes)", cfg_.path,
+                 content.size());
+  return {};
+}
+
+std::expected<void, ModbusError> Snapshot::write(const std::string &content) {
+  std::lock_guard<std::mutex> lock(fileMutex_);
+  const std::string tmp = cfg_.path + ".tmp";
+
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1) {
+    return std::unexpected(
+        ModbusError::fromErrno("Unable to create '{}'", tmp));
+  }
+
+  size_t done = 0;
+  while (done < content.size()) {
+    ssize_t n = ::write(fd, content.data() + done, content.size() - done);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1) {
+      int saved_errno = errno;
+      close(fd);
+      unlink(tmp.c_str());
+      errno = saved_errno;
+      return std::unexpected(
+          ModbusError::fromErrno("Unable to write '{}'", tmp));
+    }
+    done += static_cast<size_t>(n);
+  }
+
+  // The data has to be on disk before the rename makes it visible
+  if (fsync(fd) == -1 || close(fd) == -1) {
+    int saved_errno = errno;
+    unlink(tmp.c_str());
+    errno = saved_errno;
+    return std::unexpected(ModbusError::fromErrno("Unable to sync '{}'", tmp));
+  }
+
+  if (rename(tmp.c_str(), cfg_.path.c_str()) == -1) {
+    int saved_errno = errno;
+    unlink(tmp.c_str());
+    errno = saved_errno;
+    return std::unexpected(ModbusError::fromErrno(
+        "Unable to rename '{}' to '{}'", tmp, cfg_.path));
+  }
+
+  // Persist the rename itself, best effort
+  const auto slash = cfg_.path.rfind('/');
+  const std::string dir =
+      slash == std::string::npos ? "." : cfg_.path.substr(0, slash + 1);
+  int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dirFd != -1) {
+    fsync(dirFd);
+    close(dirFd);
+  }
+
+  return {};
+}
+
+std::expected<Snapshot::Data, ModbusError> Snapshot::load(void) const {
+  std::ifstream file(cfg_.path, std::ios::binary);
+  if (!file) {
+    return std::unexpected(
+        ModbusError::custom(ENOENT, "No snapshot at '{}'", cfg_.path));
+  }
+
+  // --- Header: magic, version, body size and CRC16 ---
+  std::string header;
+  std::getline(file, header);
+  std::string body{std::istreambuf_iterator<char>(file),
+                   std::istreambuf_iterator<char>()};
+
+  int version = 0;
+  size_t size = 0;
+  unsigned crc = 0;
+  std::istringstream fields(header);
+  if (!header.starts_with(MAGIC) || !fields.ignore(MAGIC.size()) ||
+      !(fields >> version >> size >> std::hex >> crc)) {
+    return std::unexpected(ModbusError::custom(
+        EBADMSG, "'{}' is not a snapshot file", cfg_.path));
+  }
+  if (version != VERSION) {
+    return std::unexpected(ModbusError::custom(
+        EBADMSG, "Snapshot '{}' has version {}, expected {}", cfg_.path,
+        version, VERSION));
+  }
+  if (body.size() != size || Crc16::x25(body) != crc) {
+    return std::unexpected(ModbusError::custom(
+        EBADMSG, "Snapshot '{}' is truncated or corrupt", cfg_.path));
+  }
+
+  // --- Body ---
+  Data data;
+  try {
+    const json root = json::parse(body);
+    data.time = root.at("time").get<uint64_t>();
+    for (const auto &[topic, entry] : root.at("topics").items()) {
+      Payloads &payloads = data.topics[topic];
+      if (entry.contains("values"))
+        payloads.values = entry["values"].dump();
+      if (entry.contains("device"))
+        payloads.device = entry["device"].dump();
+    }
+    data.registers = root.at("registers").get<std::vector<uint16_t>>();
+  } catch (const json::exception &e) {
+    return std::unexpected(ModbusError::custom(
+        EBADMSG, "Snapshot '{}' is malformed: {}", cfg_.path, e.what()));
+  }
+
+  // Plausible data only, a meter that was offline for days is not
+  const uint64_t now = nowMs();
+  const uint64_t age = now > data.time ? (now - data.time) / 1000 : 0;
+  if (age > static_cast<uint64_t>(cfg_.maxAge)) {
+    return std::unexpected(ModbusError::custom(
+        ETIMEDOUT, "Snapshot '{}' is {} s old, max_age is {} s", cfg_.path,
+        age, cfg_.maxAge));
+  }
+
+  return data;
+}
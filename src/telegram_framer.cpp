@@ -0,0 +1,354 @@
+#include "telegram_framer.h"
+#include "flight_recorder.h"
+#include "probes.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace {
+
+constexpr uint64_t SML_START = 0x1b1b1b1b01010101;
+constexpr uint32_t SML_ESCAPE = 0x1b1b1b1b;
+constexpr unsigned char SML_ESCAPE_BYTE = 0x1b;
+constexpr uint32_t SML_VERSION_1 = 0x01010101;
+constexpr unsigned char SML_END = 0x1a;
+constexpr unsigned char GLO_CIPHERING = 0xdb;
+constexpr unsigned char SYSTEM_TITLE_SIZE = 8;
+constexpr unsigned char MBUS_ACK = 0xe5;
+constexpr unsigned char MBUS_START = 0x68;
+constexpr unsigned char MBUS_STOP = 0x16;
+constexpr unsigned char PARITY_MARK = 0xff;
+
+// A telegram completed in any part of a chunk wins over a dropped one
+void merge(TelegramFramer::Status &status, TelegramFramer::Status next) {
+  if (next == TelegramFramer::Status::COMPLETE ||
+      (next == TelegramFramer::Status::OVERFLOW &&
+       status == TelegramFramer::Status::INCOMPLETE))
+    status = next;
+}
+
+} // namespace
+
+TelegramFramer::TelegramFramer(size_t maxSize, Format format)
+    : maxSize_(maxSize), format_(format) {
+  buffer_.reserve(maxSize_);
+}
+
+TelegramFramer::Status TelegramFramer::push(std::string_view data) {
+  stats_.bytes += data.size();
+  if (!parityMarking_)
+    return dispatch(data);
+
+  // PARMRK: ff ff is a data byte ff, ff 00 X a byte X received with an error
+  Status status = Status::INCOMPLETE;
+  size_t start = 0;
+
+  for (size_t i = 0; i < data.size(); ++i) {
+    const auto c = static_cast<unsigned char>(data[i]);
+
+    if (mark_ == 0) {
+      if (c != PARITY_MARK)
+        continue;
+      merge(status, dispatch(data.substr(start, i - start)));
+      mark_ = 1;
+    } else if (mark_ == 1 && c != 0) {
+      merge(status, dispatch(std::string_view("\xff", 1)));
+      mark_ = 0;
+      start = c == PARITY_MARK ? i + 1 : i;
+    } else if (mark_ == 1) {
+      mark_ = 2;
+    } else {
+      markError();
+      mark_ = 0;
+      start = i + 1;
+    }
+  }
+
+  if (mark_ == 0)
+    merge(status, dispatch(data.substr(start)));
+  return status;
+}
+
+TelegramFramer::Status TelegramFramer::dispatch(std::string_view data) {
+  if (format_ == Format::SML)
+    return pushSml(data);
+  if (format_ == Format::GCM)
+    return pushGcm(data);
+  if (format_ == Format::MBUS)
+    return pushMbus(data);
+  return pushText(data);
+}
+
+TelegramFramer::Status TelegramFramer::pushText(std::string_view data) {
+  Status status = Status::INCOMPLETE;
+
+  for (char c : data) {
+    if (inTelegram_ && c == '/') {
+      // IEC 62056-21 data sets never contain '/', the meter started over
+      ++stats_.truncated;
+      inTelegram_ = false;
+    }
+
+    if (!inTelegram_) {
+      if (c != '/') {
+        ++stats_.discarded;
+        ++hunted_;
+        continue;
+      }
+      begin(0);
+      trailer_ = -1;
+      buffer_.clear();
+    }
+
+    buffer_.push_back(c);
+
+    // '!' is followed by CR LF, in DSMR 4+ by a CRC16 in hex and CR LF
+    if (trailer_ < 0 && c == '!') {
+      trailer_ = format_ == Format::DSMR ? 6 : 2;
+    } else if (trailer_ > 0 && (--trailer_ == 0 || c == '\n')) {
+      complete(status);
+      continue;
+    }
+
+    if (buffer_.size() >= maxSize_)
+      drop(status);
+  }
+
+  return status;
+}
+
+TelegramFramer::Status TelegramFramer::pushSml(std::string_view data) {
+  Status status = Status::INCOMPLETE;
+
+  for (char ch : data) {
+    const auto c = static_cast<unsigned char>(ch);
+
+    if (!inTelegram_) {
+      window_ = (window_ << 8) | c;
+      ++stats_.discarded;
+      ++hunted_;
+      if (window_ != SML_START)
+        continue;
+      begin(8);
+      escapeRun_ = 0;
+      commandBytes_ = 0;
+      window_ = 0;
+      buffer_.assign("\x1b\x1b\x1b\x1b\x01\x01\x01\x01", 8);
+      continue;
+    }
+
+    buffer_.push_back(ch);
+
+    if (commandBytes_ == 0) {
+      escapeRun_ = c == SML_ESCAPE_BYTE ? escapeRun_ + 1 : 0;
+      if (escapeRun_ == 4) {
+        escapeRun_ = 0;
+        commandBytes_ = 4;
+      }
+    } else if (--commandBytes_ == 0) {
+      // Four bytes following an escape sequence
+      const auto *command =
+          reinterpret_cast<const unsigned char *>(buffer_.data()) +
+          buffer_.size() - 4;
+      const uint32_t word = static_cast<uint32_t>(command[0]) << 24 |
+                            static_cast<uint32_t>(command[1]) << 16 |
+                            static_cast<uint32_t>(command[2]) << 8 |
+                            command[3];
+
+      if (command[0] == SML_END) {
+        complete(status);
+        continue;
+      }
+      if (word == SML_VERSION_1) {
+        buffer_.erase(0, buffer_.size() - 8); // restarted by the meter
+        ++stats_.truncated;
+      } else if (word != SML_ESCAPE) {
+        drop(status);
+        continue;
+      }
+    }
+
+    if (buffer_.size() >= maxSize_)
+      drop(status);
+  }
+
+  return status;
+}
+
+TelegramFramer::Status TelegramFramer::pushGcm(std::string_view data) {
+  Status status = Status::INCOMPLETE;
+
+  for (char ch : data) {
+    const auto c = static_cast<unsigned char>(ch);
+
+    if (!inTelegram_) {
+      if (c != GLO_CIPHERING) {
+        ++stats_.discarded;
+        ++hunted_;
+        continue;
+      }
+      begin(0);
+      frameSize_ = 0;
+      buffer_.clear();
+    }
+
+    buffer_.push_back(ch);
+    const size_t size = buffer_.size();
+
+    // Tag, title length, system title and a length field of 1 to 3 bytes
+    if (frameSize_ == 0) {
+      const auto *header =
+          reinterpret_cast<const unsigned char *>(buffer_.data());
+      if (size == 2 && c != SYSTEM_TITLE_SIZE) {
+        drop(status);
+      } else if (size == 11 && c < 0x80) {
+        frameSize_ = size + c;
+      } else if (size == 11 && c != 0x81 && c != 0x82) {
+        drop(status);
+      } else if (size == 12 && header[10] == 0x81) {
+        frameSize_ = size + c;
+      } else if (size == 13 && header[10] == 0x82) {
+        frameSize_ = size + (static_cast<size_t>(header[11]) << 8 | c);
+      }
+      if (frameSize_ > maxSize_ || (frameSize_ != 0 && frameSize_ == size))
+        drop(status);
+      continue;
+    }
+
+    if (size == frameSize_) {
+      complete(status);
+    }
+  }
+
+  return status;
+}
+
+TelegramFramer::Status TelegramFramer::pushMbus(std::string_view data) {
+  Status status = Status::INCOMPLETE;
+
+  for (char ch : data) {
+    const auto c = static_cast<unsigned char>(ch);
+
+    if (!inTelegram_) {
+      if (c == MBUS_ACK) {
+        begin(0);
+        buffer_.assign(1, ch);
+        complete(status);
+        continue;
+      }
+      if (c != MBUS_START) {
+        ++stats_.discarded;
+        ++hunted_;
+        continue;
+      }
+      begin(0);
+      frameSize_ = 0;
+      buffer_.clear();
+    }
+
+    buffer_.push_back(ch);
+    const size_t size = buffer_.size();
+
+    // 68 L L 68, L bytes from the control field to the checksum, 16
+    if (size == 2) {
+      frameSize_ = c + 6u;
+      if (c < 3 || frameSize_ > maxSize_)
+        drop(status);
+    } else if (size == 3 && ch != buffer_[1]) {
+      drop(status);
+    } else if (size == 4 && c != MBUS_START) {
+      drop(status);
+    } else if (size == frameSize_) {
+      if (c == MBUS_STOP)
+        complete(status);
+      else
+        drop(status);
+    }
+  }
+
+  return status;
+}
+
+void TelegramFramer::begin(size_t startSize) {
+  // The start sequence itself was counted while hunting for it
+  const uint64_t counted = std::min<uint64_t>(hunted_, startSize);
+  stats_.discarded -= counted;
+  if (hunted_ > counted)
+    ++stats_.resyncs;
+  hunted_ = 0;
+  inTelegram_ = true;
+  started_ = std::chrono::steady_clock::now();
+  PROBE(frame_start, static_cast<int>(format_));
+  FlightRecorder::record(FlightRecorder::Event::FRAME_START,
+                         static_cast<int>(format_));
+}
+
+void TelegramFramer::complete(Status &status) {
+  const size_t size = buffer_.size();
+  if (telegrams_.size() >= MAX_QUEUED) {
+    telegrams_.pop_front();
+    ++stats_.overflows;
+  }
+  telegrams_.push_back(std::move(buffer_));
+  buffer_.clear();
+  buffer_.reserve(maxSize_);
+  inTelegram_ = false;
+  ++stats_.telegrams;
+  status = Status::COMPLETE;
+  const int64_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - started_)
+                         .count();
+  PROBE(frame_end, size, us);
+  FlightRecorder::record(FlightRecorder::Event::FRAME_END, size, us);
+}
+
+void TelegramFramer::drop(Status &status) {
+  buffer_.clear();
+  inTelegram_ = false;
+  ++stats_.overflows;
+  if (status != Status::COMPLETE)
+    status = Status::OVERFLOW;
+}
+
+void TelegramFramer::markError(void) {
+  ++stats_.parityErrors;
+  if (inTelegram_) {
+    // The checksum would fail anyway, wait for the next start sequence
+    buffer_.clear();
+    inTelegram_ = false;
+    ++stats_.truncated;
+  } else {
+    ++stats_.discarded;
+    ++hunted_;
+  }
+}
+
+std::string TelegramFramer::take(void) {
+  if (telegrams_.empty())
+    return {};
+  std::string telegram = std::move(telegrams_.front());
+  telegrams_.pop_front();
+  return telegram;
+}
+
+void TelegramFramer::reset(void) {
+  if (inTelegram_)
+    ++stats_.truncated;
+  buffer_.clear();
+  telegrams_.clear();
+  inTelegram_ = false;
+  trailer_ = -1;
+  window_ = 0;
+  escapeRun_ = 0;
+  commandBytes_ = 0;
+  frameSize_ = 0;
+  hunted_ = 0;
+  mark_ = 0;
+}
+
+void TelegramFramer::setParityMarking(bool enable) {
+  parityMarking_ = enable;
+  mark_ = 0;
+}